@@ -14,6 +14,10 @@
 #endif
 #elif FRAMEWORK_ARDUINO
 #include "Arduino.h"
+#else
+// Host builds (simulated transport)
+#include <stdint.h>
+#include <stddef.h>
 #endif
 
 #ifdef __cplusplus
@@ -38,15 +42,93 @@ typedef enum
 	EepromOk								// API is ok
 } EepromErrorState;
 
+typedef struct Eeprom Eeprom;
+typedef struct EepromTrace EepromTrace;
+
+// One part of a transaction. tx may be NULL to clock out 0xff, rx may be NULL to discard.
+typedef struct
+{
+	uint8_t* tx;
+	uint8_t* rx;
+	uint32_t len;
+} EepromSegment;
+
+// Transport capabilities, used by the driver to pick the most efficient transfer form
+#define EEPROM_TRANSPORT_CAP_SEGMENTS	0x01		// transfer() runs a whole segment list in one call
+#define EEPROM_TRANSPORT_CAP_ASYNC		0x02		// startAsync() is available
+
+/*
+ * SPI transport interface. select/deselect drive chip select, the transfer functions
+ * move data while it is asserted. Optional functions are NULL when not supported.
+ * Asynchronous transfers report completion through eeprom_TransportComplete.
+ */
 typedef struct
+{
+	uint32_t caps;
+	EepromErrorState (*init)(Eeprom* eeprom);
+	void (*select)(Eeprom* eeprom);
+	void (*deselect)(Eeprom* eeprom);
+	EepromErrorState (*transmit)(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+	EepromErrorState (*receive)(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+	EepromErrorState (*transmitReceive)(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len);
+	uint32_t (*getTick)(Eeprom* eeprom);			// Millisecond time base for timeouts
+	// Optional
+	EepromErrorState (*transfer)(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments);
+	EepromErrorState (*startAsync)(Eeprom* eeprom, const EepromSegment* segment);
+} EepromTransport;
+
+/*
+ * eeprom_Init only selects the framework default transport when transport is NULL, so an
+ * Eeprom must be zero-initialised (static storage, or "Eeprom eeprom = {0};") before the
+ * application fields are assigned, or be set up with eeprom_InitTransport.
+ */
+struct Eeprom
 {
 	// Application assigned
-#ifdef SPI_EEPROM
+#if FRAMEWORK_STM32CUBE
 	SPI_HandleTypeDef *hspi;
 	GPIO_TypeDef* csPort;
 	uint32_t csPin;
+#elif FRAMEWORK_ARDUINO
+	void* spi;						// SPIClass instance, NULL for the default SPI
+	uint32_t spiClock;				// SCK rate in Hz, 0 for the default
+	uint8_t csPin;
+#endif
+	const EepromTransport* transport;	// NULL selects the framework default in eeprom_Init
+	void* transportCtx;				// Backend specific context (e.g. EepromSim)
+#ifdef EEPROM_TRACE
+	EepromTrace* trace;				// Operation trace (see eeprom_trace.h), NULL to disable
+#endif
+
+	// Driver state
+	void (*asyncComplete)(Eeprom* eeprom, void* arg);
+	void* asyncArg;
+	// Register shadows (M95P32), so protection can be checked without bus traffic
+	uint8_t shadowValid;			// Shadows holding the device's current values (EEPROM_SHADOW_x flags)
+	uint8_t statusShadow;			// Non-volatile status register bits (SRWD, TB, BP2:BP0)
+	uint8_t configShadow;
+	uint8_t volatileShadow;			// BUFEN (BUFLD changes with device activity and is not kept)
+};
+
+// Transport backends
+#if FRAMEWORK_STM32CUBE
+extern const EepromTransport eepromTransportHal;		// HAL blocking transfers
+extern const EepromTransport eepromTransportHalDma;		// HAL DMA transfers, with asynchronous support
+#elif FRAMEWORK_ARDUINO
+extern const EepromTransport eepromTransportArduino;	// Arduino SPI library
+#endif
+
+// Public device geometry, for modules layered on top of the driver
+#ifdef EEPROM_M95
+#define EEPROM_PAGE_SIZE				512			// Maximum number of bytes in a page write
+#endif
+#if defined(M95M04)
+#define EEPROM_DEVICE_SIZE				512000		// EEPROM storage size in bytes
+#elif defined(M95P32)
+#define EEPROM_DEVICE_SIZE				4194304		// EEPROM storage size in bytes (32 Mbit = 4 MB)
+#define EEPROM_SECTOR_SIZE				4096		// Smallest multi-page erase unit (SCER)
+#define EEPROM_BLOCK_SIZE				65536		// Largest erase unit below a chip erase (BKER)
 #endif
-} Eeprom;
 
 #if defined(M95P32)
 // Identification page geometry
@@ -59,6 +141,10 @@ typedef struct
 #define EEPROM_CONFIG_DRV0_BIT			5			// Output driver strength (01 = medium, 10 = low)
 #define EEPROM_CONFIG_DRV1_BIT			6
 
+// Output driver strength values (DRV1:DRV0) for eeprom_SetOutputDrive
+#define EEPROM_DRIVE_MEDIUM				0x01		// Delivered state
+#define EEPROM_DRIVE_LOW				0x02
+
 // Safety register bit positions (read with eeprom_ReadConfigRegisters, cleared with eeprom_ClearSafetyFlags)
 #define EEPROM_SAFETY_ECC3DS_BIT		0			// ECC triple-bit error detected (sticky)
 #define EEPROM_SAFETY_ECC3D_BIT			1			// ECC triple-bit error detected
@@ -77,9 +163,18 @@ typedef struct
 
 //-------------------- PUBLIC FUNCTIONS PROTOTYPES --------------------//
 EepromErrorState eeprom_Init(Eeprom* eeprom);
+EepromErrorState eeprom_InitTransport(Eeprom* eeprom, const EepromTransport* transport, void* transportCtx);
 EepromErrorState eeprom_Write(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr);
 EepromErrorState eeprom_Read(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr);
 EepromErrorState eeprom_EraseAll(Eeprom* eeprom);
+EepromErrorState eeprom_ProgramPage(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr);
+void eeprom_TransportComplete(Eeprom* eeprom);
+
+// Non-blocking primitives. The Start functions return once the instruction is sent;
+// eeprom_IsBusy reports when the cycle has completed.
+EepromErrorState eeprom_WritePageStart(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr);
+EepromErrorState eeprom_ProgramPageStart(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr);
+EepromErrorState eeprom_IsBusy(Eeprom* eeprom, uint8_t* busy);
 
 #if defined(M95P32)
 // Erase operations. Addresses may be anywhere within the page/sector/block to be erased.
@@ -87,6 +182,9 @@ EepromErrorState eeprom_ErasePage(Eeprom* eeprom, uint32_t dataAddr);
 EepromErrorState eeprom_EraseSector(Eeprom* eeprom, uint32_t dataAddr);
 EepromErrorState eeprom_EraseBlock(Eeprom* eeprom, uint32_t dataAddr);
 EepromErrorState eeprom_EraseChip(Eeprom* eeprom);
+EepromErrorState eeprom_ErasePageStart(Eeprom* eeprom, uint32_t dataAddr);
+EepromErrorState eeprom_EraseSectorStart(Eeprom* eeprom, uint32_t dataAddr);
+EepromErrorState eeprom_EraseBlockStart(Eeprom* eeprom, uint32_t dataAddr);
 
 // Identification pages. Addresses are relative to the start of the ID area:
 // 0x000-0x1FF = device ID page, 0x200-0x3FF = user ID page.
@@ -100,6 +198,18 @@ EepromErrorState eeprom_ReadConfigRegisters(Eeprom* eeprom, uint8_t* configReg,
 EepromErrorState eeprom_ClearSafetyFlags(Eeprom* eeprom);
 EepromErrorState eeprom_ReadVolatileRegister(Eeprom* eeprom, uint8_t* data);
 EepromErrorState eeprom_WriteVolatileRegister(Eeprom* eeprom, uint8_t data);
+EepromErrorState eeprom_SetOutputDrive(Eeprom* eeprom, uint8_t drive);
+
+// Register shadows. The driver keeps copies of the status, configuration and volatile
+// registers, and uses them to reject writes and erases into block protected ranges, and ID
+// page writes once locked, with EepromStorageError before any bus traffic. eeprom_Reset
+// invalidates them itself; call eeprom_InvalidateShadow if the device is reset or its
+// registers are written by anything other than this driver.
+#define EEPROM_SHADOW_STATUS			0x01
+#define EEPROM_SHADOW_CONFIG			0x02
+#define EEPROM_SHADOW_VOLATILE			0x04
+EepromErrorState eeprom_Reset(Eeprom* eeprom);
+void eeprom_InvalidateShadow(Eeprom* eeprom);
 
 // Block write protection. bpLevel 0-7 maps to the BP2:BP0 bits (0 = unprotected,
 // 1-6 = upper/lower 1/64 to 1/2 of the array, 7 = whole array).
@@ -0,0 +1,43 @@
+#ifndef EEPROM_BLOB_H_
+#define EEPROM_BLOB_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Compressed blob storage.
+ * A blob is stored as a 16 byte header, a table of chunk end offsets and the chunk data.
+ * Each EEPROM_BLOB_CHUNK_SIZE bytes of the source are compressed independently (LZSS),
+ * so reading any byte range only decompresses the chunks it touches.
+ * Chunks that do not compress are stored raw and read straight from the device.
+ *
+ * Static RAM use is 2 * EEPROM_BLOB_CHUNK_SIZE + EEPROM_PAGE_SIZE + 2 * EEPROM_BLOB_HASH_SIZE bytes
+ * (3 Kbytes with the defaults).
+ */
+
+#ifndef EEPROM_BLOB_CHUNK_SIZE
+#define EEPROM_BLOB_CHUNK_SIZE			1024		// Uncompressed bytes per chunk (max 4096)
+#endif
+#ifndef EEPROM_BLOB_HASH_SIZE
+#define EEPROM_BLOB_HASH_SIZE			256			// Match finder hash table entries (power of 2)
+#endif
+
+#define EEPROM_BLOB_HEADER_SIZE			16
+
+// Number of chunks for a blob of 'len' bytes
+#define EEPROM_BLOB_NUM_CHUNKS(len)		(((len) + EEPROM_BLOB_CHUNK_SIZE - 1) / EEPROM_BLOB_CHUNK_SIZE)
+// Worst case stored size (every chunk stored raw). Regions must be reserved with this size.
+#define EEPROM_BLOB_MAX_STORED_SIZE(len)	(EEPROM_BLOB_HEADER_SIZE + (4 * EEPROM_BLOB_NUM_CHUNKS(len)) + (len))
+
+EepromErrorState eeprom_BlobSave(Eeprom* eeprom, uint32_t blobAddr, uint32_t maxStoredLen, uint8_t *pData, uint32_t len, uint32_t* storedLen);
+EepromErrorState eeprom_BlobRead(Eeprom* eeprom, uint32_t blobAddr, uint8_t *pData, uint32_t len, uint32_t offset);
+EepromErrorState eeprom_BlobInfo(Eeprom* eeprom, uint32_t blobAddr, uint32_t* len, uint32_t* storedLen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_BLOB_H_ */
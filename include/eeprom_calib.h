@@ -0,0 +1,54 @@
+#ifndef EEPROM_CALIB_H_
+#define EEPROM_CALIB_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SPI clock and output drive calibration.
+ * A reserved, page aligned calibration page holds a short result record followed by a
+ * known test pattern. Calibration reads the pattern back at stepped SPI clock rates
+ * (and, on the M95P32, each output drive strength), keeps the fastest setting that
+ * reads back cleanly, and stores it so later boots can apply it without searching.
+ *
+ * Clock rates are changed through an application callback. Step 0 must be the slowest
+ * (known good) rate and each higher step a faster one. On STM32Cube,
+ * eeprom_SetSpiPrescalerStep can be used directly.
+ */
+
+#ifndef EEPROM_CALIB_PATTERN_LEN
+#define EEPROM_CALIB_PATTERN_LEN		128			// Test pattern bytes read per pass
+#endif
+#ifndef EEPROM_CALIB_PASSES
+#define EEPROM_CALIB_PASSES				8			// Consecutive clean reads required to accept a setting
+#endif
+#ifndef EEPROM_CALIB_MARGIN_STEPS
+#define EEPROM_CALIB_MARGIN_STEPS		0			// Clock steps to back off from the fastest passing step
+#endif
+
+#define EEPROM_CALIB_RECORD_SIZE		8			// Result record at the start of the calibration page
+
+typedef EepromErrorState (*EepromSetClockFn)(Eeprom* eeprom, uint8_t clockStep);
+
+typedef struct
+{
+	uint8_t clockStep;				// Selected clock step (0 = slowest)
+	uint8_t drive;					// Selected output drive (EEPROM_DRIVE_x), 0 if the device has no drive setting
+} EepromSpiCalibration;
+
+EepromErrorState eeprom_CalibrateSpi(Eeprom* eeprom, EepromSetClockFn setClock, uint8_t numClockSteps, uint32_t calibAddr, EepromSpiCalibration* result);
+EepromErrorState eeprom_ApplySpiCalibration(Eeprom* eeprom, EepromSetClockFn setClock, uint8_t numClockSteps, uint32_t calibAddr, EepromSpiCalibration* result);
+
+#if FRAMEWORK_STM32CUBE
+#define EEPROM_SPI_PRESCALER_STEPS		8			// Prescaler /256 (step 0) to /2 (step 7)
+EepromErrorState eeprom_SetSpiPrescalerStep(Eeprom* eeprom, uint8_t clockStep);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_CALIB_H_ */
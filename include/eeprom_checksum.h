@@ -0,0 +1,73 @@
+#ifndef EEPROM_CHECKSUM_H_
+#define EEPROM_CHECKSUM_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Region checksums.
+ * A region is streamed through the checksum in one continuous read transaction (a single
+ * READ instruction, FREAD on the M95P32, with chip select held while the data is clocked
+ * in), so only EEPROM_CHECKSUM_CHUNK bytes of RAM are needed whatever the region size.
+ * Transports with EEPROM_TRANSPORT_CAP_ASYNC receive the next chunk while the current one
+ * is hashed, using two chunk buffers.
+ *
+ * The gain is RAM and transport calls, not throughput: bus time is about the same as
+ * hashing after eeprom_Read into a large buffer (tools/eeprom_checksum_bench.c measures
+ * both), with fewer calls than eeprom_Read in chunk sized pieces.
+ *
+ * EepromChecksumCrc32 is the standard CRC-32 (IEEE 802.3, reflected, as used by zlib), so
+ * values can be compared with those computed by image build tools. On STM32Cube targets with
+ * the HAL CRC module enabled, eeprom_ChecksumUseHardwareCrc hands the CRC calculation to the
+ * CRC peripheral. EepromChecksumFnv1a is a cheaper software hash for change detection.
+ *
+ * eeprom_ChecksumSectors keeps a table of one checksum per sector over a region, and reports
+ * which sectors have changed since the table was last updated.
+ */
+
+#ifdef EEPROM_M95
+
+#ifndef EEPROM_CHECKSUM_CHUNK
+#define EEPROM_CHECKSUM_CHUNK			256			// Bytes per receive (RAM per chunk buffer)
+#endif
+
+#ifndef EEPROM_CHECKSUM_SECTOR_RUN
+#define EEPROM_CHECKSUM_SECTOR_RUN		32			// Sectors per read transaction when reporting changes
+#endif
+
+// Sector size for checksum tables. Devices without sector erase use 4 KB units.
+#ifdef EEPROM_SECTOR_SIZE
+#define EEPROM_CHECKSUM_SECTOR_SIZE		EEPROM_SECTOR_SIZE
+#else
+#define EEPROM_CHECKSUM_SECTOR_SIZE		4096
+#endif
+
+typedef enum
+{
+	EepromChecksumCrc32,
+	EepromChecksumFnv1a
+} EepromChecksumAlgo;
+
+EepromErrorState eeprom_ChecksumRange(Eeprom* eeprom, uint32_t dataAddr, uint32_t len, uint8_t algo, uint32_t* checksum);
+EepromErrorState eeprom_ChecksumSectors(Eeprom* eeprom, uint32_t dataAddr, uint32_t numSectors, uint8_t algo,
+		uint32_t* table, uint8_t* changed);
+
+// Checksums of data in RAM, matching eeprom_ChecksumRange
+uint32_t eeprom_ChecksumBegin(uint8_t algo);
+uint32_t eeprom_ChecksumUpdate(uint8_t algo, uint32_t state, const uint8_t* pData, uint32_t len);
+uint32_t eeprom_ChecksumEnd(uint8_t algo, uint32_t state);
+
+#if FRAMEWORK_STM32CUBE && defined(HAL_CRC_MODULE_ENABLED)
+EepromErrorState eeprom_ChecksumUseHardwareCrc(CRC_HandleTypeDef* hcrc);
+#endif
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_CHECKSUM_H_ */
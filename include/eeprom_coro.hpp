@@ -0,0 +1,173 @@
+#ifndef EEPROM_CORO_HPP_
+#define EEPROM_CORO_HPP_
+
+#include "eeprom.h"
+
+/*
+ * C++20 coroutine interface.
+ * EepromAsync operations return an EepromTask that any coroutine can co_await, whatever
+ * task type its scheduler uses:
+ *
+ *   EepromAsync eepromAsync(&eeprom);
+ *   EepromErrorState status = co_await eepromAsync.write(pData, len, addr);
+ *
+ * An operation suspends while it waits for the device (WIP set during a write, erase or
+ * register write cycle), for an asynchronous transfer to complete (transports with
+ * EEPROM_TRANSPORT_CAP_ASYNC, whose completion interrupt reaches eeprom_TransportComplete),
+ * or for another operation to release the device. Nothing resumes an operation by itself:
+ * the application calls EepromAsync::poll from its executor loop or idle hook, and poll
+ * resumes the operations whose wait has ended (reading the status register once if one is
+ * waiting for the device). setResumer hands the coroutines to the executor instead of
+ * resuming them inside poll.
+ *
+ * Operations hold the device one unit at a time (a page write or erase unit and its cycle,
+ * a read transfer), so operations from several coroutines interleave in FIFO order between
+ * units, and a read waits for at most one write or erase cycle however large the write
+ * queued before it. Like eeprom_Write, write returns once the last page cycle has completed.
+ *
+ * Coroutine frames are allocated with operator new. Code that is not a coroutine can start
+ * a task with EepromTask::start and check EepromTask::done.
+ */
+
+#if defined(EEPROM_M95) && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+
+#ifndef EEPROM_CORO_TRANSFER_MAX
+#define EEPROM_CORO_TRANSFER_MAX		32768		// Largest asynchronous transfer started at once
+#endif
+
+class EepromTask
+{
+public:
+	struct promise_type
+	{
+		EepromErrorState result = EepromOk;
+		std::coroutine_handle<> continuation;
+
+		EepromTask get_return_object() { return EepromTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+			{
+				std::coroutine_handle<> continuation = handle.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+			void await_resume() noexcept {}
+		};
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void return_value(EepromErrorState status) { result = status; }
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	EepromTask(EepromTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+	EepromTask(const EepromTask&) = delete;
+	EepromTask& operator=(const EepromTask&) = delete;
+	~EepromTask() { if(handle) handle.destroy(); }
+
+	// Awaiting runs the operation, and resumes the awaiting coroutine when it completes
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		handle.promise().continuation = awaiting;
+		return handle;
+	}
+	EepromErrorState await_resume() const noexcept { return handle.promise().result; }
+
+	// For callers that are not coroutines: runs the operation to its first suspension
+	void start() { handle.resume(); }
+	bool done() const { return handle.done(); }
+	EepromErrorState result() const { return handle.promise().result; }
+
+private:
+	explicit EepromTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+	std::coroutine_handle<promise_type> handle;
+};
+
+class EepromAsync
+{
+public:
+	explicit EepromAsync(Eeprom* eeprom);
+	EepromAsync(const EepromAsync&) = delete;
+	EepromAsync& operator=(const EepromAsync&) = delete;
+
+	EepromTask read(uint8_t* pData, uint32_t len, uint32_t dataAddr);
+	EepromTask write(const uint8_t* pData, uint32_t len, uint32_t dataAddr);
+	EepromTask readStatusRegister(uint8_t* data);
+#if defined(M95P32)
+	EepromTask erase(uint32_t dataAddr, uint32_t len);		// Page aligned, erased in the largest units that fit
+	EepromTask readConfigRegisters(uint8_t* configReg, uint8_t* safetyReg);
+	EepromTask setBlockProtection(uint8_t bpLevel, uint8_t protectBottom);
+#endif
+
+	void poll();
+	bool idle() const { return !owned; }
+	void setResumer(void (*resumer)(std::coroutine_handle<> handle, void* ctx), void* ctx);
+
+	// Statistics
+	uint32_t suspensions;			// Waits for the device, a transfer or the device lock
+	uint32_t busyPolls;				// Status reads by poll that found the device busy
+
+private:
+	struct Waiter
+	{
+		std::coroutine_handle<> handle;
+		Waiter* next;
+		EepromErrorState result;
+	};
+
+	// Suspends until the device lock is granted
+	struct Acquire : Waiter
+	{
+		EepromAsync* async;
+		bool await_ready() noexcept;
+		void await_suspend(std::coroutine_handle<> handle) noexcept;
+		void await_resume() noexcept {}
+	};
+
+	// Suspends the lock owner until WIP clears, or the ready timeout
+	struct Ready : Waiter
+	{
+		EepromAsync* async;
+		bool await_ready() noexcept;
+		bool await_suspend(std::coroutine_handle<> handle) noexcept;
+		EepromErrorState await_resume() noexcept { return result; }
+	};
+
+	// Suspends the lock owner until the asynchronous transfer completes
+	struct TransferDone : Waiter
+	{
+		EepromAsync* async;
+		bool await_ready() noexcept { return async->transferDone; }
+		void await_suspend(std::coroutine_handle<> handle) noexcept;
+		void await_resume() noexcept {}
+	};
+
+	Acquire acquire() { Acquire a; a.async = this; return a; }
+	Ready waitReady() { Ready r; r.async = this; return r; }
+	TransferDone waitTransfer() { TransferDone t; t.async = this; return t; }
+	void release();
+	void resume(Waiter* waiter);
+	EepromTask transfer(uint8_t* header, uint16_t headerLen, uint8_t* tx, uint8_t* rx, uint32_t len);
+	static void transferComplete(Eeprom* eeprom, void* arg);
+
+	Eeprom* eeprom;
+	bool owned;
+	Waiter* lockHead;
+	Waiter* lockTail;
+	Waiter* granted;				// Lock handed over by release, resumed by the next poll
+	bool cyclePending;				// A cycle started here may still be running
+	Waiter* readyWaiter;
+	uint32_t readyStartMs;
+	Waiter* transferWaiter;
+	volatile bool transferDone;
+	void (*resumer)(std::coroutine_handle<> handle, void* ctx);
+	void* resumerCtx;
+};
+
+#endif
+
+#endif /* EEPROM_CORO_HPP_ */
@@ -0,0 +1,61 @@
+#ifndef EEPROM_IMAGE_H_
+#define EEPROM_IMAGE_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Streaming image writer (e.g. firmware updates received over USB or MIDI SysEx).
+ * Chunks of any size are collected into a page buffer, and each full page is started as
+ * a non-blocking page program, so the program cycle runs while the next chunk arrives.
+ * The writer only waits for the device when a page is ready before the previous cycle has
+ * finished.
+ *
+ * On the M95P32 the region ahead of the write head is erased while the device would
+ * otherwise be idle, in the largest units that fit (64 KB blocks, then 4 KB sectors, then
+ * pages), up to EEPROM_IMAGE_ERASE_AHEAD bytes ahead, and pages are written with page
+ * program (PGPR). Other devices use non-blocking page writes.
+ *
+ * eeprom_ImageFinish writes the last partial page, then reads the image back with
+ * eeprom_ChecksumRange and compares its CRC-32 with the CRC of the data appended.
+ */
+
+#ifdef EEPROM_M95
+
+#ifndef EEPROM_IMAGE_ERASE_AHEAD
+#define EEPROM_IMAGE_ERASE_AHEAD		65536		// Bytes kept erased ahead of the write head
+#endif
+
+typedef struct
+{
+	Eeprom* eeprom;
+	uint32_t start;					// Region start (page aligned)
+	uint32_t end;					// Region end (page aligned)
+	uint32_t pageAddr;				// Page being filled
+	uint32_t erasedEnd;				// End of the erased area ahead of pageAddr (M95P32)
+	uint32_t length;				// Bytes appended
+	uint32_t crc;					// CRC-32 state of the bytes appended
+	uint16_t fill;					// Bytes in pageBuf
+	uint8_t pageBuf[EEPROM_PAGE_SIZE];
+
+	// Statistics
+	uint32_t pagesWritten;
+	uint32_t erases;
+	uint32_t waits;					// Pages that had to wait for the previous cycle
+} EepromImageWriter;
+
+EepromErrorState eeprom_ImageOpen(EepromImageWriter* writer, Eeprom* eeprom, uint32_t start, uint32_t maxLen);
+EepromErrorState eeprom_ImageAppend(EepromImageWriter* writer, const uint8_t* pData, uint32_t len);
+EepromErrorState eeprom_ImagePoll(EepromImageWriter* writer);
+EepromErrorState eeprom_ImageFinish(EepromImageWriter* writer, uint32_t* crc);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_IMAGE_H_ */
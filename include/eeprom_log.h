@@ -0,0 +1,74 @@
+#ifndef EEPROM_LOG_H_
+#define EEPROM_LOG_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Append-only circular record log.
+ * Fixed size records are collected in a RAM page buffer and written a full page at a
+ * time, each page carrying a header (sequence number, record count, CRC-16). Pages are
+ * written round the region in order, so the sequence number of every page follows from
+ * its position and the newest and oldest pages are found at boot with two binary searches
+ * (about 2 * log2(pages) page reads) instead of a scan.
+ *
+ * On the M95P32 the sector after the head is erased when the head enters a new sector
+ * (dropping the oldest sector of records), and pages are then written with page program
+ * (PGPR) instead of page write. The log holds numSectors - 1 sectors of records. Other
+ * devices write pages in place and the log holds the whole region, laid out in 4 KB units.
+ * The region is at least three sectors.
+ *
+ * Records still in the page buffer are lost on reset; eeprom_LogFlush writes them out as a
+ * partial page (e.g. before shutdown).
+ */
+
+#ifdef EEPROM_M95
+
+#define EEPROM_LOG_PAGE_HEADER_SIZE		8
+
+typedef struct
+{
+	Eeprom* eeprom;
+	uint32_t start;					// Region start (sector aligned)
+	uint16_t numSectors;
+	uint16_t recordSize;
+	uint16_t recordsPerPage;
+	uint16_t sectorPages;
+	uint32_t numPages;
+	uint32_t headPage;				// Next page to be written
+	uint32_t headSeq;				// Sequence number of the next page
+	uint32_t tailSeq;				// Sequence number of the oldest page held
+	uint8_t headErased;				// headPage is known to be erased
+	uint16_t bufCount;				// Records in pageBuf
+	uint8_t pageBuf[EEPROM_PAGE_SIZE];
+
+	// Statistics
+	uint32_t pagesWritten;
+	uint32_t sectorsErased;
+	uint32_t bootReads;				// Pages read by eeprom_LogInit
+} EepromLog;
+
+typedef struct
+{
+	uint32_t seq;					// Page being read
+	uint16_t index;					// Next record in the page
+	uint16_t count;					// Records in the page, 0 until loaded
+} EepromLogCursor;
+
+EepromErrorState eeprom_LogInit(EepromLog* log, Eeprom* eeprom, uint32_t start, uint16_t numSectors, uint16_t recordSize);
+EepromErrorState eeprom_LogAppend(EepromLog* log, const void* record);
+EepromErrorState eeprom_LogFlush(EepromLog* log);
+EepromErrorState eeprom_LogFormat(EepromLog* log);
+void eeprom_LogFirst(EepromLog* log, EepromLogCursor* cursor);
+EepromErrorState eeprom_LogNext(EepromLog* log, EepromLogCursor* cursor, void* record);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_LOG_H_ */
@@ -0,0 +1,63 @@
+#ifndef EEPROM_PART_H_
+#define EEPROM_PART_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Named region partitioner.
+ * Regions are declared by the application with a size and alignment, and laid out once at
+ * init. Every region starts on, and is rounded up to, its alignment unit, so erasing a
+ * region never touches its neighbours and can use the largest erase instructions that fit.
+ * Regions flagged EEPROM_REGION_PROTECT are placed at the top of the array inside a zone
+ * sized to a block protection level, so eeprom_PartitionProtect can write protect exactly
+ * those regions.
+ */
+
+typedef enum
+{
+	EepromAlignPage,				// EEPROM_PAGE_SIZE
+	EepromAlignSector,				// 4 Kbytes
+	EepromAlignBlock				// 64 Kbytes
+} EepromAlign;
+
+#define EEPROM_REGION_PROTECT			0x01		// Place in the block protected zone
+
+typedef struct
+{
+	// Application assigned
+	const char* name;
+	uint32_t size;					// Requested size in bytes, rounded up to the alignment unit
+	uint8_t align;					// EepromAlign
+	uint8_t flags;
+	// Assigned by eeprom_PartitionInit
+	uint32_t start;
+} EepromRegion;
+
+typedef struct
+{
+	EepromRegion* regions;
+	uint8_t numRegions;
+	uint32_t freeStart;				// First address after the unprotected regions
+	uint32_t protectStart;			// Start of the protected zone (EEPROM_DEVICE_SIZE if none)
+	uint8_t protectLevel;			// BP2:BP0 level covering the protected zone, 0 if none
+	uint8_t protectApplied;			// Set while eeprom_PartitionProtect has the zone protected
+} EepromPartitionTable;
+
+EepromErrorState eeprom_PartitionInit(EepromPartitionTable* table, EepromRegion* regions, uint8_t numRegions);
+EepromRegion* eeprom_RegionFind(EepromPartitionTable* table, const char* name);
+EepromErrorState eeprom_RegionRead(Eeprom* eeprom, const EepromRegion* region, uint8_t *pData, uint32_t len, uint32_t offset);
+EepromErrorState eeprom_RegionWrite(Eeprom* eeprom, EepromPartitionTable* table, const EepromRegion* region, uint8_t *pData, uint32_t len, uint32_t offset);
+EepromErrorState eeprom_RegionErase(Eeprom* eeprom, EepromPartitionTable* table, const EepromRegion* region);
+#if defined(M95P32)
+EepromErrorState eeprom_PartitionProtect(Eeprom* eeprom, EepromPartitionTable* table, uint8_t enable);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_PART_H_ */
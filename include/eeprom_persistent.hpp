@@ -0,0 +1,152 @@
+#ifndef EEPROM_PERSISTENT_HPP_
+#define EEPROM_PERSISTENT_HPP_
+
+#include "eeprom.h"
+#include <string.h>
+#include <type_traits>
+
+/*
+ * Typed persistent variables with lazy write-back (C++).
+ * Variables are described by a compile-time layout: each EepromField takes the field before
+ * it (or an EepromLayoutStart), and is placed directly after it unless it would cross a page
+ * boundary while fitting in a page, in which case it moves to the start of the next page.
+ *
+ *   typedef EepromField<float, EepromLayoutStart<0x1000> > VolumeField;
+ *   typedef EepromField<Preset, VolumeField> PresetField;
+ *
+ *   EepromStore settings(&eeprom);
+ *   EepromPersistent<VolumeField> volume(settings);
+ *   EepromPersistent<PresetField> preset(settings);
+ *
+ * EepromStore::load reads every registered variable. Assignments only update RAM and mark
+ * the variable dirty; EepromStore::commit (or EepromStore::poll once the write-back delay
+ * has passed) writes the dirty variables with one eeprom_Write per run of adjacent
+ * variables in a page, so a page's worth of changes costs one page write.
+ */
+
+#ifdef EEPROM_M95
+
+#ifndef EEPROM_PERSISTENT_DELAY_MS
+#define EEPROM_PERSISTENT_DELAY_MS		1000		// Default write-back delay for EepromStore::poll
+#endif
+
+// Address of a size byte variable placed at or after offset, moved to the next page if it
+// would otherwise cross a page boundary it does not need to
+constexpr uint32_t eeprom_LayoutPlace(uint32_t offset, uint32_t size)
+{
+	return (size <= EEPROM_PAGE_SIZE && (offset % EEPROM_PAGE_SIZE) + size > EEPROM_PAGE_SIZE)
+			? offset + (EEPROM_PAGE_SIZE - (offset % EEPROM_PAGE_SIZE)) : offset;
+}
+
+template<uint32_t Addr>
+struct EepromLayoutStart
+{
+	static constexpr uint32_t end = Addr;
+};
+
+template<typename T, typename Prev>
+struct EepromField
+{
+	typedef T Type;
+	static constexpr uint32_t addr = eeprom_LayoutPlace(Prev::end, sizeof(T));
+	static constexpr uint32_t end = addr + sizeof(T);
+
+	static_assert(std::is_trivially_copyable<T>::value, "Persistent types are stored as raw bytes");
+	static_assert(sizeof(T) > EEPROM_PAGE_SIZE || (addr / EEPROM_PAGE_SIZE) == ((end - 1) / EEPROM_PAGE_SIZE),
+			"Field crosses a page boundary");
+	static_assert(end <= EEPROM_DEVICE_SIZE, "Layout exceeds the device");
+};
+
+class EepromStore;
+
+class EepromPersistentBase
+{
+	friend class EepromStore;
+public:
+	EepromPersistentBase(const EepromPersistentBase&) = delete;
+	EepromPersistentBase& operator=(const EepromPersistentBase&) = delete;
+	bool isDirty() const { return dirty; }
+
+protected:
+	EepromPersistentBase(EepromStore& store, uint32_t addr, uint32_t size, void* data);
+	~EepromPersistentBase();
+	void markDirty();
+
+	EepromStore& store;
+	const uint32_t addr;
+	const uint32_t size;
+	uint8_t* const data;
+	bool dirty;
+	EepromPersistentBase* next;		// Store list, in address order
+};
+
+class EepromStore
+{
+	friend class EepromPersistentBase;
+public:
+	EepromStore(Eeprom* eeprom, uint32_t delayMs = EEPROM_PERSISTENT_DELAY_MS);
+	EepromStore(const EepromStore&) = delete;
+	EepromStore& operator=(const EepromStore&) = delete;
+
+	EepromErrorState load();
+	EepromErrorState commit();
+	EepromErrorState poll();
+	bool isDirty() const { return numDirty != 0; }
+
+	// Statistics
+	uint32_t writes;				// eeprom_Write calls made by commit
+	uint32_t bytesWritten;
+
+private:
+	EepromErrorState transferRun(EepromPersistentBase* first, EepromPersistentBase* last, bool write);
+	EepromErrorState forEachRun(bool write);
+
+	Eeprom* eeprom;
+	uint32_t delayMs;
+	uint32_t dirtySinceMs;
+	uint16_t numDirty;
+	EepromPersistentBase* head;
+	uint8_t pageBuf[EEPROM_PAGE_SIZE];
+};
+
+template<typename Field>
+class EepromPersistent : public EepromPersistentBase
+{
+public:
+	typedef typename Field::Type Type;
+
+	explicit EepromPersistent(EepromStore& store)
+		: EepromPersistentBase(store, Field::addr, sizeof(Type), &value), value() {}
+	EepromPersistent(EepromStore& store, const Type& initial)
+		: EepromPersistentBase(store, Field::addr, sizeof(Type), &value), value(initial) {}
+
+	const Type& get() const { return value; }
+	operator const Type&() const { return value; }
+
+	// Assigning the stored value again does not mark the variable dirty
+	EepromPersistent& operator=(const Type& newValue)
+	{
+		if(memcmp(&value, &newValue, sizeof(Type)) != 0)
+		{
+			value = newValue;
+			markDirty();
+		}
+		return *this;
+	}
+
+	// Modifies a copy of the value in place (e.g. one member of a struct), then assigns it
+	template<typename F>
+	void update(F fn)
+	{
+		Type copy = value;
+		fn(copy);
+		*this = copy;
+	}
+
+private:
+	Type value;
+};
+
+#endif
+
+#endif /* EEPROM_PERSISTENT_HPP_ */
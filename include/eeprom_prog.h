@@ -0,0 +1,67 @@
+#ifndef EEPROM_PROG_H_
+#define EEPROM_PROG_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Production image programming.
+ * Images are prepared on the host with eeprom_ProgBuildMap, which records one bit per
+ * EEPROM_CHECKSUM_SECTOR_SIZE sector set when the sector holds any byte other than 0xff,
+ * and optionally the CRC-32 of each sector. The programmed region is whole sectors: bytes
+ * between the end of the image and the end of its last sector are left (or written) 0xff.
+ *
+ * eeprom_ProgImage erases the region (one chip erase with EEPROM_PROG_CHIP_ERASE, otherwise
+ * 64 KB block erases, and sector erases where a block does not fit), programs the pages of
+ * the mapped sectors with page program (PGPR), skipping pages that are all 0xff, then verifies.
+ * Devices without erase instructions write every page with page writes, unless the device
+ * is known to be blank (EEPROM_PROG_BLANK), in which case all 0xff pages are skipped.
+ *
+ * Verification reads the region back in one continuous fast read (FREAD on the M95P32) and
+ * compares it with the image, or with EEPROM_PROG_VERIFY_CHECKSUM computes per-sector
+ * CRC-32s with eeprom_ChecksumSectors and compares them with the host table, so the image
+ * data does not have to be available again.
+ */
+
+#ifdef EEPROM_M95
+
+#ifndef EEPROM_PROG_VERIFY_CHUNK
+#define EEPROM_PROG_VERIFY_CHUNK		256			// Bytes per receive during raw verification
+#endif
+
+#define EEPROM_PROG_CHIP_ERASE			0x01		// Erase the whole device with one chip erase (M95P32)
+#define EEPROM_PROG_BLANK				0x02		// The region is already erased, skip the erase
+#define EEPROM_PROG_VERIFY_CHECKSUM		0x04		// Verify per-sector CRC-32s instead of the data
+#define EEPROM_PROG_NO_VERIFY			0x08
+
+typedef struct
+{
+	uint32_t addr;					// Device address, sector aligned
+	uint32_t len;					// Image length in bytes
+	const uint8_t* data;			// Image data. May be NULL for eeprom_ProgVerify with EEPROM_PROG_VERIFY_CHECKSUM
+	const uint8_t* sectorMap;		// Sectors holding data (eeprom_ProgBuildMap), or NULL to program every sector
+	const uint32_t* sectorCrc;		// CRC-32 of each whole sector, needed for EEPROM_PROG_VERIFY_CHECKSUM
+} EepromProgImage;
+
+typedef struct
+{
+	uint32_t erases;
+	uint32_t pagesProgrammed;
+	uint32_t pagesSkipped;
+	uint32_t mismatchAddr;			// First byte (or sector) that failed verification, 0xffffffff if none
+} EepromProgResult;
+
+void eeprom_ProgBuildMap(const uint8_t* data, uint32_t len, uint8_t* sectorMap, uint32_t* sectorCrc);
+EepromErrorState eeprom_ProgImage(Eeprom* eeprom, const EepromProgImage* image, uint8_t flags, EepromProgResult* result);
+EepromErrorState eeprom_ProgVerify(Eeprom* eeprom, const EepromProgImage* image, uint8_t flags, EepromProgResult* result);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_PROG_H_ */
@@ -0,0 +1,64 @@
+#ifndef EEPROM_REMAP_H_
+#define EEPROM_REMAP_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Failed-page retirement and spare remapping.
+ * The logical space is physical pages 0 to numPages-1, each redirected through a RAM
+ * table (map[logical page] = physical page) so translation is a single lookup. When a
+ * page write fails (ready timeout, or PRF/ERF in the M95P32 safety register) the page is
+ * retired: its contents, merged with the data being written, move to the next page of
+ * the spare pool and the remapping is saved to a persistent table. Later writes go
+ * straight to the spare, so a failing page costs one timeout instead of one per write.
+ * Devices without a safety register (M95M04) only detect timeouts: a cycle that ends
+ * normally without storing the data is not retired.
+ *
+ * The persistent table occupies two pages written alternately (tablePage and
+ * tablePage + 1), so a reset during a table update keeps the previous table. Tables are
+ * only written on retirement.
+ */
+
+#ifdef EEPROM_M95
+
+#define EEPROM_REMAP_MAGIC				0x504d5245	// "ERMP"
+#define EEPROM_REMAP_HEADER_SIZE		16
+#define EEPROM_REMAP_MAX_SPARES			((EEPROM_PAGE_SIZE - EEPROM_REMAP_HEADER_SIZE) / 4)
+
+typedef struct
+{
+	Eeprom* eeprom;
+	uint16_t* map;					// numPages entries, application provided
+	uint16_t numPages;				// Logical pages
+	uint16_t spareStart;			// First physical page of the spare pool
+	uint16_t numSpares;
+	uint16_t sparesUsed;			// Spares allocated, including spares that failed themselves
+	uint16_t tablePage;				// First of the two persistent table pages
+	uint8_t tableSlot;				// Table page holding the current table
+	uint32_t tableSeq;
+	uint32_t retired;				// Pages retired since init
+} EepromRemap;
+
+EepromErrorState eeprom_RemapInit(EepromRemap* remap, Eeprom* eeprom, uint16_t* map, uint16_t numPages,
+		uint16_t spareStart, uint16_t numSpares, uint16_t tablePage);
+EepromErrorState eeprom_RemapRead(EepromRemap* remap, uint8_t *pData, uint32_t len, uint32_t dataAddr);
+EepromErrorState eeprom_RemapWrite(EepromRemap* remap, uint8_t *pData, uint32_t len, uint32_t dataAddr);
+EepromErrorState eeprom_RemapRetire(EepromRemap* remap, uint16_t logicalPage);
+
+// Physical address of a logical address
+static inline uint32_t eeprom_RemapTranslate(const EepromRemap* remap, uint32_t dataAddr)
+{
+	return ((uint32_t)remap->map[dataAddr / EEPROM_PAGE_SIZE] * EEPROM_PAGE_SIZE) + (dataAddr % EEPROM_PAGE_SIZE);
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_REMAP_H_ */
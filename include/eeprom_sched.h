@@ -0,0 +1,110 @@
+#ifndef EEPROM_SCHED_H_
+#define EEPROM_SCHED_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Latency-aware I/O scheduler.
+ * Requests are queued per priority class and executed one unit at a time from
+ * eeprom_SchedPoll: writes are split at page boundaries, erases into sector/page erases
+ * (page writes of 0xff on devices without erase instructions) and reads into
+ * EEPROM_SCHED_READ_CHUNK byte chunks. Program and erase units are started without
+ * waiting, and the highest priority queue is served again at every unit boundary, so a
+ * high priority read waits for at most one page write or sector erase cycle (~5mS)
+ * however large the writes queued behind it are.
+ *
+ * Within a class, requests with a deadline are served earliest deadline first, ahead of
+ * requests without one, which stay FIFO. A request is never queued ahead of one that has
+ * started or one touching the same bytes (unless both are reads), so the order of
+ * overlapping writes and reads within a class is kept. Classes are not ordered against
+ * each other: a read that must observe a queued write has to be submitted in the same
+ * class as the write. Submit and poll from the same context.
+ *
+ * A program/erase unit still busy after its timeout completes its request with
+ * EepromBusy. The next unit is held back for up to EEPROM_SCHED_SETTLE_TIMEOUT while
+ * the device finishes the cycle.
+ */
+
+#ifndef EEPROM_SCHED_READ_CHUNK
+#define EEPROM_SCHED_READ_CHUNK			1024		// Largest read executed between priority checks
+#endif
+
+#ifndef EEPROM_SCHED_SETTLE_TIMEOUT
+#define EEPROM_SCHED_SETTLE_TIMEOUT		100			// Longest wait for the device after a unit timeout (mS)
+#endif
+
+typedef enum
+{
+	EepromPriorityHigh,
+	EepromPriorityNormal,
+	EepromPriorityLow
+} EepromPriority;
+
+#define EEPROM_SCHED_NUM_PRIORITIES		3
+
+typedef enum
+{
+	EepromReqRead,
+	EepromReqWrite,
+	EepromReqErase					// addr and len must be page aligned
+} EepromReqOp;
+
+#define EEPROM_REQ_DROP_LATE			0x01		// Complete with EepromBusy, unexecuted, if the deadline passes before it starts
+
+typedef struct EepromRequest EepromRequest;
+struct EepromRequest
+{
+	// Application assigned
+	uint8_t op;						// EepromReqOp
+	uint8_t priority;				// EepromPriority
+	uint8_t flags;
+	uint8_t* pData;					// Read destination/write source. Must stay valid until completion
+	uint32_t addr;
+	uint32_t len;
+	uint32_t deadlineMs;			// Completion deadline from submission, 0 for none
+	void (*complete)(EepromRequest* req);	// Called on completion, or NULL
+	void* arg;						// Application context for complete
+
+	// Scheduler state
+	volatile uint8_t pending;		// Set from submission until completion
+	uint8_t missed;					// Completed after its deadline
+	EepromErrorState result;
+	uint32_t submitMs;
+	uint32_t latencyMs;				// Submission to completion
+	uint32_t doneLen;
+	EepromRequest* next;
+};
+
+typedef struct
+{
+	Eeprom* eeprom;
+	EepromRequest* head[EEPROM_SCHED_NUM_PRIORITIES];
+	EepromRequest* tail[EEPROM_SCHED_NUM_PRIORITIES];
+	EepromRequest* active;			// Request whose program/erase unit is in progress
+	uint32_t unitLen;
+	uint32_t unitStartMs;
+	uint32_t unitTimeoutMs;
+	uint8_t settling;				// A unit timed out: wait for the device before the next unit
+
+	// Statistics
+	uint32_t completed;
+	uint32_t failed;
+	uint32_t deadlineMisses;
+	uint32_t dropped;
+	uint32_t maxLatencyMs[EEPROM_SCHED_NUM_PRIORITIES];
+} EepromScheduler;
+
+void eeprom_SchedInit(EepromScheduler* sched, Eeprom* eeprom);
+EepromErrorState eeprom_SchedSubmit(EepromScheduler* sched, EepromRequest* req);
+EepromErrorState eeprom_SchedPoll(EepromScheduler* sched);
+EepromErrorState eeprom_SchedFlush(EepromScheduler* sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_SCHED_H_ */
@@ -0,0 +1,85 @@
+#ifndef EEPROM_SEQ_H_
+#define EEPROM_SEQ_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Chained command sequences.
+ * A device operation such as a page write (WREN, WRITE + header + data, RDSR polling) is
+ * described as an array of steps and executed back to back, either blocking
+ * (eeprom_SeqRun) or driven from SPI DMA completion interrupts (eeprom_SeqStart).
+ * Chip select is asserted at the start of each step and released at its end unless the
+ * step has EEPROM_SEQ_HOLD_CS set, so a header and its payload can be sent from separate
+ * buffers within one transaction without copying.
+ *
+ * Interrupt driven sequences need EEPROM_SEQ_DMA defined and a transport with
+ * EEPROM_TRANSPORT_CAP_ASYNC (e.g. eepromTransportHalDma, whose transfer complete
+ * callbacks the application forwards to eeprom_TransportComplete). The application
+ * calls eeprom_SeqTick periodically (e.g. every 1mS) to advance ready polling steps.
+ */
+
+#ifndef EEPROM_SEQ_MAX_SEGMENTS
+#define EEPROM_SEQ_MAX_SEGMENTS			4			// Steps that may share one chip select window
+#endif
+
+typedef enum
+{
+	EepromSeqTx,					// Transmit len bytes from tx
+	EepromSeqRx,					// Receive len bytes into rx
+	EepromSeqTxRx,					// Full duplex, len bytes
+	EepromSeqPollReady				// Wait for WIP to clear. len is the timeout in mS
+} EepromSeqOp;
+
+#define EEPROM_SEQ_HOLD_CS				0x01		// Keep chip select asserted into the next step
+
+typedef struct
+{
+	uint8_t op;						// EepromSeqOp
+	uint8_t flags;
+	uint16_t len;
+	uint8_t* tx;
+	uint8_t* rx;
+} EepromSeqStep;
+
+typedef struct EepromSeq EepromSeq;
+struct EepromSeq
+{
+	Eeprom* eeprom;
+	const EepromSeqStep* steps;
+	uint8_t numSteps;
+	volatile uint8_t index;			// Step being executed
+	volatile uint8_t running;
+	volatile uint8_t transferActive;	// A DMA transfer for the current step is in flight
+	volatile EepromErrorState result;
+	uint32_t pollStartMs;
+	uint8_t pollTx[2];
+	uint8_t pollRx[2];
+	void (*complete)(EepromSeq* seq);	// Set before starting, or NULL. Called from interrupt context when the sequence ends
+};
+
+// Storage for a prebuilt page write sequence
+typedef struct
+{
+	uint8_t wren;
+	uint8_t header[4];
+	EepromSeqStep steps[5];
+} EepromSeqPageWrite;
+
+EepromErrorState eeprom_SeqRun(Eeprom* eeprom, const EepromSeqStep* steps, uint8_t numSteps);
+uint8_t eeprom_SeqBuildPageWrite(EepromSeqPageWrite* seq, uint8_t* pData, uint16_t len, uint32_t dataAddr, uint8_t preErased);
+
+#ifdef EEPROM_SEQ_DMA
+EepromErrorState eeprom_SeqStart(EepromSeq* seq, Eeprom* eeprom, const EepromSeqStep* steps, uint8_t numSteps);
+void eeprom_SeqCallback(EepromSeq* seq);
+void eeprom_SeqTick(EepromSeq* seq);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_SEQ_H_ */
@@ -0,0 +1,111 @@
+#ifndef EEPROM_SIM_H_
+#define EEPROM_SIM_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Simulated M95 device transport for host builds (compiled with EEPROM_SIM defined).
+ * The simulator decodes the instruction stream at the byte level, keeps the array in
+ * application provided memory and models time: every transport call costs
+ * callOverheadNs, every byte 8 SCK periods, and program/erase cycles keep WIP set for
+ * their datasheet maximum cycle time. Statistics are collected for benchmarking.
+ *
+ * Usage: eeprom.transport = &eepromTransportSim; eeprom.transportCtx = &sim;
+ * eeprom_SimInit(&sim, mem, wear); eeprom_Init(&eeprom);
+ */
+
+#ifdef EEPROM_SIM
+
+// Cycle times (nS), datasheet maximums
+#if defined(M95P32)
+#define EEPROM_SIM_PAGE_WRITE_NS		4500000		// tPW, page write (erase + program)
+#define EEPROM_SIM_PAGE_PROGRAM_NS		2000000		// Page program (PGPR) on an erased page
+#define EEPROM_SIM_PAGE_ERASE_NS		4500000		// tPE
+#define EEPROM_SIM_SECTOR_ERASE_NS		5000000		// tSE
+#define EEPROM_SIM_BLOCK_ERASE_NS		8000000		// tBE
+#define EEPROM_SIM_CHIP_ERASE_NS		25000000	// tCE
+#define EEPROM_SIM_WRSR_NS				9000000		// tWSCR
+#else
+#define EEPROM_SIM_PAGE_WRITE_NS		5000000
+#define EEPROM_SIM_WRSR_NS				5000000
+#endif
+
+#define EEPROM_SIM_NUM_PAGES			(EEPROM_DEVICE_SIZE / EEPROM_PAGE_SIZE)
+#define EEPROM_SIM_FAIL_BUSY_NS			30000000	// WIP hold time of a failing cycle in EepromSimFailTimeout mode
+#define EEPROM_SIM_KERNEL_CLOCK_HZ		160000000	// SPI kernel clock for eeprom_SimSetClockStep
+#define EEPROM_SIM_CLOCK_STEPS			8			// Prescaler /256 (step 0) to /2 (step 7)
+
+// How program/erase cycles on pages in failPages fail. The page contents are left unchanged.
+typedef enum
+{
+	EepromSimFailFlag,				// Cycle ends normally with PRF/ERF set in the safety register (M95P32)
+	EepromSimFailTimeout			// WIP stays set for EEPROM_SIM_FAIL_BUSY_NS, past the driver's ready timeout
+} EepromSimFailMode;
+
+typedef struct
+{
+	// Application assigned (defaults set by eeprom_SimInit)
+	uint8_t* mem;					// EEPROM_DEVICE_SIZE bytes of array storage
+	uint32_t* wear;					// Optional per-page program/erase counters (EEPROM_SIM_NUM_PAGES), or NULL
+	uint32_t spiClockHz;			// Simulated SCK rate
+	uint32_t callOverheadNs;		// Software cost of each transport call
+	uint32_t errorAboveHz;			// Bytes read from the device get bit errors above this SCK rate (0 = never)
+	uint32_t lowDriveErrorAboveHz;	// Threshold used instead while the output drive is low (M95P32, 0 = errorAboveHz)
+	const uint8_t* failPages;		// Optional bitmap (EEPROM_SIM_NUM_PAGES bits) of pages whose cycles fail, or NULL
+	uint8_t failMode;				// EepromSimFailMode
+
+	// Device state
+	uint8_t statusReg;
+	uint8_t configReg;
+	uint8_t safetyReg;
+	uint8_t volatileReg;
+#if defined(M95P32)
+	uint8_t idPages[2 * EEPROM_ID_PAGE_SIZE];
+#endif
+	uint64_t busyUntilNs;
+	uint8_t resetEnabled;
+
+	// Instruction decode state
+	uint8_t cmd;
+	uint8_t ignore;					// Instruction arrived while busy and is ignored
+	uint32_t count;					// Bytes clocked since chip select was asserted
+	uint32_t addr;
+	uint8_t args[2];				// Register data bytes
+	uint8_t pageBuf[EEPROM_PAGE_SIZE];
+	uint8_t pageLoaded[EEPROM_PAGE_SIZE / 8];
+	uint32_t rng;
+
+	// Statistics
+	uint64_t timeNs;
+	uint32_t calls;					// Transport calls (including select/deselect)
+	uint64_t busBytes;
+	uint32_t pageWrites;			// Page write cycles (WRITE)
+	uint32_t pagePrograms;			// Page program cycles (PGPR)
+	uint32_t pageErases;
+	uint32_t sectorErases;
+	uint32_t blockErases;
+	uint32_t chipErases;
+	uint32_t registerWrites;
+	uint32_t rejected;				// Instructions ignored (device busy, WEL clear or protected)
+	uint32_t failedCycles;			// Program/erase cycles failed by failPages
+	uint32_t bitErrors;
+} EepromSim;
+
+extern const EepromTransport eepromTransportSim;		// Separate call per segment
+extern const EepromTransport eepromTransportSimBurst;	// Segment lists in one call, asynchronous support
+
+void eeprom_SimInit(EepromSim* sim, uint8_t* mem, uint32_t* wear);
+void eeprom_SimIdle(EepromSim* sim, uint64_t ns);
+EepromErrorState eeprom_SimSetClockStep(Eeprom* eeprom, uint8_t clockStep);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_SIM_H_ */
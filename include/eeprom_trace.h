@@ -0,0 +1,80 @@
+#ifndef EEPROM_TRACE_H_
+#define EEPROM_TRACE_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Operation trace capture.
+ * With EEPROM_TRACE defined, every eeprom_Read/Write/ProgramPage/Erase* call made while eeprom->trace
+ * points to an initialised EepromTrace is logged to its RAM ring buffer (oldest records
+ * are overwritten). eeprom_TraceExport serialises the buffer into the binary trace format
+ * below, which tools/eeprom_replay.c replays against the simulated device.
+ *
+ * Trace format, little-endian:
+ *   header  magic u32 (EEPROM_TRACE_MAGIC), version u16, record size u16,
+ *           number of records u32, records lost to overwriting u32
+ *   records timestamp u32 (mS), address u32, length u32, duration u16 (mS), op u8, result u8
+ */
+
+#define EEPROM_TRACE_MAGIC				0x43525445	// "ETRC"
+#define EEPROM_TRACE_VERSION			1
+#define EEPROM_TRACE_HEADER_SIZE		16
+#define EEPROM_TRACE_RECORD_SIZE		16
+
+typedef enum
+{
+	EepromTraceRead,
+	EepromTraceWrite,
+	EepromTraceErasePage,
+	EepromTraceEraseSector,
+	EepromTraceEraseBlock,
+	EepromTraceEraseChip,
+	EepromTraceProgram				// Page program of an erased page (eeprom_ProgramPage)
+} EepromTraceOp;
+
+typedef struct
+{
+	uint32_t timestamp;				// Transport tick at the start of the call (mS)
+	uint32_t addr;
+	uint32_t len;					// Bytes read/written, or the erase size
+	uint16_t duration;				// Call duration (mS)
+	uint8_t op;						// EepromTraceOp
+	uint8_t result;					// EepromErrorState
+} EepromTraceRecord;
+
+struct EepromTrace
+{
+	EepromTraceRecord* records;
+	uint32_t numRecords;
+	uint32_t head;					// Next record to be written
+	uint32_t count;					// Records logged since init
+	uint8_t enabled;
+};
+
+void eeprom_TraceInit(EepromTrace* trace, EepromTraceRecord* records, uint32_t numRecords);
+void eeprom_TraceClear(EepromTrace* trace);
+uint32_t eeprom_TraceExport(EepromTrace* trace, uint8_t* pData, uint32_t maxLen);
+uint8_t eeprom_TraceDecodeHeader(const uint8_t* pData, uint32_t* numRecords, uint32_t* lost);
+void eeprom_TraceDecodeRecord(const uint8_t* pData, EepromTraceRecord* record);
+
+#ifdef EEPROM_TRACE
+uint32_t eeprom_TraceTick(Eeprom* eeprom);
+void eeprom_TraceLog(Eeprom* eeprom, uint8_t op, uint32_t addr, uint32_t len, uint32_t start, EepromErrorState result);
+
+// Driver hooks, wrapped around each traced call
+#define EEPROM_TRACE_BEGIN(eeprom)								uint32_t traceStart = eeprom_TraceTick(eeprom)
+#define EEPROM_TRACE_END(eeprom, op, addr, len, result)			eeprom_TraceLog((eeprom), (op), (addr), (len), traceStart, (result))
+#else
+#define EEPROM_TRACE_BEGIN(eeprom)
+#define EEPROM_TRACE_END(eeprom, op, addr, len, result)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_TRACE_H_ */
@@ -5,134 +5,77 @@
  *      Author: Sam Work
  */
 
-#include "eeprom.h"
+#include "eeprom_m95.h"
+#include "eeprom_seq.h"
+#include "eeprom_trace.h"
 #include "stdlib.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define TRUE	1
-#define FALSE	0
-
-// M95 EEPROM Devices
-#ifdef EEPROM_M95
-#define PAGE_WIDTH 				512			// Maximum number of bytes in a page write
-
-#if defined(M95M04)
-#define MAX_WRITE_CYCLES		4000000	// Maximum number of writes allowed per cell
-#define DEVICE_SIZE 			512000	// EEPROM storage size in bytes
-#define NUM_EEPROM_PAGES		1000		// Equal to the device size / page size
-
-#define WRITE_CYCLE_TIME		5				// Required time for the device to complete an internal  write operation (mS)
-#define READ_CYCLE_TIME			5				// Required time for the device to complete an internal  read operation (mS)
-#define READY_CHECK_TIMEOUT		15
-
-// Command bytes
-#define WREN_CMD	0b00000110		// Write enable
-#define WRDI_CMD	0b00000100		// Write disable
-#define RDSR_CMD	0b00000101		// Read Status register
-#define WRSR_CMD	0b00000001		// Write Status register
-#define READ_CMD	0b00000011		// Read from Memory array
-#define WRITE_CMD	0b00000010		// Write to Memory array
-#define RDID_CMD	0b10000011		// Read Identification page
-#define WRID_CMD	0b10000010		// Write Identification page
-#define RDLS_CMD	0b10000011		// Reads the Identification page lock status
-#define LID_CMD		0b10000010		// Locks the Identification page in read-only mode
-
-// Status register bit positions
-#define WIP_BIT		0
-#define WEL_BIT 	1
-#define BP0_BIT		2
-#define BP1_BIT		3
-#define SRWD_BIT	4
-#endif
-
-#if defined (M95P32)
-#define MAX_WRITE_CYCLES		5000000		// Maximum number of writes allowed per cell
-#define DEVICE_SIZE 			4194304		// EEPROM storage size in bytes (32 Mbit = 4 MB)
-#define NUM_EEPROM_PAGES		8192		// Equal to the device size / page size (512 bytes/page)
-#define SECTOR_SIZE				4096		// Sector size in bytes (4 Kbytes)
-#define NUM_SECTORS				1024		// Equal to the device size / sector size
-#define BLOCK_SIZE				65536		// Block size in bytes (64 Kbytes)
-#define NUM_BLOCKS				64			// Equal to the device size / block size
-
-#define WRITE_CYCLE_TIME		5				// Required time for the device to complete a page write (erase+program) cycle (mS). Datasheet tPW max is 4.5mS
-#define READ_CYCLE_TIME			5				// Required time for the device to complete an internal read operation (mS)
-#define READY_CHECK_TIMEOUT		15			// Page write/program/erase poll timeout (tPW/tPE max 4.5mS)
-#define SECTOR_ERASE_TIMEOUT	15			// Sector erase poll timeout (tSE max 5mS)
-#define BLOCK_ERASE_TIMEOUT		25			// Block erase poll timeout (tBE max 8mS)
-#define CHIP_ERASE_TIMEOUT		75			// Chip erase poll timeout (tCE max 25mS)
-#define WRSR_TIMEOUT			30			// Write status/configuration registers poll timeout (tWSCR max 9mS)
-
-// Command bytes
-#define WREN_CMD	0b00000110		// Write enable
-#define WRDI_CMD	0b00000100		// Write disable
-#define RDSR_CMD	0b00000101		// Read status register
-#define WRSR_CMD	0b00000001		// Write status and configuration registers
-#define READ_CMD	0b00000011		// Read data single output from memory array
-#define FREAD_CMD	0b00001011		// Fast read single output with one dummy byte
-#define FDREAD_CMD	0b00111011		// Fast read dual output with one dummy byte
-#define FQREAD_CMD	0b01101011		// Fast read quad output with one dummy byte
-#define WRITE_CMD	0b00000010		// Page write: self-timed erase + program (PGWR), used for generic byte-alterable writes
-#define PGPR_CMD	0b00001010		// Page program: programs a pre-erased page only (PGPR)
-#define PGER_CMD	0b11011011		// Page erase (512 bytes)
-#define SCER_CMD	0b00100000		// Sector erase (4 Kbytes)
-#define BKER_CMD	0b11011000		// Block erase (64 Kbytes)
-#define CHER_CMD	0b11000111		// Chip erase
-#define RDID_CMD	0b10000011		// Read identification page
-#define FRDID_CMD	0b10001011		// Fast read identification page with one dummy byte
-#define WRID_CMD	0b10000010		// Write identification page
-#define DPD_CMD		0b10111001		// Deep power-down enter
-#define RDPD_CMD	0b10101011		// Deep power-down release
-#define JEDID_CMD	0b10011111		// JEDEC identification
-#define RDCR_CMD	0b00010101		// Read configuration and safety registers
-#define RDVR_CMD	0b10000101		// Read volatile register
-#define WRVR_CMD	0b10000001		// Write volatile register
-#define CLRSF_CMD	0b01010000		// Clear safety register sticky flags
-#define RDSFDP_CMD	0b01011010		// Read SFDP register
-#define RSTEN_CMD	0b01100110		// Enable reset
-#define RESET_CMD	0b10011001		// Software reset
-
-// Status register bit positions
-#define WIP_BIT		0
-#define WEL_BIT		1
-#define BP0_BIT		2
-#define BP1_BIT		3
-#define BP2_BIT		4
-#define TB_BIT		6
-#define SRWD_BIT	7
-#endif
-
-//-------------------- Private Function Prototypes --------------------//
-EepromErrorState m95_Read(Eeprom* eeprom, uint8_t *pData, uint32_t dataAddr, uint32_t size);
-EepromErrorState m95_Write(Eeprom* eeprom, uint8_t *data, uint32_t dataAddr, uint32_t size);
-EepromErrorState m95_PollReady(Eeprom* eeprom, uint32_t timeoutMs);
-EepromErrorState m95_WriteEnable(Eeprom* eeprom);
-EepromErrorState m95_WriteDisable(Eeprom* eeprom);
-EepromErrorState m95_ReadStatusRegister(Eeprom* eeprom, uint8_t* data);
-#if defined(M95P32)
-EepromErrorState m95p32_SendCommand(Eeprom* eeprom, uint8_t cmd);
-EepromErrorState m95p32_Erase(Eeprom* eeprom, uint8_t cmd, uint32_t dataAddr, uint8_t hasAddress, uint32_t timeoutMs);
-EepromErrorState m95p32_WriteStatusConfigRegisters(Eeprom* eeprom, uint8_t statusReg, uint8_t configReg, uint8_t writeConfig);
-#endif
-#endif
-
 #if !defined(M95P32)
 uint8_t erasePacket[PAGE_WIDTH];
 #endif
 
+//-------------------- Private Function Prototypes --------------------//
+static EepromErrorState eeprom_WritePages(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr);
+static EepromErrorState eeprom_PageStart(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr, uint8_t preErased);
+
 /**
   * @brief 	Initialises the eeprom struct
+  * The struct must be zero-initialised before the application fields are assigned: a
+  * transport pointer left uninitialised is used as is. Use eeprom_InitTransport otherwise.
   * @param 	eeprom eeprom struct
   * @retval	error state
   */
 EepromErrorState eeprom_Init(Eeprom* eeprom)
 {
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
+	if(eeprom->transport == NULL)
+	{
+	#if FRAMEWORK_STM32CUBE
+		eeprom->transport = &eepromTransportHal;
+	#elif FRAMEWORK_ARDUINO
+		eeprom->transport = &eepromTransportArduino;
+	#else
+		return EepromHalError;
+	#endif
+	}
+	if(eeprom->transport->init != NULL)
+	{
+		EepromErrorState status = eeprom->transport->init(eeprom);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	eeprom->asyncComplete = NULL;
+	eeprom->asyncArg = NULL;
+	eeprom->shadowValid = 0;
+	eeprom->transport->deselect(eeprom);
 	return EepromOk;
 }
 
+/**
+  * @brief 	Assigns the transport and initialises the eeprom struct, for structs that are
+  * not zero-initialised (e.g. on the stack). The framework fields (hspi/csPort/csPin or
+  * spi/spiClock/csPin) must be assigned first. Tracing is disabled; assign eeprom->trace
+  * afterwards to enable it.
+  * @param 	eeprom eeprom struct
+  * @param	transport Transport backend, or NULL for the framework default
+  * @param	transportCtx Backend specific context, or NULL
+  * @retval	error state
+  */
+EepromErrorState eeprom_InitTransport(Eeprom* eeprom, const EepromTransport* transport, void* transportCtx)
+{
+	eeprom->transport = transport;
+	eeprom->transportCtx = transportCtx;
+#ifdef EEPROM_TRACE
+	eeprom->trace = NULL;
+#endif
+	return eeprom_Init(eeprom);
+}
+
 /**
   * @brief 	Writes 'size' number of bytes from the data pointer to the eeprom
   * 			Note that sizes of more than the PAGE_WIDTH cannot be written with one call.
@@ -145,76 +88,18 @@ EepromErrorState eeprom_Init(Eeprom* eeprom)
   */
 EepromErrorState eeprom_Write(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr)
 {
-	EepromErrorState status;
-	static uint32_t numRemaining;
-	static uint32_t currentDataAddr;
-	static uint8_t *currentData;
-
-	/* 
-	* Because each page becomes row locked, if a write reaches the end of a page boundary,
-	* the address counter in the eeprom will reset to the beginning of the page.
-	* Therefore, the buffer address must be checked against a multiple of the page width,
-	* With that many bytes being written, then the rest of the data can be written to consecutive pages.
-	* If this is not done, other data in the page which may not be part of the buffer can be overwritten.
-	*
-	* The formula to work out how many bits can be written before overflowing the current page is:
-	* currentPageBytes = PAGE_WIDTH - (addres % PAGE_WIDTH)
-	*
-	* currentPageBytes number of bytes are written to the page that the data address exists in,
-	* then full pages can be written to as normal.
-	*/
-
-	// Calculate how many bytes exist in the current page that need to be written to
-	uint16_t currentPageBytes = PAGE_WIDTH - (dataAddr % PAGE_WIDTH);
-	
-	// Update the static variables to those passed to the function
-	currentData = pData;
-	currentDataAddr = dataAddr;
-
-	if(len > currentPageBytes)
-	{		
-		#ifdef EEPROM_M95
-		status = m95_Write(eeprom, currentData, currentPageBytes, currentDataAddr);
-		#endif
-		// Update the static data variables
-		numRemaining = (len - currentPageBytes);
-		currentData += currentPageBytes;
-		currentDataAddr += currentPageBytes;
-	}
-	else
-	{
-		#ifdef EEPROM_M95
-		status = m95_Write(eeprom, currentData, len, currentDataAddr);
-		#endif
-		return status;
-	}
-
-	// For consecutive writes after the initial page write
-	while(numRemaining > 0)
+	EEPROM_TRACE_BEGIN(eeprom);
+#if defined(M95P32)
+	EepromErrorState status = m95p32_CheckWritable(eeprom, dataAddr, len);
+	if(status == EepromOk)
 	{
-		// If this is the last sequential write required
-		if(numRemaining <= PAGE_WIDTH)
-		{
-			#ifdef EEPROM_M95
-			status = m95_Write(eeprom, currentData, numRemaining, currentDataAddr);
-			#endif
-			return status;
-		}
-		else
-		{
-			#ifdef EEPROM_M95
-			status = m95_Write(eeprom, currentData, PAGE_WIDTH, currentDataAddr);
-			#endif
-			numRemaining -= PAGE_WIDTH;
-			currentData += PAGE_WIDTH;
-			currentDataAddr += PAGE_WIDTH;
-		}
-		if(status != EepromOk)
-		{
-			return status;
-		}
+		status = eeprom_WritePages(eeprom, pData, len, dataAddr);
 	}
-	return EepromOk;
+#else
+	EepromErrorState status = eeprom_WritePages(eeprom, pData, len, dataAddr);
+#endif
+	EEPROM_TRACE_END(eeprom, EepromTraceWrite, dataAddr, len, status);
+	return status;
 }
 
 /**
@@ -228,7 +113,10 @@ EepromErrorState eeprom_Write(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint
 EepromErrorState eeprom_Read(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr)
 {
 #ifdef EEPROM_M95
-	return m95_Read(eeprom, pData, len, dataAddr);
+	EEPROM_TRACE_BEGIN(eeprom);
+	EepromErrorState status = m95_Read(eeprom, pData, len, dataAddr);
+	EEPROM_TRACE_END(eeprom, EepromTraceRead, dataAddr, len, status);
+	return status;
 #endif
 }
 
@@ -244,6 +132,7 @@ EepromErrorState eeprom_EraseAll(Eeprom* eeprom)
 	return eeprom_EraseChip(eeprom);
 #else
 	EepromErrorState status;
+	EEPROM_TRACE_BEGIN(eeprom);
 
 	for(uint16_t i=0; i<PAGE_WIDTH; i++)
 	{
@@ -256,13 +145,113 @@ EepromErrorState eeprom_EraseAll(Eeprom* eeprom)
 		#endif
 		if(status != EepromOk)
 		{
-			return status;
+			break;
 		}
 	}
+	EEPROM_TRACE_END(eeprom, EepromTraceEraseChip, 0, DEVICE_SIZE, status);
+	return status;
+#endif
+}
+
+/**
+  * @brief 	Reports completion of an asynchronous transport transfer.
+  * Backends call this, or the application calls it from the transfer complete
+  * interrupt (e.g. HAL_SPI_TxCpltCallback/RxCpltCallback/TxRxCpltCallback for the
+  * eeprom's SPI handle when using eepromTransportHalDma).
+  * @param	eeprom eeprom struct
+  */
+void eeprom_TransportComplete(Eeprom* eeprom)
+{
+	if(eeprom->asyncComplete != NULL)
+	{
+		eeprom->asyncComplete(eeprom, eeprom->asyncArg);
+	}
+}
+
+/**
+  * @brief 	Programs data within one page that is known to be erased (all 0xff).
+  * On the M95P32 this uses page program (PGPR), which skips the erase phase of a page
+  * write and completes in less than half the time. Programming a page that is not erased
+  * ANDs the new data into the old. Other devices use a normal page write.
+  * @param	eeprom eeprom struct
+  * @param 	pData Data to program
+  * @param	len Number of bytes to program (1 to EEPROM_PAGE_SIZE)
+  * @param	dataAddr Address to begin programming. Must not cross a page boundary.
+  * @retval	error state
+  */
+EepromErrorState eeprom_ProgramPage(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr)
+{
+#ifdef EEPROM_M95
+	if(len == 0 || len > PAGE_WIDTH - (dataAddr % PAGE_WIDTH) || dataAddr >= DEVICE_SIZE)
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status;
+#if defined(M95P32)
+	status = m95p32_CheckWritable(eeprom, dataAddr, len);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+#endif
+	EEPROM_TRACE_BEGIN(eeprom);
+	EepromSeqPageWrite seq;
+	uint8_t numSteps = eeprom_SeqBuildPageWrite(&seq, pData, (uint16_t)len, dataAddr, TRUE);
+	status = eeprom_SeqRun(eeprom, seq.steps, numSteps);
+	EEPROM_TRACE_END(eeprom, EepromTraceProgram, dataAddr, len, status);
 	return status;
 #endif
 }
 
+/**
+  * @brief 	Starts a write within one page and returns without waiting for the write
+  * cycle. Completion is checked with eeprom_IsBusy. Used by schedulers that interleave
+  * other requests with long writes.
+  * @param	eeprom eeprom struct
+  * @param 	pData Data to write. Only needs to stay valid for the duration of the call.
+  * @param	len Number of bytes to write (1 to EEPROM_PAGE_SIZE)
+  * @param	dataAddr Address to begin writing to. The write must not cross a page boundary.
+  * @retval	error state. EepromBusy if a previous cycle is still in progress.
+  */
+EepromErrorState eeprom_WritePageStart(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr)
+{
+	return eeprom_PageStart(eeprom, pData, len, dataAddr, FALSE);
+}
+
+/**
+  * @brief 	Starts a program within one erased page (see eeprom_ProgramPage) and returns
+  * without waiting for the program cycle. Completion is checked with eeprom_IsBusy.
+  * @param	eeprom eeprom struct
+  * @param 	pData Data to program. Only needs to stay valid for the duration of the call.
+  * @param	len Number of bytes to program (1 to EEPROM_PAGE_SIZE)
+  * @param	dataAddr Address to begin programming. Must not cross a page boundary.
+  * @retval	error state. EepromBusy if a previous cycle is still in progress.
+  */
+EepromErrorState eeprom_ProgramPageStart(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr)
+{
+	return eeprom_PageStart(eeprom, pData, len, dataAddr, TRUE);
+}
+
+/**
+  * @brief 	Checks whether a write, erase or register write cycle is in progress.
+  * @param	eeprom eeprom struct
+  * @param	busy Set to TRUE while the device is busy (WIP set)
+  * @retval	error state
+  */
+EepromErrorState eeprom_IsBusy(Eeprom* eeprom, uint8_t* busy)
+{
+#ifdef EEPROM_M95
+	uint8_t statusReg;
+	EepromErrorState status = m95_ReadStatusRegister(eeprom, &statusReg);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	*busy = (statusReg >> WIP_BIT) & 1;
+	return EepromOk;
+#endif
+}
+
 #if defined(M95P32)
 /**
   * @brief 	Erases the 512 byte page containing dataAddr (sets all bytes to 0xff).
@@ -276,7 +265,10 @@ EepromErrorState eeprom_ErasePage(Eeprom* eeprom, uint32_t dataAddr)
 	{
 		return EepromStorageError;
 	}
-	return m95p32_Erase(eeprom, PGER_CMD, dataAddr, TRUE, READY_CHECK_TIMEOUT);
+	EEPROM_TRACE_BEGIN(eeprom);
+	EepromErrorState status = m95p32_Erase(eeprom, PGER_CMD, dataAddr, TRUE, READY_CHECK_TIMEOUT);
+	EEPROM_TRACE_END(eeprom, EepromTraceErasePage, dataAddr - (dataAddr % PAGE_WIDTH), PAGE_WIDTH, status);
+	return status;
 }
 
 /**
@@ -291,7 +283,10 @@ EepromErrorState eeprom_EraseSector(Eeprom* eeprom, uint32_t dataAddr)
 	{
 		return EepromStorageError;
 	}
-	return m95p32_Erase(eeprom, SCER_CMD, dataAddr, TRUE, SECTOR_ERASE_TIMEOUT);
+	EEPROM_TRACE_BEGIN(eeprom);
+	EepromErrorState status = m95p32_Erase(eeprom, SCER_CMD, dataAddr, TRUE, SECTOR_ERASE_TIMEOUT);
+	EEPROM_TRACE_END(eeprom, EepromTraceEraseSector, dataAddr - (dataAddr % SECTOR_SIZE), SECTOR_SIZE, status);
+	return status;
 }
 
 /**
@@ -306,7 +301,10 @@ EepromErrorState eeprom_EraseBlock(Eeprom* eeprom, uint32_t dataAddr)
 	{
 		return EepromStorageError;
 	}
-	return m95p32_Erase(eeprom, BKER_CMD, dataAddr, TRUE, BLOCK_ERASE_TIMEOUT);
+	EEPROM_TRACE_BEGIN(eeprom);
+	EepromErrorState status = m95p32_Erase(eeprom, BKER_CMD, dataAddr, TRUE, BLOCK_ERASE_TIMEOUT);
+	EEPROM_TRACE_END(eeprom, EepromTraceEraseBlock, dataAddr - (dataAddr % BLOCK_SIZE), BLOCK_SIZE, status);
+	return status;
 }
 
 /**
@@ -317,7 +315,32 @@ EepromErrorState eeprom_EraseBlock(Eeprom* eeprom, uint32_t dataAddr)
   */
 EepromErrorState eeprom_EraseChip(Eeprom* eeprom)
 {
-	return m95p32_Erase(eeprom, CHER_CMD, 0, FALSE, CHIP_ERASE_TIMEOUT);
+	EEPROM_TRACE_BEGIN(eeprom);
+	EepromErrorState status = m95p32_Erase(eeprom, CHER_CMD, 0, FALSE, CHIP_ERASE_TIMEOUT);
+	EEPROM_TRACE_END(eeprom, EepromTraceEraseChip, 0, DEVICE_SIZE, status);
+	return status;
+}
+
+/**
+  * @brief 	Starts a page/sector/block erase and returns without waiting for the erase
+  * cycle. Completion is checked with eeprom_IsBusy.
+  * @param	eeprom eeprom struct
+  * @param	dataAddr Any address within the page/sector/block to be erased
+  * @retval	error state. EepromBusy if a previous cycle is still in progress.
+  */
+EepromErrorState eeprom_ErasePageStart(Eeprom* eeprom, uint32_t dataAddr)
+{
+	return m95p32_EraseStart(eeprom, PGER_CMD, dataAddr, EepromTraceErasePage, PAGE_WIDTH);
+}
+
+EepromErrorState eeprom_EraseSectorStart(Eeprom* eeprom, uint32_t dataAddr)
+{
+	return m95p32_EraseStart(eeprom, SCER_CMD, dataAddr, EepromTraceEraseSector, SECTOR_SIZE);
+}
+
+EepromErrorState eeprom_EraseBlockStart(Eeprom* eeprom, uint32_t dataAddr)
+{
+	return m95p32_EraseStart(eeprom, BKER_CMD, dataAddr, EepromTraceEraseBlock, BLOCK_SIZE);
 }
 
 /**
@@ -337,9 +360,6 @@ EepromErrorState eeprom_ReadIdPage(Eeprom* eeprom, uint8_t *pData, uint32_t len,
 	{
 		return EepromStorageError;
 	}
-	// Check to make sure the device is ready
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-
 	// Prepare the command + address header
 	uint8_t txPacket[4];
 	txPacket[0] = RDID_CMD;
@@ -347,20 +367,8 @@ EepromErrorState eeprom_ReadIdPage(Eeprom* eeprom, uint8_t *pData, uint32_t len,
 	txPacket[2] = (uint8_t)((dataAddr >> 8) & 0xff);
 	txPacket[3] = (uint8_t)(dataAddr & 0xff);
 
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, txPacket, 4, HAL_MAX_DELAY) != HAL_OK)
-	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
-	}
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	if(HAL_SPI_Receive(eeprom->hspi, pData, len, HAL_MAX_DELAY) != HAL_OK)
-	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
-	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-	return EepromOk;
+	EepromSegment segments[2] = {{txPacket, NULL, 4}, {NULL, pData, len}};
+	return m95_Transfer(eeprom, segments, 2);
 }
 
 /**
@@ -369,7 +377,8 @@ EepromErrorState eeprom_ReadIdPage(Eeprom* eeprom, uint8_t *pData, uint32_t len,
   * rolls over at the page boundary, so a longer write would wrap and overwrite the
   * beginning of the same page. Application data belongs in the user ID page
   * (EEPROM_ID_USER_PAGE_ADDR); the device ID page content is factory programmed.
-  * Fails once the ID pages have been locked (check with eeprom_IdPageLocked).
+  * Returns EepromStorageError without sending anything once the ID pages have been locked
+  * (check with eeprom_IdPageLocked).
   * @param	eeprom eeprom struct
   * @param 	pData Pointer for the data to write
   * @param	len Number of bytes to be written (1-512)
@@ -387,31 +396,33 @@ EepromErrorState eeprom_WriteIdPage(Eeprom* eeprom, uint8_t *pData, uint32_t len
 	{
 		return EepromStorageError;
 	}
-	// Check to make sure the device is ready
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-
+	// The device ignores writes once the ID pages are locked
+	EepromErrorState status = m95p32_LoadShadow(eeprom, EEPROM_SHADOW_CONFIG);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if((eeprom->configShadow >> EEPROM_CONFIG_LID_BIT) & 1)
+	{
+		return EepromStorageError;
+	}
 	// Send the write enable (WREN) instruction
 	m95_WriteEnable(eeprom);
 
 	// Prepare the command + address header
-	uint8_t txPacket[4 + len];
+	uint8_t txPacket[4];
 	txPacket[0] = WRID_CMD;
 	txPacket[1] = (uint8_t)((dataAddr >> 16) & 0xff);
 	txPacket[2] = (uint8_t)((dataAddr >> 8) & 0xff);
 	txPacket[3] = (uint8_t)(dataAddr & 0xff);
-	for(uint32_t i=0; i<len; i++)
-	{
-		txPacket[4+i] = pData[i];
-	}
 
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, txPacket, len + 4, HAL_MAX_DELAY) != HAL_OK)
+	// The payload is sent straight from the caller's buffer in the same transaction
+	EepromSegment segments[2] = {{txPacket, NULL, 4}, {pData, NULL, len}};
+	status = m95_Transfer(eeprom, segments, 2);
+	if(status != EepromOk)
 	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
+		return status;
 	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
 	return m95_PollReady(eeprom, READY_CHECK_TIMEOUT);
 }
 
@@ -425,43 +436,35 @@ EepromErrorState eeprom_WriteIdPage(Eeprom* eeprom, uint8_t *pData, uint32_t len
   */
 EepromErrorState eeprom_LockIdPage(Eeprom* eeprom)
 {
-	uint8_t statusReg, configReg, safetyReg;
-	EepromErrorState status;
-
-	status = m95_ReadStatusRegister(eeprom, &statusReg);
-	if(status != EepromOk)
-	{
-		return status;
-	}
-	status = eeprom_ReadConfigRegisters(eeprom, &configReg, &safetyReg);
+	EepromErrorState status = m95p32_LoadShadow(eeprom, EEPROM_SHADOW_STATUS | EEPROM_SHADOW_CONFIG);
 	if(status != EepromOk)
 	{
 		return status;
 	}
-	if((configReg >> EEPROM_CONFIG_LID_BIT) & 1)
+	if((eeprom->configShadow >> EEPROM_CONFIG_LID_BIT) & 1)
 	{
 		// Already locked
 		return EepromOk;
 	}
-	configReg |= (1 << EEPROM_CONFIG_LID_BIT);
-	return m95p32_WriteStatusConfigRegisters(eeprom, statusReg, configReg, TRUE);
+	uint8_t configReg = eeprom->configShadow | (1 << EEPROM_CONFIG_LID_BIT);
+	return m95p32_WriteStatusConfigRegisters(eeprom, eeprom->statusShadow, configReg, TRUE);
 }
 
 /**
-  * @brief 	Reads the identification page lock status from the configuration register.
+  * @brief 	Returns the identification page lock status from the configuration register
+  * (from the shadow once it has been read).
   * @param	eeprom eeprom struct
   * @param	locked Set to 1 if the ID pages are permanently locked, 0 otherwise
   * @retval	error state
   */
 EepromErrorState eeprom_IdPageLocked(Eeprom* eeprom, uint8_t* locked)
 {
-	uint8_t configReg, safetyReg;
-	EepromErrorState status = eeprom_ReadConfigRegisters(eeprom, &configReg, &safetyReg);
+	EepromErrorState status = m95p32_LoadShadow(eeprom, EEPROM_SHADOW_CONFIG);
 	if(status != EepromOk)
 	{
 		return status;
 	}
-	*locked = (configReg >> EEPROM_CONFIG_LID_BIT) & 1;
+	*locked = (eeprom->configShadow >> EEPROM_CONFIG_LID_BIT) & 1;
 	return EepromOk;
 }
 
@@ -480,17 +483,16 @@ EepromErrorState eeprom_ReadConfigRegisters(Eeprom* eeprom, uint8_t* configReg,
 	uint8_t txBuf[3] = {RDCR_CMD, 0, 0};
 	uint8_t rxBuf[3];
 
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_TransmitReceive(eeprom->hspi, txBuf, rxBuf, 3, HAL_MAX_DELAY) != HAL_OK)
+	EepromSegment segment = {txBuf, rxBuf, 3};
+	EepromErrorState status = m95_Transfer(eeprom, &segment, 1);
+	if(status != EepromOk)
 	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
+		return status;
 	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-
 	*configReg = rxBuf[1];
 	*safetyReg = rxBuf[2];
+	eeprom->configShadow = rxBuf[1];
+	eeprom->shadowValid |= EEPROM_SHADOW_CONFIG;
 	return EepromOk;
 }
 
@@ -515,48 +517,87 @@ EepromErrorState eeprom_ReadVolatileRegister(Eeprom* eeprom, uint8_t* data)
 	uint8_t txBuf[2] = {RDVR_CMD, 0};
 	uint8_t rxBuf[2];
 
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_TransmitReceive(eeprom->hspi, txBuf, rxBuf, 2, HAL_MAX_DELAY) != HAL_OK)
+	EepromSegment segment = {txBuf, rxBuf, 2};
+	EepromErrorState status = m95_Transfer(eeprom, &segment, 1);
+	if(status != EepromOk)
 	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
+		return status;
 	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-
 	*data = rxBuf[1];
+	eeprom->volatileShadow = rxBuf[1] & (1 << EEPROM_VOLATILE_BUFEN_BIT);
+	eeprom->shadowValid |= EEPROM_SHADOW_VOLATILE;
 	return EepromOk;
 }
 
 /**
   * @brief 	Writes the volatile register. Setting BUFEN enables buffered page program
   * (a page program instruction can be loaded while the previous one is executing).
+  * Nothing is sent if the shadow shows BUFEN already has the requested value.
   * @param	eeprom eeprom struct
   * @param	data Register value to write
   * @retval	error state
   */
 EepromErrorState eeprom_WriteVolatileRegister(Eeprom* eeprom, uint8_t data)
 {
+	uint8_t bufen = data & (1 << EEPROM_VOLATILE_BUFEN_BIT);
+	if((eeprom->shadowValid & EEPROM_SHADOW_VOLATILE) && eeprom->volatileShadow == bufen)
+	{
+		return EepromOk;
+	}
 	// Send the write enable (WREN) instruction
 	m95_WriteEnable(eeprom);
 
 	uint8_t txPacket[2] = {WRVR_CMD, data};
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, txPacket, 2, HAL_MAX_DELAY) != HAL_OK)
+	EepromSegment segment = {txPacket, NULL, 2};
+	EepromErrorState status = m95_Transfer(eeprom, &segment, 1);
+	if(status == EepromOk)
 	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
+		status = m95_PollReady(eeprom, READY_CHECK_TIMEOUT);
 	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-	return m95_PollReady(eeprom, READY_CHECK_TIMEOUT);
+	if(status != EepromOk)
+	{
+		eeprom->shadowValid &= ~EEPROM_SHADOW_VOLATILE;
+		return status;
+	}
+	eeprom->volatileShadow = bufen;
+	eeprom->shadowValid |= EEPROM_SHADOW_VOLATILE;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Sets the output driver strength via the DRV1:DRV0 configuration register bits.
+  * The setting is non-volatile, so it is only written when it differs from the current value.
+  * @param	eeprom eeprom struct
+  * @param	drive EEPROM_DRIVE_MEDIUM or EEPROM_DRIVE_LOW
+  * @retval	error state
+  */
+EepromErrorState eeprom_SetOutputDrive(Eeprom* eeprom, uint8_t drive)
+{
+	if(drive != EEPROM_DRIVE_MEDIUM && drive != EEPROM_DRIVE_LOW)
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status = m95p32_LoadShadow(eeprom, EEPROM_SHADOW_STATUS | EEPROM_SHADOW_CONFIG);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	uint8_t driveMask = (1 << EEPROM_CONFIG_DRV1_BIT) | (1 << EEPROM_CONFIG_DRV0_BIT);
+	if((eeprom->configShadow & driveMask) == (drive << EEPROM_CONFIG_DRV0_BIT))
+	{
+		return EepromOk;
+	}
+	uint8_t configReg = (eeprom->configShadow & ~driveMask) | (drive << EEPROM_CONFIG_DRV0_BIT);
+	return m95p32_WriteStatusConfigRegisters(eeprom, eeprom->statusShadow, configReg, TRUE);
 }
 
 /**
   * @brief 	Sets the block write protection level via the status register.
   * The protected region is rejected by program/erase instructions and flagged in the
   * safety register (PAMAF). Note that erase instructions are only accepted at all
-  * when the array is fully unprotected (bpLevel 0).
+  * when the array is fully unprotected (bpLevel 0). The driver rejects writes and erases
+  * the device would ignore with EepromStorageError, without sending them. The register is
+  * only written when the setting differs from the current one.
   * @param	eeprom eeprom struct
   * @param	bpLevel BP2:BP0 value, 0-7. 0 = unprotected, 1-6 = 1/64 to 1/2 of the
   * 		array, 7 = whole array
@@ -569,40 +610,249 @@ EepromErrorState eeprom_SetBlockProtection(Eeprom* eeprom, uint8_t bpLevel, uint
 	{
 		return EepromStorageError;
 	}
-	uint8_t statusReg;
-	EepromErrorState status = m95_ReadStatusRegister(eeprom, &statusReg);
+	EepromErrorState status = m95p32_LoadShadow(eeprom, EEPROM_SHADOW_STATUS);
 	if(status != EepromOk)
 	{
 		return status;
 	}
 	// Clear and set the BP2:BP0 and TB bits, preserving SRWD
+	uint8_t statusReg = eeprom->statusShadow;
 	statusReg &= ~((1 << BP2_BIT) | (1 << BP1_BIT) | (1 << BP0_BIT) | (1 << TB_BIT));
 	statusReg |= (bpLevel << BP0_BIT);
 	if(protectBottom)
 	{
 		statusReg |= (1 << TB_BIT);
 	}
+	if(statusReg == eeprom->statusShadow)
+	{
+		return EepromOk;
+	}
 	return m95p32_WriteStatusConfigRegisters(eeprom, statusReg, 0, FALSE);
 }
-#endif
 
-
-//-------------------- Private Device Functions --------------------//
-#ifdef EEPROM_M95
 /**
-  * @brief 	Reads 'size' number of bytes from the eeprom to the data pointer.
-  * 
+  * @brief 	Software resets the device with the RSTEN and RESET instructions. Any cycle in
+  * progress is aborted, the write enable latch and volatile register are cleared, and the
+  * register shadows are invalidated.
   * @param	eeprom eeprom struct
-  * @param 	data Pointer for the data to read to
+  * @retval	error state
+  */
+EepromErrorState eeprom_Reset(Eeprom* eeprom)
+{
+	eeprom_InvalidateShadow(eeprom);
+	EepromErrorState status = m95p32_SendCommand(eeprom, RSTEN_CMD);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	status = m95p32_SendCommand(eeprom, RESET_CMD);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	return m95_PollReady(eeprom, READY_CHECK_TIMEOUT);
+}
+
+/**
+  * @brief 	Discards the register shadows, so they are read from the device when next needed.
+  * @param	eeprom eeprom struct
+  */
+void eeprom_InvalidateShadow(Eeprom* eeprom)
+{
+	eeprom->shadowValid = 0;
+}
+#endif
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Sends a page write or page program and returns without waiting for the cycle.
+  */
+static EepromErrorState eeprom_PageStart(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr, uint8_t preErased)
+{
+#ifdef EEPROM_M95
+	if(len == 0 || len > PAGE_WIDTH - (dataAddr % PAGE_WIDTH) || dataAddr >= DEVICE_SIZE)
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status;
+#if defined(M95P32)
+	status = m95p32_CheckWritable(eeprom, dataAddr, len);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+#endif
+	uint8_t busy;
+	status = eeprom_IsBusy(eeprom, &busy);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(busy)
+	{
+		return EepromBusy;
+	}
+	EEPROM_TRACE_BEGIN(eeprom);
+	// The page write sequence without its ready polling steps
+	EepromSeqPageWrite seq;
+	eeprom_SeqBuildPageWrite(&seq, pData, (uint16_t)len, dataAddr, preErased);
+	status = eeprom_SeqRun(eeprom, &seq.steps[1], 3);
+	EEPROM_TRACE_END(eeprom, preErased ? EepromTraceProgram : EepromTraceWrite, dataAddr, len, status);
+	return status;
+#endif
+}
+
+/**
+  * @brief 	Splits a write at page boundaries into page writes.
+  */
+static EepromErrorState eeprom_WritePages(Eeprom* eeprom, uint8_t *pData, uint32_t len, uint32_t dataAddr)
+{
+	EepromErrorState status;
+	static uint32_t numRemaining;
+	static uint32_t currentDataAddr;
+	static uint8_t *currentData;
+
+	/* 
+	* Because each page becomes row locked, if a write reaches the end of a page boundary,
+	* the address counter in the eeprom will reset to the beginning of the page.
+	* Therefore, the buffer address must be checked against a multiple of the page width,
+	* With that many bytes being written, then the rest of the data can be written to consecutive pages.
+	* If this is not done, other data in the page which may not be part of the buffer can be overwritten.
+	*
+	* The formula to work out how many bits can be written before overflowing the current page is:
+	* currentPageBytes = PAGE_WIDTH - (addres % PAGE_WIDTH)
+	*
+	* currentPageBytes number of bytes are written to the page that the data address exists in,
+	* then full pages can be written to as normal.
+	*/
+
+	// Calculate how many bytes exist in the current page that need to be written to
+	uint16_t currentPageBytes = PAGE_WIDTH - (dataAddr % PAGE_WIDTH);
+	
+	// Update the static variables to those passed to the function
+	currentData = pData;
+	currentDataAddr = dataAddr;
+
+	if(len > currentPageBytes)
+	{		
+		#ifdef EEPROM_M95
+		status = m95_Write(eeprom, currentData, currentPageBytes, currentDataAddr);
+		#endif
+		// Update the static data variables
+		numRemaining = (len - currentPageBytes);
+		currentData += currentPageBytes;
+		currentDataAddr += currentPageBytes;
+	}
+	else
+	{
+		#ifdef EEPROM_M95
+		status = m95_Write(eeprom, currentData, len, currentDataAddr);
+		#endif
+		return status;
+	}
+
+	// For consecutive writes after the initial page write
+	while(numRemaining > 0)
+	{
+		// If this is the last sequential write required
+		if(numRemaining <= PAGE_WIDTH)
+		{
+			#ifdef EEPROM_M95
+			status = m95_Write(eeprom, currentData, numRemaining, currentDataAddr);
+			#endif
+			return status;
+		}
+		else
+		{
+			#ifdef EEPROM_M95
+			status = m95_Write(eeprom, currentData, PAGE_WIDTH, currentDataAddr);
+			#endif
+			numRemaining -= PAGE_WIDTH;
+			currentData += PAGE_WIDTH;
+			currentDataAddr += PAGE_WIDTH;
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	return EepromOk;
+}
+
+
+/**
+  * @brief 	CRC-16/CCITT (polynomial 0x1021), bitwise. Used for the small metadata
+  * records kept by the storage modules.
+  * @param	pData Data
+  * @param	len Number of bytes
+  * @param	crc Initial value (0xffff), or the result of a previous call to continue
+  * @retval	CRC
+  */
+uint16_t eeprom_Crc16(const uint8_t* pData, uint32_t len, uint16_t crc)
+{
+	for(uint32_t i=0; i<len; i++)
+	{
+		crc ^= (uint16_t)(pData[i] << 8);
+		for(uint8_t bit=0; bit<8; bit++)
+		{
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+//-------------------- Private Device Functions --------------------//
+#ifdef EEPROM_M95
+/**
+  * @brief 	Runs one SPI transaction: asserts chip select, transfers each segment in order
+  * and releases chip select. Transports that can run a segment list in one call are
+  * handed the whole list; otherwise each segment is a separate transfer call.
+  * @param	eeprom eeprom struct
+  * @param	segments Segment list
+  * @param	numSegments Number of segments
+  * @retval	error state
+  */
+EepromErrorState m95_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments)
+{
+	const EepromTransport* transport = eeprom->transport;
+	if(transport->caps & EEPROM_TRANSPORT_CAP_SEGMENTS)
+	{
+		return transport->transfer(eeprom, segments, numSegments);
+	}
+	EepromErrorState status = EepromOk;
+	transport->select(eeprom);
+	for(uint8_t i=0; i<numSegments && status == EepromOk; i++)
+	{
+		const EepromSegment* segment = &segments[i];
+		if(segment->tx != NULL && segment->rx != NULL)
+		{
+			status = transport->transmitReceive(eeprom, segment->tx, segment->rx, segment->len);
+		}
+		else if(segment->rx != NULL)
+		{
+			status = transport->receive(eeprom, segment->rx, segment->len);
+		}
+		else if(segment->tx != NULL)
+		{
+			status = transport->transmit(eeprom, segment->tx, segment->len);
+		}
+	}
+	transport->deselect(eeprom);
+	return status;
+}
+
+/**
+  * @brief 	Reads 'size' number of bytes from the eeprom to the data pointer.
+  * 
+  * @param	eeprom eeprom struct
+  * @param 	data Pointer for the data to read to
   * @param	dataAddr Address to begin reading from
   * @param	size Number of bytes to be read
   * @retval	error state
   */
 EepromErrorState m95_Read(Eeprom* eeprom, uint8_t *pData, uint32_t size, uint32_t dataAddr)
 {
-	// Check to make sure the device is ready
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-
 	// Prepare the command + address header
 	uint8_t txPacket[4];
 	txPacket[0] = READ_CMD;
@@ -610,18 +860,8 @@ EepromErrorState m95_Read(Eeprom* eeprom, uint8_t *pData, uint32_t size, uint32_
 	txPacket[2] = (uint8_t)((dataAddr >> 8) & 0xff);
 	txPacket[3] = (uint8_t)(dataAddr & 0xff);
 
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, txPacket, 4, HAL_MAX_DELAY) != HAL_OK)
-	{
-		return EepromHalError;
-	}
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	if(HAL_SPI_Receive(eeprom->hspi, pData, size, HAL_MAX_DELAY) != HAL_OK)
-	{
-		return EepromHalError;
-	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-	return EepromOk;
+	EepromSegment segments[2] = {{txPacket, NULL, 4}, {NULL, pData, size}};
+	return m95_Transfer(eeprom, segments, 2);
 }
 
 /**
@@ -640,44 +880,11 @@ EepromErrorState m95_Write(Eeprom* eeprom, uint8_t *data, uint32_t size, uint32_
 	{
 		return EepromStorageError;
 	}
-	// Check to make sure the device is ready
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-
-	// Send the write enmable (WREN) instruction
-	m95_WriteEnable(eeprom);
-
-	// Prepare the command + address header
-	uint8_t txPacket[4 + size];
-	txPacket[0] = WRITE_CMD;
-	txPacket[1] = (uint8_t)((dataAddr >> 16) & 0xff);
-	txPacket[2] = (uint8_t)((dataAddr >> 8) & 0xff);
-	txPacket[3] = (uint8_t)(dataAddr & 0xff);
-	// Copy the data to be written into the transmit buffer
-	for(uint32_t i=0; i<size; i++)
-	{
-		txPacket[4+i] = data[i];
-	}
-
-	// Wait until the device is ready
-	// On a HAL error or device timeout, return the error condition
-	EepromErrorState status = m95_PollReady(eeprom, READY_CHECK_TIMEOUT);
-	if(status != EepromOk)
-	{
-		return status;
-	}
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, txPacket, size + 4, HAL_MAX_DELAY) != HAL_OK)
-	{
-		return EepromHalError;
-	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-	status = m95_PollReady(eeprom, READY_CHECK_TIMEOUT);
-	if(status != EepromOk)
-	{
-		return status;
-	}
-	return status;
+	// Wait for any previous cycle, send WREN, then the header and payload in one
+	// chip select window straight from the caller's buffer, then wait for the write cycle
+	EepromSeqPageWrite seq;
+	uint8_t numSteps = eeprom_SeqBuildPageWrite(&seq, data, (uint16_t)size, dataAddr, FALSE);
+	return eeprom_SeqRun(eeprom, seq.steps, numSteps);
 }
 
 /**
@@ -690,30 +897,26 @@ EepromErrorState m95_Write(Eeprom* eeprom, uint8_t *data, uint32_t size, uint32_
   */
 EepromErrorState m95_PollReady(Eeprom* eeprom, uint32_t timeoutMs)
 {
+	const EepromTransport* transport = eeprom->transport;
 	uint8_t txBuf = RDSR_CMD;
 	uint8_t rxBuf;
 	uint8_t deviceBusy = TRUE;
 
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, &txBuf, 1, HAL_MAX_DELAY) != HAL_OK)
+	// The status register is output continuously while chip select stays asserted
+	transport->select(eeprom);
+	if(transport->transmit(eeprom, &txBuf, 1) != EepromOk)
 	{
+		transport->deselect(eeprom);
 		return EepromHalError;
 	}
-	uint32_t startMs, timeMs = 0;
-	#if FRAMEWORK_STM32CUBE
-	startMs = HAL_GetTick();
-	#elif FRAMEWORK_ARDUINO
-	startMs = millis();
-	#endif
-	timeMs = startMs;
+	uint32_t startMs = transport->getTick(eeprom);
+	uint32_t timeMs = startMs;
 	while((timeMs - startMs) < timeoutMs)
 	{
 		// Read the status register contents
-		while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-		if(HAL_SPI_Receive(eeprom->hspi, &rxBuf, 1, HAL_MAX_DELAY) != HAL_OK)
+		if(transport->receive(eeprom, &rxBuf, 1) != EepromOk)
 		{
-			HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
+			transport->deselect(eeprom);
 			return EepromHalError;
 		}
 		// Check the WIP bit
@@ -723,17 +926,16 @@ EepromErrorState m95_PollReady(Eeprom* eeprom, uint32_t timeoutMs)
 			break;
 		}
 		// Get the current polling time. This is used to check for a timeout condition
-		#if FRAMEWORK_STM32CUBE
-		timeMs = HAL_GetTick();
-		#elif FRAMEWORK_ARDUINO
-		timeMs = millis();
-		#endif
+		timeMs = transport->getTick(eeprom);
 	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
+	transport->deselect(eeprom);
 	if(deviceBusy)
 	{
 		return EepromBusy;
 	}
+#if defined(M95P32)
+	m95p32_UpdateStatusShadow(eeprom, rxBuf);
+#endif
 	return EepromOk;
 }
 
@@ -748,13 +950,8 @@ EepromErrorState m95_WriteEnable(Eeprom* eeprom)
 {
 	// Send the write enmable (WREN) instruction
 	uint8_t wrenPacket = WREN_CMD;
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, &wrenPacket, 1, HAL_MAX_DELAY) != HAL_OK)
-	{
-		return EepromHalError;
-	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-	return EepromOk;
+	EepromSegment segment = {&wrenPacket, NULL, 1};
+	return m95_Transfer(eeprom, &segment, 1);
 }
 
 /**
@@ -770,15 +967,10 @@ EepromErrorState m95_WriteEnable(Eeprom* eeprom)
   */
 EepromErrorState m95_WriteDisable(Eeprom* eeprom)
 {
-	// Send the write enmable (WREN) instruction
+	// Send the write disable (WRDI) instruction
 	uint8_t wrdiPacket = WRDI_CMD;
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, &wrdiPacket, 1, HAL_MAX_DELAY) != HAL_OK)
-	{
-		return EepromHalError;
-	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-	return EepromOk;
+	EepromSegment segment = {&wrdiPacket, NULL, 1};
+	return m95_Transfer(eeprom, &segment, 1);
 }
 
 /**
@@ -793,15 +985,16 @@ EepromErrorState m95_ReadStatusRegister(Eeprom* eeprom, uint8_t* data)
 	uint8_t txBuf[2] = {RDSR_CMD, 0};
 	uint8_t rxBuf[2];
 
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_TransmitReceive(eeprom->hspi, txBuf, rxBuf, 2, HAL_MAX_DELAY) != HAL_OK)
+	EepromSegment segment = {txBuf, rxBuf, 2};
+	EepromErrorState status = m95_Transfer(eeprom, &segment, 1);
+	if(status != EepromOk)
 	{
-		return EepromHalError;
+		return status;
 	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-
 	*data = rxBuf[1];
+#if defined(M95P32)
+	m95p32_UpdateStatusShadow(eeprom, rxBuf[1]);
+#endif
 	return EepromOk;
 }
 
@@ -814,15 +1007,8 @@ EepromErrorState m95_ReadStatusRegister(Eeprom* eeprom, uint8_t* data)
   */
 EepromErrorState m95p32_SendCommand(Eeprom* eeprom, uint8_t cmd)
 {
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, &cmd, 1, HAL_MAX_DELAY) != HAL_OK)
-	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
-	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-	return EepromOk;
+	EepromSegment segment = {&cmd, NULL, 1};
+	return m95_Transfer(eeprom, &segment, 1);
 }
 
 /**
@@ -831,14 +1017,17 @@ EepromErrorState m95p32_SendCommand(Eeprom* eeprom, uint8_t cmd)
   * @param	cmd Erase instruction byte (PGER/SCER/BKER/CHER)
   * @param	dataAddr Address within the region to erase (ignored if hasAddress is FALSE)
   * @param	hasAddress TRUE if the instruction takes a 24-bit address (all except chip erase)
-  * @param	timeoutMs Poll timeout matched to the erase cycle time of the operation
-  * @retval	Error state
+  * @param	timeoutMs Poll timeout matched to the erase cycle time of the operation,
+  * 		0 to return as soon as the instruction is sent
+  * @retval	Error state. EepromStorageError if block protection is set (erases would be ignored).
   */
 EepromErrorState m95p32_Erase(Eeprom* eeprom, uint8_t cmd, uint32_t dataAddr, uint8_t hasAddress, uint32_t timeoutMs)
 {
-	// Check to make sure the device is ready
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-
+	EepromErrorState status = m95p32_CheckErasable(eeprom);
+	if(status != EepromOk)
+	{
+		return status;
+	}
 	// Send the write enable (WREN) instruction
 	m95_WriteEnable(eeprom);
 
@@ -853,17 +1042,55 @@ EepromErrorState m95p32_Erase(Eeprom* eeprom, uint8_t cmd, uint32_t dataAddr, ui
 		packetLen = 4;
 	}
 
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, txPacket, packetLen, HAL_MAX_DELAY) != HAL_OK)
+	EepromSegment segment = {txPacket, NULL, packetLen};
+	status = m95_Transfer(eeprom, &segment, 1);
+	if(status != EepromOk || timeoutMs == 0)
 	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
+		return status;
 	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
 	return m95_PollReady(eeprom, timeoutMs);
 }
 
+/**
+  * @brief	Checks the device is idle and starts an erase without waiting for it.
+  * @param	eeprom eeprom struct
+  * @param	cmd Erase instruction byte (PGER/SCER/BKER)
+  * @param	dataAddr Address within the region to erase
+  * @param	traceOp EepromTraceOp logged for the call
+  * @param	size Erase size, for the trace
+  * @retval	Error state. EepromBusy if a previous cycle is still in progress.
+  */
+EepromErrorState m95p32_EraseStart(Eeprom* eeprom, uint8_t cmd, uint32_t dataAddr, uint8_t traceOp, uint32_t size)
+{
+#ifndef EEPROM_TRACE
+	(void)traceOp;
+	(void)size;
+#endif
+	if(dataAddr >= DEVICE_SIZE)
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status = m95p32_CheckErasable(eeprom);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	uint8_t busy;
+	status = eeprom_IsBusy(eeprom, &busy);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(busy)
+	{
+		return EepromBusy;
+	}
+	EEPROM_TRACE_BEGIN(eeprom);
+	status = m95p32_Erase(eeprom, cmd, dataAddr, TRUE, 0);
+	EEPROM_TRACE_END(eeprom, traceOp, dataAddr - (dataAddr % size), size, status);
+	return status;
+}
+
 /**
   * @brief	Writes the status register, and optionally the configuration register,
   * with a WRSR instruction (one or two data bytes).
@@ -878,19 +1105,125 @@ EepromErrorState m95p32_WriteStatusConfigRegisters(Eeprom* eeprom, uint8_t statu
 	// Send the write enable (WREN) instruction
 	m95_WriteEnable(eeprom);
 
+	// The final status read of the poll refreshes the status shadow. The configuration
+	// register is re-read when next needed, as the device may not take every bit (LID
+	// cannot be cleared).
+	if(writeConfig)
+	{
+		eeprom->shadowValid &= ~EEPROM_SHADOW_CONFIG;
+	}
 	uint8_t txPacket[3] = {WRSR_CMD, statusReg, configReg};
 	uint16_t packetLen = writeConfig ? 3 : 2;
 
-	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
-	if(HAL_SPI_Transmit(eeprom->hspi, txPacket, packetLen, HAL_MAX_DELAY) != HAL_OK)
+	EepromSegment segment = {txPacket, NULL, packetLen};
+	EepromErrorState status = m95_Transfer(eeprom, &segment, 1);
+	if(status != EepromOk)
 	{
-		HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
-		return EepromHalError;
+		return status;
 	}
-	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
 	return m95_PollReady(eeprom, WRSR_TIMEOUT);
 }
+
+/**
+  * @brief	Keeps the status shadow coherent from a status register value read from the
+  * device. Values read during a cycle are skipped, as a status register write in progress
+  * may not have taken effect yet.
+  * @param	eeprom eeprom struct
+  * @param	statusReg Status register value read from the device
+  */
+void m95p32_UpdateStatusShadow(Eeprom* eeprom, uint8_t statusReg)
+{
+	if((statusReg >> WIP_BIT) & 1)
+	{
+		return;
+	}
+	eeprom->statusShadow = statusReg & STATUS_NV_MASK;
+	eeprom->shadowValid |= EEPROM_SHADOW_STATUS;
+}
+
+/**
+  * @brief	Reads any of the requested registers whose shadow is not valid.
+  * @param	eeprom eeprom struct
+  * @param	which EEPROM_SHADOW_x flags of the shadows needed
+  * @retval	Error state
+  */
+EepromErrorState m95p32_LoadShadow(Eeprom* eeprom, uint8_t which)
+{
+	EepromErrorState status;
+	if((which & EEPROM_SHADOW_STATUS) && !(eeprom->shadowValid & EEPROM_SHADOW_STATUS))
+	{
+		// Wait out any cycle in progress; the final status read fills the shadow
+		status = m95_PollReady(eeprom, WRSR_TIMEOUT);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	if((which & EEPROM_SHADOW_CONFIG) && !(eeprom->shadowValid & EEPROM_SHADOW_CONFIG))
+	{
+		uint8_t configReg, safetyReg;
+		status = eeprom_ReadConfigRegisters(eeprom, &configReg, &safetyReg);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	if((which & EEPROM_SHADOW_VOLATILE) && !(eeprom->shadowValid & EEPROM_SHADOW_VOLATILE))
+	{
+		uint8_t volatileReg;
+		status = eeprom_ReadVolatileRegister(eeprom, &volatileReg);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief	Checks a write or program range against the block protection in the status
+  * shadow. The device would ignore the write and set PAMAF, so it is rejected here instead.
+  * @param	eeprom eeprom struct
+  * @param	dataAddr First address written
+  * @param	len Number of bytes written
+  * @retval	Error state. EepromStorageError if any of the range is protected.
+  */
+EepromErrorState m95p32_CheckWritable(Eeprom* eeprom, uint32_t dataAddr, uint32_t len)
+{
+	EepromErrorState status = m95p32_LoadShadow(eeprom, EEPROM_SHADOW_STATUS);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	uint8_t bpLevel = (eeprom->statusShadow >> BP0_BIT) & 0x07;
+	if(bpLevel == 0 || len == 0)
+	{
+		return EepromOk;
+	}
+	// Levels 1-6 protect 1/64 to 1/2 of the array, from the bottom if TB is set
+	uint32_t protectedSize = (bpLevel == 7) ? DEVICE_SIZE : (DEVICE_SIZE >> (7 - bpLevel));
+	if((eeprom->statusShadow >> TB_BIT) & 1)
+	{
+		return (dataAddr < protectedSize) ? EepromStorageError : EepromOk;
+	}
+	return (dataAddr + len > DEVICE_SIZE - protectedSize) ? EepromStorageError : EepromOk;
+}
+
+/**
+  * @brief	Checks that erases will be accepted: the device ignores every erase instruction
+  * while any block protection is set.
+  * @param	eeprom eeprom struct
+  * @retval	Error state. EepromStorageError if block protection is set.
+  */
+EepromErrorState m95p32_CheckErasable(Eeprom* eeprom)
+{
+	EepromErrorState status = m95p32_LoadShadow(eeprom, EEPROM_SHADOW_STATUS);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	return (((eeprom->statusShadow >> BP0_BIT) & 0x07) != 0) ? EepromStorageError : EepromOk;
+}
 #endif
 #endif
 
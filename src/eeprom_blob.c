@@ -0,0 +1,498 @@
+/*
+ * eeprom_blob.c
+ *
+ * Compressed blob storage layered over eeprom_Read/eeprom_Write.
+ *
+ * Stored layout (all fields little endian):
+ * 	0x00	Magic (EBLB)
+ * 	0x04	Uncompressed length
+ * 	0x08	Chunk size
+ * 	0x0A	Number of chunks
+ * 	0x0C	Reserved
+ * 	0x10	Chunk table: one 32-bit end offset per chunk, relative to the start of the chunk data.
+ * 			Bit 31 is set when the chunk is stored raw.
+ * 	...		Chunk data
+ *
+ * Chunks are compressed with LZSS: a control byte holds 8 flags (LSB first, 1 = literal),
+ * each followed by either a literal byte or a 2 byte match (12-bit offset, 4-bit length).
+ */
+
+#include "eeprom_blob.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+#define BLOB_MAGIC				0x424C4245	// "EBLB"
+#define BLOB_RAW_FLAG			0x80000000
+#define BLOB_MIN_MATCH			3
+#define BLOB_MAX_MATCH			18
+#define BLOB_MAX_OFFSET			4096
+
+#if EEPROM_BLOB_CHUNK_SIZE > BLOB_MAX_OFFSET
+#error "EEPROM_BLOB_CHUNK_SIZE must not exceed 4096 bytes"
+#endif
+
+typedef struct
+{
+	Eeprom* eeprom;
+	uint32_t bufAddr;				// Device address of pageBuf[0]
+	uint32_t fill;					// Number of bytes held in pageBuf
+} BlobStream;
+
+//-------------------- Private Function Prototypes --------------------//
+static EepromErrorState blob_StreamPut(BlobStream* stream, const uint8_t* data, uint32_t len);
+static EepromErrorState blob_StreamFlush(BlobStream* stream);
+static EepromErrorState blob_ReadHeader(Eeprom* eeprom, uint32_t blobAddr, uint32_t* len, uint32_t* chunkSize, uint32_t* numChunks);
+static uint32_t blob_Compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t dstMax);
+static EepromErrorState blob_Decompress(const uint8_t* src, uint32_t srcLen, uint8_t* dst, uint32_t dstLen);
+
+static uint8_t pageBuf[EEPROM_PAGE_SIZE];
+static uint8_t compBuf[EEPROM_BLOB_CHUNK_SIZE];
+static uint8_t chunkBuf[EEPROM_BLOB_CHUNK_SIZE];
+static uint16_t hashHead[EEPROM_BLOB_HASH_SIZE];
+
+static inline void blob_PutLe32(uint8_t* buf, uint32_t value)
+{
+	buf[0] = (uint8_t)(value & 0xff);
+	buf[1] = (uint8_t)((value >> 8) & 0xff);
+	buf[2] = (uint8_t)((value >> 16) & 0xff);
+	buf[3] = (uint8_t)((value >> 24) & 0xff);
+}
+
+static inline uint32_t blob_GetLe32(const uint8_t* buf)
+{
+	return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+/**
+  * @brief 	Compresses and stores a blob. The source is compressed twice (once to build the
+  * chunk table, once to emit the chunk data) so that the output is written strictly
+  * sequentially and every device page is programmed exactly once.
+  * @param	eeprom eeprom struct
+  * @param	blobAddr Address to store the blob at
+  * @param	maxStoredLen Size of the region reserved for the blob. Must be at least
+  * 		EEPROM_BLOB_MAX_STORED_SIZE(len) so any content fits.
+  * @param 	pData Pointer to the uncompressed data
+  * @param	len Number of bytes to store
+  * @param	storedLen Set to the number of device bytes used. May be NULL.
+  * @retval	error state
+  */
+EepromErrorState eeprom_BlobSave(Eeprom* eeprom, uint32_t blobAddr, uint32_t maxStoredLen, uint8_t *pData, uint32_t len, uint32_t* storedLen)
+{
+	if(len == 0 || EEPROM_BLOB_NUM_CHUNKS(len) > 0xffff
+		|| maxStoredLen < EEPROM_BLOB_MAX_STORED_SIZE(len)
+		|| blobAddr >= EEPROM_DEVICE_SIZE || maxStoredLen > (EEPROM_DEVICE_SIZE - blobAddr))
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status;
+	uint32_t numChunks = EEPROM_BLOB_NUM_CHUNKS(len);
+	BlobStream stream = {eeprom, blobAddr, 0};
+
+	uint8_t header[EEPROM_BLOB_HEADER_SIZE];
+	memset(header, 0xff, sizeof(header));
+	blob_PutLe32(&header[0], BLOB_MAGIC);
+	blob_PutLe32(&header[4], len);
+	header[8] = (uint8_t)(EEPROM_BLOB_CHUNK_SIZE & 0xff);
+	header[9] = (uint8_t)((EEPROM_BLOB_CHUNK_SIZE >> 8) & 0xff);
+	header[10] = (uint8_t)(numChunks & 0xff);
+	header[11] = (uint8_t)((numChunks >> 8) & 0xff);
+	status = blob_StreamPut(&stream, header, EEPROM_BLOB_HEADER_SIZE);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+
+	// Chunk table
+	uint32_t dataLen = 0;
+	for(uint32_t i=0; i<numChunks; i++)
+	{
+		uint32_t chunkLen = len - (i * EEPROM_BLOB_CHUNK_SIZE);
+		if(chunkLen > EEPROM_BLOB_CHUNK_SIZE)
+		{
+			chunkLen = EEPROM_BLOB_CHUNK_SIZE;
+		}
+		uint32_t compLen = blob_Compress(&pData[i * EEPROM_BLOB_CHUNK_SIZE], chunkLen, compBuf, chunkLen);
+		uint8_t entry[4];
+		if(compLen)
+		{
+			dataLen += compLen;
+			blob_PutLe32(entry, dataLen);
+		}
+		else
+		{
+			dataLen += chunkLen;
+			blob_PutLe32(entry, dataLen | BLOB_RAW_FLAG);
+		}
+		status = blob_StreamPut(&stream, entry, 4);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+
+	// Chunk data
+	for(uint32_t i=0; i<numChunks; i++)
+	{
+		uint8_t* chunk = &pData[i * EEPROM_BLOB_CHUNK_SIZE];
+		uint32_t chunkLen = len - (i * EEPROM_BLOB_CHUNK_SIZE);
+		if(chunkLen > EEPROM_BLOB_CHUNK_SIZE)
+		{
+			chunkLen = EEPROM_BLOB_CHUNK_SIZE;
+		}
+		uint32_t compLen = blob_Compress(chunk, chunkLen, compBuf, chunkLen);
+		if(compLen)
+		{
+			status = blob_StreamPut(&stream, compBuf, compLen);
+		}
+		else
+		{
+			status = blob_StreamPut(&stream, chunk, chunkLen);
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	status = blob_StreamFlush(&stream);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(storedLen != NULL)
+	{
+		*storedLen = EEPROM_BLOB_HEADER_SIZE + (4 * numChunks) + dataLen;
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Reads a range of uncompressed bytes from a stored blob.
+  * Only the chunks overlapping the range are read and decompressed.
+  * @param	eeprom eeprom struct
+  * @param	blobAddr Address the blob was stored at
+  * @param 	pData Pointer for the data to read to
+  * @param	len Number of bytes to be read
+  * @param	offset Uncompressed offset within the blob to begin reading from
+  * @retval	error state. EepromStorageError if the blob is missing or corrupt, or the
+  * 		range exceeds its length.
+  */
+EepromErrorState eeprom_BlobRead(Eeprom* eeprom, uint32_t blobAddr, uint8_t *pData, uint32_t len, uint32_t offset)
+{
+	uint32_t blobLen, chunkSize, numChunks;
+	EepromErrorState status = blob_ReadHeader(eeprom, blobAddr, &blobLen, &chunkSize, &numChunks);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(len == 0 || offset > blobLen || len > (blobLen - offset))
+	{
+		return EepromStorageError;
+	}
+	uint32_t tableAddr = blobAddr + EEPROM_BLOB_HEADER_SIZE;
+	uint32_t dataAddr = tableAddr + (4 * numChunks);
+
+	while(len > 0)
+	{
+		uint32_t chunk = offset / chunkSize;
+		uint32_t chunkOffset = offset % chunkSize;
+		uint32_t chunkLen = blobLen - (chunk * chunkSize);
+		if(chunkLen > chunkSize)
+		{
+			chunkLen = chunkSize;
+		}
+		uint32_t num = chunkLen - chunkOffset;
+		if(num > len)
+		{
+			num = len;
+		}
+
+		// The chunk spans from the previous chunk's end offset to its own
+		uint8_t entries[8];
+		uint32_t start = 0, end;
+		if(chunk == 0)
+		{
+			status = eeprom_Read(eeprom, entries, 4, tableAddr);
+			end = blob_GetLe32(&entries[0]);
+		}
+		else
+		{
+			status = eeprom_Read(eeprom, entries, 8, tableAddr + (4 * (chunk - 1)));
+			start = blob_GetLe32(&entries[0]) & ~BLOB_RAW_FLAG;
+			end = blob_GetLe32(&entries[4]);
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+
+		if(end & BLOB_RAW_FLAG)
+		{
+			// Raw chunks are read directly into the destination
+			status = eeprom_Read(eeprom, pData, num, dataAddr + start + chunkOffset);
+		}
+		else
+		{
+			uint32_t compLen = end - start;
+			if(end < start || compLen > chunkSize)
+			{
+				return EepromStorageError;
+			}
+			status = eeprom_Read(eeprom, compBuf, compLen, dataAddr + start);
+			if(status != EepromOk)
+			{
+				return status;
+			}
+			// Whole chunks are decompressed in place, partial chunks through the chunk buffer
+			if(num == chunkLen)
+			{
+				status = blob_Decompress(compBuf, compLen, pData, chunkLen);
+			}
+			else
+			{
+				status = blob_Decompress(compBuf, compLen, chunkBuf, chunkLen);
+				memcpy(pData, &chunkBuf[chunkOffset], num);
+			}
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		pData += num;
+		offset += num;
+		len -= num;
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Reads the uncompressed and stored sizes of a blob.
+  * The compression ratio is len / storedLen.
+  * @param	eeprom eeprom struct
+  * @param	blobAddr Address the blob was stored at
+  * @param	len Set to the uncompressed length
+  * @param	storedLen Set to the number of device bytes used
+  * @retval	error state
+  */
+EepromErrorState eeprom_BlobInfo(Eeprom* eeprom, uint32_t blobAddr, uint32_t* len, uint32_t* storedLen)
+{
+	uint32_t chunkSize, numChunks;
+	EepromErrorState status = blob_ReadHeader(eeprom, blobAddr, len, &chunkSize, &numChunks);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	uint8_t entry[4];
+	status = eeprom_Read(eeprom, entry, 4, blobAddr + EEPROM_BLOB_HEADER_SIZE + (4 * (numChunks - 1)));
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	*storedLen = EEPROM_BLOB_HEADER_SIZE + (4 * numChunks) + (blob_GetLe32(entry) & ~BLOB_RAW_FLAG);
+	return EepromOk;
+}
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Appends bytes to the output stream, writing each page as soon as it is complete.
+  */
+static EepromErrorState blob_StreamPut(BlobStream* stream, const uint8_t* data, uint32_t len)
+{
+	while(len > 0)
+	{
+		uint32_t room = EEPROM_PAGE_SIZE - ((stream->bufAddr + stream->fill) % EEPROM_PAGE_SIZE);
+		uint32_t num = (len < room) ? len : room;
+		memcpy(&pageBuf[stream->fill], data, num);
+		stream->fill += num;
+		data += num;
+		len -= num;
+		if(num == room)
+		{
+			EepromErrorState status = blob_StreamFlush(stream);
+			if(status != EepromOk)
+			{
+				return status;
+			}
+		}
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Writes any buffered bytes of the output stream.
+  */
+static EepromErrorState blob_StreamFlush(BlobStream* stream)
+{
+	if(stream->fill == 0)
+	{
+		return EepromOk;
+	}
+	EepromErrorState status = eeprom_Write(stream->eeprom, pageBuf, stream->fill, stream->bufAddr);
+	stream->bufAddr += stream->fill;
+	stream->fill = 0;
+	return status;
+}
+
+/**
+  * @brief 	Reads and validates a blob header.
+  */
+static EepromErrorState blob_ReadHeader(Eeprom* eeprom, uint32_t blobAddr, uint32_t* len, uint32_t* chunkSize, uint32_t* numChunks)
+{
+	uint8_t header[EEPROM_BLOB_HEADER_SIZE];
+	EepromErrorState status = eeprom_Read(eeprom, header, EEPROM_BLOB_HEADER_SIZE, blobAddr);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	*len = blob_GetLe32(&header[4]);
+	*chunkSize = (uint32_t)header[8] | ((uint32_t)header[9] << 8);
+	*numChunks = (uint32_t)header[10] | ((uint32_t)header[11] << 8);
+	if(blob_GetLe32(&header[0]) != BLOB_MAGIC || *len == 0
+		|| *chunkSize == 0 || *chunkSize > EEPROM_BLOB_CHUNK_SIZE
+		|| *numChunks != ((*len + *chunkSize - 1) / *chunkSize))
+	{
+		return EepromStorageError;
+	}
+	return EepromOk;
+}
+
+static inline uint32_t blob_Hash(const uint8_t* src)
+{
+	uint32_t key = (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16);
+	return ((key * 2654435761u) >> 16) & (EEPROM_BLOB_HASH_SIZE - 1);
+}
+
+/**
+  * @brief 	Compresses a chunk with a greedy single-candidate LZSS match finder.
+  * @retval	Compressed length, or 0 if the output would not be smaller than dstMax
+  */
+static uint32_t blob_Compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t dstMax)
+{
+	uint32_t in = 0, out = 0, ctrlPos = 0;
+	uint8_t bit = 8;
+
+	memset(hashHead, 0, sizeof(hashHead));
+	while(in < len)
+	{
+		if(bit == 8)
+		{
+			if(out >= dstMax)
+			{
+				return 0;
+			}
+			ctrlPos = out++;
+			dst[ctrlPos] = 0;
+			bit = 0;
+		}
+		uint32_t matchLen = 0, matchOffset = 0;
+		if(in + BLOB_MIN_MATCH <= len)
+		{
+			uint32_t hash = blob_Hash(&src[in]);
+			uint32_t candidate = hashHead[hash];
+			hashHead[hash] = (uint16_t)(in + 1);
+			if(candidate != 0)
+			{
+				candidate--;
+				uint32_t maxLen = len - in;
+				if(maxLen > BLOB_MAX_MATCH)
+				{
+					maxLen = BLOB_MAX_MATCH;
+				}
+				uint32_t n = 0;
+				while(n < maxLen && src[candidate + n] == src[in + n])
+				{
+					n++;
+				}
+				if(n >= BLOB_MIN_MATCH)
+				{
+					matchLen = n;
+					matchOffset = in - candidate;
+				}
+			}
+		}
+		if(matchLen)
+		{
+			if(out + 2 > dstMax)
+			{
+				return 0;
+			}
+			dst[out++] = (uint8_t)((matchOffset - 1) & 0xff);
+			dst[out++] = (uint8_t)((((matchOffset - 1) >> 8) << 4) | (matchLen - BLOB_MIN_MATCH));
+			// Index the positions covered by the match so later data can refer to them
+			for(uint32_t i=1; i<matchLen && (in + i + BLOB_MIN_MATCH) <= len; i++)
+			{
+				hashHead[blob_Hash(&src[in + i])] = (uint16_t)(in + i + 1);
+			}
+			in += matchLen;
+		}
+		else
+		{
+			if(out >= dstMax)
+			{
+				return 0;
+			}
+			dst[ctrlPos] |= (uint8_t)(1 << bit);
+			dst[out++] = src[in++];
+		}
+		bit++;
+	}
+	return (out < dstMax) ? out : 0;
+}
+
+/**
+  * @brief 	Decompresses an LZSS chunk, checking every reference against the buffers.
+  * @retval	EepromOk, or EepromStorageError if the data is corrupt
+  */
+static EepromErrorState blob_Decompress(const uint8_t* src, uint32_t srcLen, uint8_t* dst, uint32_t dstLen)
+{
+	uint32_t in = 0, out = 0;
+	while(out < dstLen)
+	{
+		if(in >= srcLen)
+		{
+			return EepromStorageError;
+		}
+		uint8_t ctrl = src[in++];
+		for(uint8_t bit=0; bit<8 && out<dstLen; bit++)
+		{
+			if((ctrl >> bit) & 1)
+			{
+				if(in >= srcLen)
+				{
+					return EepromStorageError;
+				}
+				dst[out++] = src[in++];
+			}
+			else
+			{
+				if(in + 2 > srcLen)
+				{
+					return EepromStorageError;
+				}
+				uint32_t matchOffset = ((uint32_t)src[in] | ((uint32_t)(src[in + 1] >> 4) << 8)) + 1;
+				uint32_t matchLen = (uint32_t)(src[in + 1] & 0x0f) + BLOB_MIN_MATCH;
+				in += 2;
+				if(matchOffset > out || matchLen > (dstLen - out))
+				{
+					return EepromStorageError;
+				}
+				// Byte-wise copy: matches may overlap their own output
+				for(uint32_t i=0; i<matchLen; i++, out++)
+				{
+					dst[out] = dst[out - matchOffset];
+				}
+			}
+		}
+	}
+	return EepromOk;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,357 @@
+/*
+ * eeprom_calib.c
+ *
+ * SPI clock auto-tuning and output drive calibration.
+ *
+ * Calibration page layout:
+ * 	0x00	Magic (0xC5 0x1B)
+ * 	0x02	Number of clock steps the record was made with
+ * 	0x03	Selected clock step
+ * 	0x04	Selected output drive
+ * 	0x05	Check byte (inverted sum of bytes 0x00-0x04)
+ * 	0x08	Test pattern (EEPROM_CALIB_PATTERN_LEN bytes)
+ */
+
+#include "eeprom_calib.h"
+#include "eeprom_m95.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+#define CALIB_MAGIC0		0xC5
+#define CALIB_MAGIC1		0x1B
+
+#if (EEPROM_CALIB_RECORD_SIZE + EEPROM_CALIB_PATTERN_LEN) > EEPROM_PAGE_SIZE
+#error "The calibration record and pattern must fit in one page"
+#endif
+
+//-------------------- Private Function Prototypes --------------------//
+static uint8_t calib_PatternByte(uint32_t i);
+static EepromErrorState calib_PatternMatches(Eeprom* eeprom, uint32_t calibAddr, uint8_t* matches);
+static EepromErrorState calib_FastestStep(Eeprom* eeprom, EepromSetClockFn setClock, uint8_t numClockSteps, uint32_t calibAddr, int16_t* step);
+static uint8_t calib_Check(const uint8_t* record);
+
+#if defined(M95P32)
+static const uint8_t driveSettings[] = {EEPROM_DRIVE_LOW, EEPROM_DRIVE_MEDIUM};	// Weakest first
+#endif
+
+/**
+  * @brief 	Searches for the fastest reliable SPI clock step and output drive strength,
+  * then stores the result in the calibration page.
+  * The test pattern is (re)written at the slowest clock step if it does not read back.
+  * At each drive strength the clock steps are tried from fastest to slowest; the
+  * fastest passing step wins, with ties going to the weaker drive. All register and
+  * array writes are made at clock step 0. The selected clock step is applied on return.
+  * @param	eeprom eeprom struct
+  * @param	setClock Callback that applies a clock step (0 = slowest)
+  * @param	numClockSteps Number of clock steps supported by setClock
+  * @param	calibAddr Page aligned address of the reserved calibration page
+  * @param	result Set to the selected setting
+  * @retval	error state. EepromDeviceError if the pattern does not read back even at step 0.
+  */
+EepromErrorState eeprom_CalibrateSpi(Eeprom* eeprom, EepromSetClockFn setClock, uint8_t numClockSteps, uint32_t calibAddr, EepromSpiCalibration* result)
+{
+	if(numClockSteps == 0 || (calibAddr % EEPROM_PAGE_SIZE) != 0 || calibAddr >= EEPROM_DEVICE_SIZE)
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status = setClock(eeprom, 0);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+
+	// Make sure the reference pattern is in place
+	uint8_t page[EEPROM_CALIB_RECORD_SIZE + EEPROM_CALIB_PATTERN_LEN];
+	uint8_t matches;
+	status = calib_PatternMatches(eeprom, calibAddr, &matches);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(!matches)
+	{
+		for(uint32_t i=0; i<EEPROM_CALIB_RECORD_SIZE; i++)
+		{
+			page[i] = 0xff;
+		}
+		for(uint32_t i=0; i<EEPROM_CALIB_PATTERN_LEN; i++)
+		{
+			page[EEPROM_CALIB_RECORD_SIZE + i] = calib_PatternByte(i);
+		}
+		status = eeprom_Write(eeprom, page, sizeof(page), calibAddr);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		status = calib_PatternMatches(eeprom, calibAddr, &matches);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		if(!matches)
+		{
+			return EepromDeviceError;
+		}
+	}
+
+	int16_t bestStep = -1;
+	uint8_t bestDrive = 0;
+#if defined(M95P32)
+	for(uint8_t d=0; d<sizeof(driveSettings); d++)
+	{
+		status = setClock(eeprom, 0);
+		if(status == EepromOk)
+		{
+			status = eeprom_SetOutputDrive(eeprom, driveSettings[d]);
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		int16_t step = -1;
+		status = calib_FastestStep(eeprom, setClock, numClockSteps, calibAddr, &step);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		if(step > bestStep)
+		{
+			bestStep = step;
+			bestDrive = driveSettings[d];
+		}
+	}
+#else
+	status = calib_FastestStep(eeprom, setClock, numClockSteps, calibAddr, &bestStep);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+#endif
+	if(bestStep < 0)
+	{
+		// Step 0 was verified above, so this only happens on intermittent errors
+		return EepromDeviceError;
+	}
+	bestStep -= EEPROM_CALIB_MARGIN_STEPS;
+	if(bestStep < 0)
+	{
+		bestStep = 0;
+	}
+	result->clockStep = (uint8_t)bestStep;
+	result->drive = bestDrive;
+
+	// Store the result and apply it
+	status = setClock(eeprom, 0);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+#if defined(M95P32)
+	status = eeprom_SetOutputDrive(eeprom, bestDrive);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+#endif
+	page[0] = CALIB_MAGIC0;
+	page[1] = CALIB_MAGIC1;
+	page[2] = numClockSteps;
+	page[3] = result->clockStep;
+	page[4] = result->drive;
+	page[5] = calib_Check(page);
+	page[6] = 0xff;
+	page[7] = 0xff;
+	status = eeprom_Write(eeprom, page, EEPROM_CALIB_RECORD_SIZE, calibAddr);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	return setClock(eeprom, result->clockStep);
+}
+
+/**
+  * @brief 	Applies a previously stored calibration and verifies it with one pattern read.
+  * @param	eeprom eeprom struct
+  * @param	setClock Callback that applies a clock step (0 = slowest)
+  * @param	numClockSteps Number of clock steps supported by setClock
+  * @param	calibAddr Page aligned address of the reserved calibration page
+  * @param	result Set to the applied setting
+  * @retval	error state. EepromStorageError if there is no valid record (or it was made
+  * 		with a different number of clock steps), EepromDeviceError if the stored setting
+  * 		no longer reads back cleanly. In both cases the clock is left at step 0 and
+  * 		eeprom_CalibrateSpi should be run.
+  */
+EepromErrorState eeprom_ApplySpiCalibration(Eeprom* eeprom, EepromSetClockFn setClock, uint8_t numClockSteps, uint32_t calibAddr, EepromSpiCalibration* result)
+{
+	if((calibAddr % EEPROM_PAGE_SIZE) != 0 || calibAddr >= EEPROM_DEVICE_SIZE)
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status = setClock(eeprom, 0);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	uint8_t record[EEPROM_CALIB_RECORD_SIZE];
+	status = eeprom_Read(eeprom, record, EEPROM_CALIB_RECORD_SIZE, calibAddr);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(record[0] != CALIB_MAGIC0 || record[1] != CALIB_MAGIC1 || record[5] != calib_Check(record)
+		|| record[2] != numClockSteps || record[3] >= numClockSteps)
+	{
+		return EepromStorageError;
+	}
+	result->clockStep = record[3];
+	result->drive = record[4];
+#if defined(M95P32)
+	// The drive setting is non-volatile, so this only writes if it was changed elsewhere
+	status = eeprom_SetOutputDrive(eeprom, result->drive);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+#endif
+	status = setClock(eeprom, result->clockStep);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	uint8_t matches;
+	status = calib_PatternMatches(eeprom, calibAddr, &matches);
+	if(status == EepromOk && !matches)
+	{
+		status = EepromDeviceError;
+	}
+	if(status != EepromOk)
+	{
+		setClock(eeprom, 0);
+	}
+	return status;
+}
+
+#if FRAMEWORK_STM32CUBE
+/**
+  * @brief 	Clock step callback for STM32 HAL SPI handles. Re-initialises the SPI
+  * peripheral with the prescaler for the step: step 0 = /256 up to step 7 = /2.
+  * @param	eeprom eeprom struct
+  * @param	clockStep 0 to EEPROM_SPI_PRESCALER_STEPS-1
+  * @retval	error state
+  */
+EepromErrorState eeprom_SetSpiPrescalerStep(Eeprom* eeprom, uint8_t clockStep)
+{
+	static const uint32_t prescalers[EEPROM_SPI_PRESCALER_STEPS] =
+	{
+		SPI_BAUDRATEPRESCALER_256, SPI_BAUDRATEPRESCALER_128, SPI_BAUDRATEPRESCALER_64, SPI_BAUDRATEPRESCALER_32,
+		SPI_BAUDRATEPRESCALER_16, SPI_BAUDRATEPRESCALER_8, SPI_BAUDRATEPRESCALER_4, SPI_BAUDRATEPRESCALER_2
+	};
+	if(clockStep >= EEPROM_SPI_PRESCALER_STEPS)
+	{
+		return EepromStorageError;
+	}
+	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
+	eeprom->hspi->Init.BaudRatePrescaler = prescalers[clockStep];
+	if(HAL_SPI_Init(eeprom->hspi) != HAL_OK)
+	{
+		return EepromHalError;
+	}
+	return EepromOk;
+}
+#endif
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Generates the test pattern: alternating bits, all ones/zeros and walking
+  * ones/zeros, so both edge rates and long runs are exercised.
+  */
+static uint8_t calib_PatternByte(uint32_t i)
+{
+	uint8_t walk = (uint8_t)(1 << ((i / 6) % 8));
+	switch(i % 6)
+	{
+		case 0: return 0x55;
+		case 1: return 0xaa;
+		case 2: return 0xff;
+		case 3: return 0x00;
+		case 4: return walk;
+		default: return (uint8_t)~walk;
+	}
+}
+
+/**
+  * @brief 	Reads the test pattern once at the current clock step and compares it.
+  */
+static EepromErrorState calib_PatternMatches(Eeprom* eeprom, uint32_t calibAddr, uint8_t* matches)
+{
+	uint8_t pattern[EEPROM_CALIB_PATTERN_LEN];
+	EepromErrorState status = eeprom_Read(eeprom, pattern, EEPROM_CALIB_PATTERN_LEN, calibAddr + EEPROM_CALIB_RECORD_SIZE);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	*matches = TRUE;
+	for(uint32_t i=0; i<EEPROM_CALIB_PATTERN_LEN; i++)
+	{
+		if(pattern[i] != calib_PatternByte(i))
+		{
+			*matches = FALSE;
+			break;
+		}
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Finds the fastest clock step at which EEPROM_CALIB_PASSES consecutive
+  * pattern reads all match, trying steps from fastest to slowest.
+  * @param	step Set to the passing step, or -1 if none passed
+  */
+static EepromErrorState calib_FastestStep(Eeprom* eeprom, EepromSetClockFn setClock, uint8_t numClockSteps, uint32_t calibAddr, int16_t* step)
+{
+	for(int16_t s=numClockSteps-1; s>=0; s--)
+	{
+		EepromErrorState status = setClock(eeprom, (uint8_t)s);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		uint8_t matches = TRUE;
+		for(uint8_t pass=0; pass<EEPROM_CALIB_PASSES && matches; pass++)
+		{
+			status = calib_PatternMatches(eeprom, calibAddr, &matches);
+			// A HAL error at a fast clock is treated as a failed pass, not a failed calibration
+			if(status != EepromOk)
+			{
+				matches = FALSE;
+			}
+		}
+		if(matches)
+		{
+			*step = s;
+			return EepromOk;
+		}
+	}
+	*step = -1;
+	return EepromOk;
+}
+
+static uint8_t calib_Check(const uint8_t* record)
+{
+	uint8_t sum = 0;
+	for(uint8_t i=0; i<5; i++)
+	{
+		sum += record[i];
+	}
+	return (uint8_t)~sum;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,334 @@
+/*
+ * eeprom_checksum.c
+ *
+ * Region checksums streamed from a single read transaction.
+ */
+
+#include "eeprom_checksum.h"
+#include "eeprom_m95.h"
+#include "eeprom_trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+#define CRC32_POLY_REFLECTED		0xedb88320
+#define FNV1A_OFFSET				0x811c9dc5
+#define FNV1A_PRIME					0x01000193
+
+static uint8_t chunkBuf[2][EEPROM_CHECKSUM_CHUNK];
+#if FRAMEWORK_STM32CUBE && defined(HAL_CRC_MODULE_ENABLED)
+static CRC_HandleTypeDef* crcHandle = NULL;
+#endif
+
+//-------------------- Private Function Prototypes --------------------//
+static EepromErrorState checksum_Stream(Eeprom* eeprom, uint32_t dataAddr, uint32_t len, uint8_t algo,
+		uint32_t segmentLen, uint32_t* results);
+static uint32_t checksum_Consume(const uint8_t* pData, uint32_t len, uint8_t algo, uint32_t segmentLen,
+		uint32_t* results, uint32_t* offset, uint32_t state);
+static void checksum_TransferComplete(Eeprom* eeprom, void* arg);
+static uint32_t checksum_Crc32(uint32_t crc, const uint8_t* pData, uint32_t len);
+
+/**
+  * @brief 	Computes the checksum of a region of the eeprom with one continuous read.
+  * @param	eeprom eeprom struct
+  * @param	dataAddr Region start address
+  * @param	len Region length in bytes
+  * @param	algo EepromChecksumAlgo
+  * @param	checksum Returns the checksum
+  * @retval	error state
+  */
+EepromErrorState eeprom_ChecksumRange(Eeprom* eeprom, uint32_t dataAddr, uint32_t len, uint8_t algo, uint32_t* checksum)
+{
+	if(dataAddr > DEVICE_SIZE || len > DEVICE_SIZE - dataAddr)
+	{
+		return EepromStorageError;
+	}
+	if(len == 0)
+	{
+		*checksum = eeprom_ChecksumEnd(algo, eeprom_ChecksumBegin(algo));
+		return EepromOk;
+	}
+	return checksum_Stream(eeprom, dataAddr, len, algo, len, checksum);
+}
+
+/**
+  * @brief 	Updates a table of per-sector checksums over a region with one continuous read,
+  * and flags the sectors whose checksum differs from the table's previous contents.
+  * @param	eeprom eeprom struct
+  * @param	dataAddr Region start address, sector aligned
+  * @param	numSectors Sectors in the region
+  * @param	algo EepromChecksumAlgo
+  * @param	table numSectors checksums, updated in place
+  * @param	changed Bitmap of (numSectors + 7) / 8 bytes set for the sectors that changed, or NULL
+  * @retval	error state. On error, sectors before the failed run are already updated.
+  */
+EepromErrorState eeprom_ChecksumSectors(Eeprom* eeprom, uint32_t dataAddr, uint32_t numSectors, uint8_t algo,
+		uint32_t* table, uint8_t* changed)
+{
+	if((dataAddr % EEPROM_CHECKSUM_SECTOR_SIZE) != 0 || dataAddr > DEVICE_SIZE
+			|| numSectors > (DEVICE_SIZE - dataAddr) / EEPROM_CHECKSUM_SECTOR_SIZE)
+	{
+		return EepromStorageError;
+	}
+	if(numSectors == 0)
+	{
+		return EepromOk;
+	}
+	if(changed == NULL)
+	{
+		return checksum_Stream(eeprom, dataAddr, numSectors * EEPROM_CHECKSUM_SECTOR_SIZE, algo,
+				EEPROM_CHECKSUM_SECTOR_SIZE, table);
+	}
+	// Runs of sectors are checksummed into a small results buffer and compared with the table
+	uint32_t results[EEPROM_CHECKSUM_SECTOR_RUN];
+	for(uint32_t i=0; i<numSectors; i += EEPROM_CHECKSUM_SECTOR_RUN)
+	{
+		uint32_t run = (numSectors - i < EEPROM_CHECKSUM_SECTOR_RUN) ? numSectors - i : EEPROM_CHECKSUM_SECTOR_RUN;
+		EepromErrorState status = checksum_Stream(eeprom, dataAddr + (i * EEPROM_CHECKSUM_SECTOR_SIZE),
+				run * EEPROM_CHECKSUM_SECTOR_SIZE, algo, EEPROM_CHECKSUM_SECTOR_SIZE, results);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		for(uint32_t j=0; j<run; j++)
+		{
+			uint32_t sector = i + j;
+			if((sector % 8) == 0)
+			{
+				changed[sector / 8] = 0;
+			}
+			if(results[j] != table[sector])
+			{
+				changed[sector / 8] |= (uint8_t)(1 << (sector % 8));
+				table[sector] = results[j];
+			}
+		}
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Starts a checksum of data in RAM.
+  * @param	algo EepromChecksumAlgo
+  * @retval	Checksum state for eeprom_ChecksumUpdate
+  */
+uint32_t eeprom_ChecksumBegin(uint8_t algo)
+{
+	if(algo == EepromChecksumFnv1a)
+	{
+		return FNV1A_OFFSET;
+	}
+	return 0xffffffff;
+}
+
+/**
+  * @brief 	Adds data to a checksum.
+  * @param	algo EepromChecksumAlgo
+  * @param	state State from eeprom_ChecksumBegin or a previous update
+  * @param	pData Data
+  * @param	len Bytes
+  * @retval	Checksum state
+  */
+uint32_t eeprom_ChecksumUpdate(uint8_t algo, uint32_t state, const uint8_t* pData, uint32_t len)
+{
+	if(algo == EepromChecksumFnv1a)
+	{
+		for(uint32_t i=0; i<len; i++)
+		{
+			state = (state ^ pData[i]) * FNV1A_PRIME;
+		}
+		return state;
+	}
+#if FRAMEWORK_STM32CUBE && defined(HAL_CRC_MODULE_ENABLED)
+	if(crcHandle != NULL)
+	{
+		// The peripheral is loaded from state, so checksums may be interleaved. With output
+		// inversion the register reads back in the same (reflected) form as the software state
+		__HAL_CRC_INITIALCRCVALUE_CONFIG(crcHandle, __RBIT(state));
+		__HAL_CRC_DR_RESET(crcHandle);
+		return HAL_CRC_Accumulate(crcHandle, (uint32_t*)pData, len);
+	}
+#endif
+	return checksum_Crc32(state, pData, len);
+}
+
+/**
+  * @brief 	Finishes a checksum.
+  * @param	algo EepromChecksumAlgo
+  * @param	state State from eeprom_ChecksumUpdate
+  * @retval	Checksum
+  */
+uint32_t eeprom_ChecksumEnd(uint8_t algo, uint32_t state)
+{
+	if(algo == EepromChecksumFnv1a)
+	{
+		return state;
+	}
+	return ~state;
+}
+
+#if FRAMEWORK_STM32CUBE && defined(HAL_CRC_MODULE_ENABLED)
+/**
+  * @brief 	Uses the CRC peripheral for EepromChecksumCrc32. The handle is reconfigured for
+  * CRC-32 (default polynomial and initial value, byte input, reflected input and output),
+  * and each update reloads its initial value, so it must not be shared with other CRC users.
+  * @param	hcrc CRC handle, or NULL to return to the software CRC
+  * @retval	error state
+  */
+EepromErrorState eeprom_ChecksumUseHardwareCrc(CRC_HandleTypeDef* hcrc)
+{
+	if(hcrc != NULL)
+	{
+		hcrc->Init.DefaultPolynomialUse = DEFAULT_POLYNOMIAL_ENABLE;
+		hcrc->Init.DefaultInitValueUse = DEFAULT_INIT_VALUE_ENABLE;
+		hcrc->Init.InputDataInversionMode = CRC_INPUTDATA_INVERSION_BYTE;
+		hcrc->Init.OutputDataInversionMode = CRC_OUTPUTDATA_INVERSION_ENABLE;
+		hcrc->InputDataFormat = CRC_INPUTDATA_FORMAT_BYTES;
+		if(HAL_CRC_Init(hcrc) != HAL_OK)
+		{
+			return EepromHalError;
+		}
+	}
+	crcHandle = hcrc;
+	return EepromOk;
+}
+#endif
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Reads a region in one transaction, producing one checksum per segmentLen bytes.
+  * Asynchronous transports receive the next chunk while the previous one is hashed.
+  */
+static EepromErrorState checksum_Stream(Eeprom* eeprom, uint32_t dataAddr, uint32_t len, uint8_t algo,
+		uint32_t segmentLen, uint32_t* results)
+{
+	const EepromTransport* transport = eeprom->transport;
+	// The M95P32 fast read (one dummy byte) is specified to a higher clock rate than READ
+#if defined(M95P32)
+	uint8_t header[5];
+	header[0] = FREAD_CMD;
+	header[4] = 0;
+#else
+	uint8_t header[4];
+	header[0] = READ_CMD;
+#endif
+	header[1] = (uint8_t)((dataAddr >> 16) & 0xff);
+	header[2] = (uint8_t)((dataAddr >> 8) & 0xff);
+	header[3] = (uint8_t)(dataAddr & 0xff);
+
+	uint32_t offset = 0;
+	uint32_t state = eeprom_ChecksumBegin(algo);
+	uint32_t remaining = len;
+	EEPROM_TRACE_BEGIN(eeprom);
+	transport->select(eeprom);
+	EepromErrorState status = transport->transmit(eeprom, header, sizeof(header));
+	if(status == EepromOk && (transport->caps & EEPROM_TRANSPORT_CAP_ASYNC))
+	{
+		volatile uint8_t done = FALSE;
+		eeprom->asyncComplete = checksum_TransferComplete;
+		eeprom->asyncArg = (void*)&done;
+		uint8_t current = 0;
+		uint32_t chunkLen = (remaining < EEPROM_CHECKSUM_CHUNK) ? remaining : EEPROM_CHECKSUM_CHUNK;
+		EepromSegment segment = {NULL, chunkBuf[current], chunkLen};
+		status = transport->startAsync(eeprom, &segment);
+		while(status == EepromOk && remaining > 0)
+		{
+			while(!done);
+			done = FALSE;
+			remaining -= chunkLen;
+			uint32_t receivedLen = chunkLen;
+			if(remaining > 0)
+			{
+				chunkLen = (remaining < EEPROM_CHECKSUM_CHUNK) ? remaining : EEPROM_CHECKSUM_CHUNK;
+				segment.rx = chunkBuf[current ^ 1];
+				segment.len = chunkLen;
+				status = transport->startAsync(eeprom, &segment);
+			}
+			state = checksum_Consume(chunkBuf[current], receivedLen, algo, segmentLen, results, &offset, state);
+			current ^= 1;
+		}
+		eeprom->asyncComplete = NULL;
+	}
+	else
+	{
+		while(status == EepromOk && remaining > 0)
+		{
+			uint32_t chunkLen = (remaining < EEPROM_CHECKSUM_CHUNK) ? remaining : EEPROM_CHECKSUM_CHUNK;
+			status = transport->receive(eeprom, chunkBuf[0], chunkLen);
+			if(status == EepromOk)
+			{
+				state = checksum_Consume(chunkBuf[0], chunkLen, algo, segmentLen, results, &offset, state);
+				remaining -= chunkLen;
+			}
+		}
+	}
+	transport->deselect(eeprom);
+	EEPROM_TRACE_END(eeprom, EepromTraceRead, dataAddr, len, status);
+	return status;
+}
+
+/**
+  * @brief 	Hashes a received chunk, finishing a result at each segment boundary.
+  * @retval	Checksum state for the next chunk
+  */
+static uint32_t checksum_Consume(const uint8_t* pData, uint32_t len, uint8_t algo, uint32_t segmentLen,
+		uint32_t* results, uint32_t* offset, uint32_t state)
+{
+	while(len > 0)
+	{
+		uint32_t segmentLeft = segmentLen - (*offset % segmentLen);
+		uint32_t n = (len < segmentLeft) ? len : segmentLeft;
+		state = eeprom_ChecksumUpdate(algo, state, pData, n);
+		*offset += n;
+		pData += n;
+		len -= n;
+		if((*offset % segmentLen) == 0)
+		{
+			results[(*offset / segmentLen) - 1] = eeprom_ChecksumEnd(algo, state);
+			state = eeprom_ChecksumBegin(algo);
+		}
+	}
+	return state;
+}
+
+static void checksum_TransferComplete(Eeprom* eeprom, void* arg)
+{
+	(void)eeprom;
+	*(volatile uint8_t*)arg = TRUE;
+}
+
+/**
+  * @brief 	Table driven CRC-32 (reflected, polynomial 0x04c11db7).
+  */
+static uint32_t checksum_Crc32(uint32_t crc, const uint8_t* pData, uint32_t len)
+{
+	static uint32_t table[256];
+	static uint8_t tableReady = FALSE;
+	if(!tableReady)
+	{
+		for(uint32_t i=0; i<256; i++)
+		{
+			uint32_t value = i;
+			for(uint8_t bit=0; bit<8; bit++)
+			{
+				value = (value & 1) ? (value >> 1) ^ CRC32_POLY_REFLECTED : (value >> 1);
+			}
+			table[i] = value;
+		}
+		tableReady = TRUE;
+	}
+	for(uint32_t i=0; i<len; i++)
+	{
+		crc = table[(crc ^ pData[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
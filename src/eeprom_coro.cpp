@@ -0,0 +1,423 @@
+/*
+ * eeprom_coro.cpp
+ *
+ * C++20 coroutine interface: awaitable read, write, erase and register operations.
+ */
+
+#include "eeprom_coro.hpp"
+#include "eeprom_m95.h"
+#include "eeprom_trace.h"
+
+#if defined(EEPROM_M95) && defined(__cpp_impl_coroutine)
+
+#if defined(M95P32)
+#define CORO_READY_TIMEOUT			BLOCK_ERASE_TIMEOUT
+#else
+#define CORO_READY_TIMEOUT			READY_CHECK_TIMEOUT
+#endif
+
+EepromAsync::EepromAsync(Eeprom* eeprom)
+	: suspensions(0), busyPolls(0), eeprom(eeprom), owned(false), lockHead(nullptr), lockTail(nullptr),
+	granted(nullptr), cyclePending(true), readyWaiter(nullptr), readyStartMs(0), transferWaiter(nullptr),
+	transferDone(false), resumer(nullptr), resumerCtx(nullptr)
+{
+}
+
+/**
+  * @brief 	Reads from the eeprom. Waits for any cycle in progress first.
+  * @param 	pData Destination. Must stay valid until the operation completes.
+  * @param	len Number of bytes to read
+  * @param	dataAddr Address to begin reading from
+  * @retval	error state
+  */
+EepromTask EepromAsync::read(uint8_t* pData, uint32_t len, uint32_t dataAddr)
+{
+	if(len == 0 || dataAddr >= DEVICE_SIZE || len > DEVICE_SIZE - dataAddr)
+	{
+		co_return EepromStorageError;
+	}
+	co_await acquire();
+	EepromErrorState status = co_await waitReady();
+	if(status == EepromOk)
+	{
+		EEPROM_TRACE_BEGIN(eeprom);
+		uint8_t header[4] = {READ_CMD, (uint8_t)((dataAddr >> 16) & 0xff), (uint8_t)((dataAddr >> 8) & 0xff), (uint8_t)(dataAddr & 0xff)};
+		status = co_await transfer(header, 4, nullptr, pData, len);
+		EEPROM_TRACE_END(eeprom, EepromTraceRead, dataAddr, len, status);
+	}
+	release();
+	co_return status;
+}
+
+/**
+  * @brief 	Writes to the eeprom, one page write per page touched, suspending during each
+  * write cycle. The device is released between pages.
+  * @param 	pData Data to write. Must stay valid until the operation completes.
+  * @param	len Number of bytes to write
+  * @param	dataAddr Address to begin writing to
+  * @retval	error state. On the M95P32, EepromStorageError for block protected ranges.
+  */
+EepromTask EepromAsync::write(const uint8_t* pData, uint32_t len, uint32_t dataAddr)
+{
+	if(len == 0 || dataAddr >= DEVICE_SIZE || len > DEVICE_SIZE - dataAddr)
+	{
+		co_return EepromStorageError;
+	}
+	EepromErrorState status = EepromOk;
+	while(status == EepromOk && len > 0)
+	{
+		uint32_t pageLen = PAGE_WIDTH - (dataAddr % PAGE_WIDTH);
+		pageLen = (len < pageLen) ? len : pageLen;
+		co_await acquire();
+		status = co_await waitReady();
+	#if defined(M95P32)
+		if(status == EepromOk)
+		{
+			status = m95p32_CheckWritable(eeprom, dataAddr, pageLen);
+		}
+	#endif
+		if(status == EepromOk)
+		{
+			EEPROM_TRACE_BEGIN(eeprom);
+			status = m95_WriteEnable(eeprom);
+			uint8_t header[4] = {WRITE_CMD, (uint8_t)((dataAddr >> 16) & 0xff), (uint8_t)((dataAddr >> 8) & 0xff), (uint8_t)(dataAddr & 0xff)};
+			if(status == EepromOk)
+			{
+				status = co_await transfer(header, 4, (uint8_t*)pData, nullptr, pageLen);
+			}
+			cyclePending = true;
+			if(status == EepromOk)
+			{
+				status = co_await waitReady();
+			}
+			EEPROM_TRACE_END(eeprom, EepromTraceWrite, dataAddr, pageLen, status);
+		}
+		release();
+		pData += pageLen;
+		dataAddr += pageLen;
+		len -= pageLen;
+	}
+	co_return status;
+}
+
+/**
+  * @brief 	Reads the status register. It may be read during a cycle, so this only waits
+  * for the device lock.
+  * @param	data Returns the register value
+  * @retval	error state
+  */
+EepromTask EepromAsync::readStatusRegister(uint8_t* data)
+{
+	co_await acquire();
+	EepromErrorState status = m95_ReadStatusRegister(eeprom, data);
+	release();
+	co_return status;
+}
+
+#if defined(M95P32)
+/**
+  * @brief 	Erases a page aligned region in the largest aligned units that fit (64 KB
+  * blocks, 4 KB sectors, then pages), suspending during each erase cycle.
+  * @param	dataAddr Region start, page aligned
+  * @param	len Region length, a multiple of the page size
+  * @retval	error state. EepromStorageError while block protection is set.
+  */
+EepromTask EepromAsync::erase(uint32_t dataAddr, uint32_t len)
+{
+	if(len == 0 || (dataAddr % PAGE_WIDTH) != 0 || (len % PAGE_WIDTH) != 0 || dataAddr >= DEVICE_SIZE
+			|| len > DEVICE_SIZE - dataAddr)
+	{
+		co_return EepromStorageError;
+	}
+	EepromErrorState status = EepromOk;
+	while(status == EepromOk && len > 0)
+	{
+		uint32_t size = PAGE_WIDTH;
+		if((dataAddr % BLOCK_SIZE) == 0 && len >= BLOCK_SIZE)
+		{
+			size = BLOCK_SIZE;
+		}
+		else if((dataAddr % SECTOR_SIZE) == 0 && len >= SECTOR_SIZE)
+		{
+			size = SECTOR_SIZE;
+		}
+		co_await acquire();
+		status = co_await waitReady();
+		if(status == EepromOk)
+		{
+			if(size == BLOCK_SIZE)
+			{
+				status = eeprom_EraseBlockStart(eeprom, dataAddr);
+			}
+			else if(size == SECTOR_SIZE)
+			{
+				status = eeprom_EraseSectorStart(eeprom, dataAddr);
+			}
+			else
+			{
+				status = eeprom_ErasePageStart(eeprom, dataAddr);
+			}
+			cyclePending = true;
+			if(status == EepromOk)
+			{
+				status = co_await waitReady();
+			}
+		}
+		release();
+		dataAddr += size;
+		len -= size;
+	}
+	co_return status;
+}
+
+/**
+  * @brief 	Reads the configuration and safety registers (see eeprom_ReadConfigRegisters).
+  * @retval	error state
+  */
+EepromTask EepromAsync::readConfigRegisters(uint8_t* configReg, uint8_t* safetyReg)
+{
+	co_await acquire();
+	EepromErrorState status = co_await waitReady();
+	if(status == EepromOk)
+	{
+		status = eeprom_ReadConfigRegisters(eeprom, configReg, safetyReg);
+	}
+	release();
+	co_return status;
+}
+
+/**
+  * @brief 	Sets the block write protection level (see eeprom_SetBlockProtection),
+  * suspending during the status register write cycle.
+  * @retval	error state
+  */
+EepromTask EepromAsync::setBlockProtection(uint8_t bpLevel, uint8_t protectBottom)
+{
+	if(bpLevel > 7)
+	{
+		co_return EepromStorageError;
+	}
+	co_await acquire();
+	EepromErrorState status = co_await waitReady();
+	if(status == EepromOk)
+	{
+		status = m95p32_LoadShadow(eeprom, EEPROM_SHADOW_STATUS);
+	}
+	if(status == EepromOk)
+	{
+		uint8_t statusReg = eeprom->statusShadow;
+		statusReg &= ~((1 << BP2_BIT) | (1 << BP1_BIT) | (1 << BP0_BIT) | (1 << TB_BIT));
+		statusReg |= (bpLevel << BP0_BIT);
+		if(protectBottom)
+		{
+			statusReg |= (1 << TB_BIT);
+		}
+		if(statusReg != eeprom->statusShadow)
+		{
+			status = m95_WriteEnable(eeprom);
+			uint8_t txPacket[2] = {WRSR_CMD, statusReg};
+			EepromSegment segment = {txPacket, NULL, 2};
+			if(status == EepromOk)
+			{
+				status = m95_Transfer(eeprom, &segment, 1);
+			}
+			cyclePending = true;
+			if(status == EepromOk)
+			{
+				// The status read that ends the wait refreshes the shadow
+				status = co_await waitReady();
+			}
+		}
+	}
+	release();
+	co_return status;
+}
+#endif
+
+/**
+  * @brief 	Resumes the operations whose wait has ended. If one is waiting for the device,
+  * the status register is read once. Call from the executor loop or an idle hook.
+  */
+void EepromAsync::poll()
+{
+	if(granted != nullptr)
+	{
+		Waiter* waiter = granted;
+		granted = nullptr;
+		resume(waiter);
+	}
+	if(transferWaiter != nullptr && transferDone)
+	{
+		Waiter* waiter = transferWaiter;
+		transferWaiter = nullptr;
+		resume(waiter);
+	}
+	if(readyWaiter != nullptr)
+	{
+		uint8_t busy;
+		EepromErrorState status = eeprom_IsBusy(eeprom, &busy);
+		if(status == EepromOk && busy)
+		{
+			busyPolls++;
+			if((eeprom->transport->getTick(eeprom) - readyStartMs) < CORO_READY_TIMEOUT)
+			{
+				return;
+			}
+			status = EepromBusy;
+		}
+		else if(status == EepromOk)
+		{
+			cyclePending = false;
+		}
+		Waiter* waiter = readyWaiter;
+		readyWaiter = nullptr;
+		waiter->result = status;
+		resume(waiter);
+	}
+}
+
+/**
+  * @brief 	Hands resumed coroutines to the executor (e.g. onto its ready queue) instead of
+  * resuming them inside poll.
+  * @param	resumer Called with each coroutine to resume, or nullptr to resume inside poll
+  * @param	ctx Passed to resumer
+  */
+void EepromAsync::setResumer(void (*resumer)(std::coroutine_handle<> handle, void* ctx), void* ctx)
+{
+	this->resumer = resumer;
+	resumerCtx = ctx;
+}
+
+
+//-------------------- Private Functions --------------------//
+bool EepromAsync::Acquire::await_ready() noexcept
+{
+	if(!async->owned)
+	{
+		async->owned = true;
+		return true;
+	}
+	return false;
+}
+
+void EepromAsync::Acquire::await_suspend(std::coroutine_handle<> handle) noexcept
+{
+	this->handle = handle;
+	next = nullptr;
+	if(async->lockTail != nullptr)
+	{
+		async->lockTail->next = this;
+	}
+	else
+	{
+		async->lockHead = this;
+	}
+	async->lockTail = this;
+	async->suspensions++;
+}
+
+bool EepromAsync::Ready::await_ready() noexcept
+{
+	// No cycle has been started since the device was last seen idle
+	result = EepromOk;
+	return !async->cyclePending;
+}
+
+bool EepromAsync::Ready::await_suspend(std::coroutine_handle<> handle) noexcept
+{
+	Eeprom* eeprom = async->eeprom;
+	uint8_t busy;
+	result = eeprom_IsBusy(eeprom, &busy);
+	if(result != EepromOk || !busy)
+	{
+		async->cyclePending = (result != EepromOk);
+		return false;
+	}
+	this->handle = handle;
+	async->readyWaiter = this;
+	async->readyStartMs = eeprom->transport->getTick(eeprom);
+	async->suspensions++;
+	return true;
+}
+
+void EepromAsync::TransferDone::await_suspend(std::coroutine_handle<> handle) noexcept
+{
+	this->handle = handle;
+	async->transferWaiter = this;
+	async->suspensions++;
+}
+
+/**
+  * @brief 	Releases the device lock, handing it to the first waiting operation.
+  */
+void EepromAsync::release()
+{
+	Waiter* waiter = lockHead;
+	if(waiter == nullptr)
+	{
+		owned = false;
+		return;
+	}
+	lockHead = waiter->next;
+	if(lockHead == nullptr)
+	{
+		lockTail = nullptr;
+	}
+	granted = waiter;
+}
+
+void EepromAsync::resume(Waiter* waiter)
+{
+	if(resumer != nullptr)
+	{
+		resumer(waiter->handle, resumerCtx);
+		return;
+	}
+	waiter->handle.resume();
+}
+
+/**
+  * @brief 	Runs one transaction: a header, then len bytes sent from tx or received into rx.
+  * On asynchronous transports the data moves in EEPROM_CORO_TRANSFER_MAX byte transfers,
+  * suspending until each completes. Otherwise the data moves with a blocking call.
+  */
+EepromTask EepromAsync::transfer(uint8_t* header, uint16_t headerLen, uint8_t* tx, uint8_t* rx, uint32_t len)
+{
+	const EepromTransport* transport = eeprom->transport;
+	transport->select(eeprom);
+	EepromErrorState status = transport->transmit(eeprom, header, headerLen);
+	if(status == EepromOk && (transport->caps & EEPROM_TRANSPORT_CAP_ASYNC))
+	{
+		eeprom->asyncComplete = transferComplete;
+		eeprom->asyncArg = this;
+		while(status == EepromOk && len > 0)
+		{
+			uint32_t chunkLen = (len < EEPROM_CORO_TRANSFER_MAX) ? len : EEPROM_CORO_TRANSFER_MAX;
+			EepromSegment segment = {tx, rx, chunkLen};
+			transferDone = false;
+			status = transport->startAsync(eeprom, &segment);
+			if(status == EepromOk)
+			{
+				co_await waitTransfer();
+			}
+			tx = (tx != nullptr) ? tx + chunkLen : nullptr;
+			rx = (rx != nullptr) ? rx + chunkLen : nullptr;
+			len -= chunkLen;
+		}
+		eeprom->asyncComplete = NULL;
+	}
+	else if(status == EepromOk)
+	{
+		status = (rx != nullptr) ? transport->receive(eeprom, rx, len) : transport->transmit(eeprom, tx, len);
+	}
+	transport->deselect(eeprom);
+	co_return status;
+}
+
+void EepromAsync::transferComplete(Eeprom* eeprom, void* arg)
+{
+	(void)eeprom;
+	((EepromAsync*)arg)->transferDone = true;
+}
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * eeprom_image.c
+ *
+ * Streaming image writer with erase-ahead.
+ */
+
+#include "eeprom_image.h"
+#include "eeprom_checksum.h"
+#include "eeprom_m95.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+#if defined(M95P32)
+#define IMAGE_READY_TIMEOUT			BLOCK_ERASE_TIMEOUT
+#else
+#define IMAGE_READY_TIMEOUT			READY_CHECK_TIMEOUT
+#endif
+
+//-------------------- Private Function Prototypes --------------------//
+static EepromErrorState image_WritePage(EepromImageWriter* writer, uint16_t len);
+#if defined(M95P32)
+static EepromErrorState image_EraseAhead(EepromImageWriter* writer, uint8_t wait);
+#endif
+
+/**
+  * @brief 	Starts writing an image. Nothing is erased or written until data arrives (or
+  * eeprom_ImagePoll is called), so opening returns at once.
+  * @param	writer Writer state
+  * @param	eeprom Initialised eeprom struct
+  * @param	start Region start address, page aligned
+  * @param	maxLen Largest image the region holds. On the M95P32 the whole region may be erased.
+  * @retval	error state. EepromStorageError if the region is invalid.
+  */
+EepromErrorState eeprom_ImageOpen(EepromImageWriter* writer, Eeprom* eeprom, uint32_t start, uint32_t maxLen)
+{
+	if((start % PAGE_WIDTH) != 0 || maxLen == 0 || start >= DEVICE_SIZE || maxLen > DEVICE_SIZE - start)
+	{
+		return EepromStorageError;
+	}
+	writer->eeprom = eeprom;
+	writer->start = start;
+	writer->end = start + maxLen + ((PAGE_WIDTH - (maxLen % PAGE_WIDTH)) % PAGE_WIDTH);
+	writer->pageAddr = start;
+	writer->erasedEnd = start;
+	writer->length = 0;
+	writer->crc = eeprom_ChecksumBegin(EepromChecksumCrc32);
+	writer->fill = 0;
+	writer->pagesWritten = 0;
+	writer->erases = 0;
+	writer->waits = 0;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Appends a chunk of the image. Full pages are started as they fill, and the
+  * call returns once the last one has been started.
+  * @param	writer Writer state
+  * @param	pData Chunk data
+  * @param	len Chunk length, any size
+  * @retval	error state. EepromStorageError if the image would exceed maxLen. On a device
+  * error, writer->length counts the bytes taken so far (they are written on the next
+  * append or finish); append the rest of the chunk to continue.
+  */
+EepromErrorState eeprom_ImageAppend(EepromImageWriter* writer, const uint8_t* pData, uint32_t len)
+{
+	if(len > (writer->end - writer->pageAddr) - writer->fill)
+	{
+		return EepromStorageError;
+	}
+	while(len > 0)
+	{
+		uint32_t n = PAGE_WIDTH - writer->fill;
+		n = (len < n) ? len : n;
+		memcpy(&writer->pageBuf[writer->fill], pData, n);
+		writer->crc = eeprom_ChecksumUpdate(EepromChecksumCrc32, writer->crc, pData, n);
+		writer->length += n;
+		writer->fill += n;
+		pData += n;
+		len -= n;
+		if(writer->fill == PAGE_WIDTH)
+		{
+			EepromErrorState status = image_WritePage(writer, PAGE_WIDTH);
+			if(status != EepromOk)
+			{
+				return status;
+			}
+		}
+	}
+	return eeprom_ImagePoll(writer);
+}
+
+/**
+  * @brief 	Starts the next erase ahead of the write head if the device is idle. Called by
+  * eeprom_ImageAppend; the application may also call it while waiting for data.
+  * @param	writer Writer state
+  * @retval	error state
+  */
+EepromErrorState eeprom_ImagePoll(EepromImageWriter* writer)
+{
+#if defined(M95P32)
+	return image_EraseAhead(writer, FALSE);
+#else
+	(void)writer;
+	return EepromOk;
+#endif
+}
+
+/**
+  * @brief 	Writes the last partial page, waits for the device, and verifies the image.
+  * @param	writer Writer state
+  * @param	crc Returns the CRC-32 of the image (as eeprom_ChecksumRange), or NULL
+  * @retval	error state. EepromDeviceError if the image read back does not match.
+  */
+EepromErrorState eeprom_ImageFinish(EepromImageWriter* writer, uint32_t* crc)
+{
+	EepromErrorState status;
+	if(writer->fill > 0)
+	{
+		status = image_WritePage(writer, writer->fill);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	status = m95_PollReady(writer->eeprom, IMAGE_READY_TIMEOUT);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	uint32_t expected = eeprom_ChecksumEnd(EepromChecksumCrc32, writer->crc);
+	uint32_t stored;
+	status = eeprom_ChecksumRange(writer->eeprom, writer->start, writer->length, EepromChecksumCrc32, &stored);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(crc != NULL)
+	{
+		*crc = expected;
+	}
+	return (stored == expected) ? EepromOk : EepromDeviceError;
+}
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Starts writing the page buffer to the page at the write head, waiting for the
+  * previous cycle (and on the M95P32 erasing the page first) if needed.
+  */
+static EepromErrorState image_WritePage(EepromImageWriter* writer, uint16_t len)
+{
+	Eeprom* eeprom = writer->eeprom;
+	EepromErrorState status;
+#if defined(M95P32)
+	if(writer->erasedEnd <= writer->pageAddr)
+	{
+		status = image_EraseAhead(writer, TRUE);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	status = eeprom_ProgramPageStart(eeprom, writer->pageBuf, len, writer->pageAddr);
+#else
+	status = eeprom_WritePageStart(eeprom, writer->pageBuf, len, writer->pageAddr);
+#endif
+	if(status == EepromBusy)
+	{
+		writer->waits++;
+		status = m95_PollReady(eeprom, IMAGE_READY_TIMEOUT);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	#if defined(M95P32)
+		status = eeprom_ProgramPageStart(eeprom, writer->pageBuf, len, writer->pageAddr);
+	#else
+		status = eeprom_WritePageStart(eeprom, writer->pageBuf, len, writer->pageAddr);
+	#endif
+	}
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	writer->pagesWritten++;
+	writer->pageAddr += PAGE_WIDTH;
+	writer->fill = 0;
+	return EepromOk;
+}
+
+#if defined(M95P32)
+/**
+  * @brief 	Erases the next unit after erasedEnd if it is within EEPROM_IMAGE_ERASE_AHEAD of
+  * the write head, using the largest aligned unit that fits in the region.
+  * @param	wait TRUE to wait for the device and the erase, FALSE to return if the device is busy
+  */
+static EepromErrorState image_EraseAhead(EepromImageWriter* writer, uint8_t wait)
+{
+	Eeprom* eeprom = writer->eeprom;
+	uint32_t addr = writer->erasedEnd;
+	if(addr >= writer->end || addr - writer->pageAddr >= EEPROM_IMAGE_ERASE_AHEAD)
+	{
+		return EepromOk;
+	}
+	EepromErrorState status;
+	if(wait)
+	{
+		status = m95_PollReady(eeprom, IMAGE_READY_TIMEOUT);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	uint32_t size;
+	if((addr % BLOCK_SIZE) == 0 && writer->end - addr >= BLOCK_SIZE)
+	{
+		size = BLOCK_SIZE;
+		status = eeprom_EraseBlockStart(eeprom, addr);
+	}
+	else if((addr % SECTOR_SIZE) == 0 && writer->end - addr >= SECTOR_SIZE)
+	{
+		size = SECTOR_SIZE;
+		status = eeprom_EraseSectorStart(eeprom, addr);
+	}
+	else
+	{
+		size = PAGE_WIDTH;
+		status = eeprom_ErasePageStart(eeprom, addr);
+	}
+	if(status == EepromBusy && !wait)
+	{
+		return EepromOk;
+	}
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	writer->erases++;
+	writer->erasedEnd = addr + size;
+	return EepromOk;
+}
+#endif
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,396 @@
+/*
+ * eeprom_log.c
+ *
+ * Append-only circular record log with page-batched writes.
+ */
+
+#include "eeprom_log.h"
+#include "eeprom_m95.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+// Devices without sector erase still lay the log out in sector units
+#ifdef EEPROM_SECTOR_SIZE
+#define LOG_SECTOR_SIZE			EEPROM_SECTOR_SIZE
+#else
+#define LOG_SECTOR_SIZE			4096
+#endif
+
+//-------------------- Private Function Prototypes --------------------//
+static EepromErrorState log_WritePage(EepromLog* log);
+static uint8_t log_PageValid(EepromLog* log, uint32_t page, uint32_t* seq);
+static inline uint32_t log_PageAddr(EepromLog* log, uint32_t page);
+
+/**
+  * @brief 	Initialises a log over a sector aligned region and recovers its head and tail.
+  * An empty region (no valid pages) starts a new log.
+  * @param	log Log state
+  * @param	eeprom Initialised eeprom struct
+  * @param	start Region start address, sector aligned
+  * @param	numSectors Region size in sectors (at least 3)
+  * @param	recordSize Bytes per record (1 to EEPROM_PAGE_SIZE - EEPROM_LOG_PAGE_HEADER_SIZE)
+  * @retval	error state. EepromStorageError if the region or record size is invalid.
+  */
+EepromErrorState eeprom_LogInit(EepromLog* log, Eeprom* eeprom, uint32_t start, uint16_t numSectors, uint16_t recordSize)
+{
+	if((start % LOG_SECTOR_SIZE) != 0 || numSectors < 3 || recordSize == 0
+			|| recordSize > PAGE_WIDTH - EEPROM_LOG_PAGE_HEADER_SIZE
+			|| start >= DEVICE_SIZE || (uint32_t)numSectors * LOG_SECTOR_SIZE > DEVICE_SIZE - start)
+	{
+		return EepromStorageError;
+	}
+	log->eeprom = eeprom;
+	log->start = start;
+	log->numSectors = numSectors;
+	log->recordSize = recordSize;
+	log->recordsPerPage = (PAGE_WIDTH - EEPROM_LOG_PAGE_HEADER_SIZE) / recordSize;
+	log->sectorPages = LOG_SECTOR_SIZE / PAGE_WIDTH;
+	log->numPages = (uint32_t)numSectors * log->sectorPages;
+	log->headPage = 0;
+	log->headSeq = 0;
+	log->tailSeq = 0;
+	log->headErased = FALSE;
+	log->bufCount = 0;
+	log->pagesWritten = 0;
+	log->sectorsErased = 0;
+	log->bootReads = 0;
+
+	/*
+	 * Find any valid page. The first page of the head sector is always written once the
+	 * log is in use, and the unwritten run after the head is shorter than two sectors, so
+	 * one of the first pages of three consecutive sectors is valid unless the log is empty.
+	 */
+	uint32_t probePage = 0;
+	uint32_t probeSeq = 0;
+	uint8_t found = FALSE;
+	for(uint8_t i=0; i<3 && !found; i++)
+	{
+		probePage = (uint32_t)i * log->sectorPages;
+		found = log_PageValid(log, probePage, &probeSeq);
+	}
+	if(!found)
+	{
+	#if defined(M95P32)
+		// A new log. The first sector is erased so the first pages can be programmed
+		EepromErrorState status = eeprom_EraseSector(eeprom, start);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		log->headErased = TRUE;
+	#endif
+		return EepromOk;
+	}
+
+	// Pages written in the current lap after probePage carry probeSeq + their distance
+	uint32_t seq;
+	uint32_t lo = 0;
+	uint32_t hi = log->numPages - 1;
+	while(lo < hi)
+	{
+		uint32_t mid = lo + ((hi - lo + 1) / 2);
+		if(log_PageValid(log, (probePage + mid) % log->numPages, &seq) && seq == probeSeq + mid)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	uint32_t lastPage = (probePage + lo) % log->numPages;
+	uint32_t lastSeq = probeSeq + lo;
+
+	// Walk back from the newest page the same way to find the oldest
+	lo = 0;
+	hi = log->numPages - 1;
+	while(lo < hi)
+	{
+		uint32_t mid = lo + ((hi - lo + 1) / 2);
+		if(log_PageValid(log, (lastPage + log->numPages - mid) % log->numPages, &seq) && seq == lastSeq - mid)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	log->headPage = (lastPage + 1) % log->numPages;
+	log->headSeq = lastSeq + 1;
+	log->tailSeq = lastSeq - lo;
+	// The page after the head may hold a page torn by a reset, so it is rewritten with a
+	// page write rather than programmed
+	log->headErased = FALSE;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Appends a record. The page buffer is written out once it holds a full page.
+  * @param	log Log state
+  * @param	record recordSize bytes
+  * @retval	error state. On a write error the record is kept and the write is retried on the
+  * 		next append or flush.
+  */
+EepromErrorState eeprom_LogAppend(EepromLog* log, const void* record)
+{
+	if(log->bufCount == log->recordsPerPage)
+	{
+		EepromErrorState status = log_WritePage(log);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	memcpy(&log->pageBuf[EEPROM_LOG_PAGE_HEADER_SIZE + (log->bufCount * log->recordSize)], record, log->recordSize);
+	log->bufCount++;
+	if(log->bufCount == log->recordsPerPage)
+	{
+		return log_WritePage(log);
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Writes buffered records out as a partial page. The rest of the page is not
+  * used, so flushing costs capacity and should be kept to events such as shutdown.
+  * @param	log Log state
+  * @retval	error state
+  */
+EepromErrorState eeprom_LogFlush(EepromLog* log)
+{
+	return log_WritePage(log);
+}
+
+/**
+  * @brief 	Erases the whole log, including buffered records.
+  * @param	log Log state
+  * @retval	error state
+  */
+EepromErrorState eeprom_LogFormat(EepromLog* log)
+{
+	EepromErrorState status;
+#if defined(M95P32)
+	for(uint16_t i=0; i<log->numSectors; i++)
+	{
+		status = eeprom_EraseSector(log->eeprom, log->start + ((uint32_t)i * LOG_SECTOR_SIZE));
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+	log->headErased = TRUE;
+#else
+	memset(log->pageBuf, 0xff, PAGE_WIDTH);
+	for(uint32_t i=0; i<log->numPages; i++)
+	{
+		status = eeprom_Write(log->eeprom, log->pageBuf, PAGE_WIDTH, log_PageAddr(log, i));
+		if(status != EepromOk)
+		{
+			return status;
+		}
+	}
+#endif
+	log->headPage = 0;
+	log->headSeq = 0;
+	log->tailSeq = 0;
+	log->bufCount = 0;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Positions a cursor at the oldest record.
+  */
+void eeprom_LogFirst(EepromLog* log, EepromLogCursor* cursor)
+{
+	cursor->seq = log->tailSeq;
+	cursor->index = 0;
+	cursor->count = 0;
+}
+
+/**
+  * @brief 	Reads the record at the cursor and advances it, oldest to newest, including
+  * records still in the page buffer. Records overwritten since the cursor passed them
+  * are skipped.
+  * @param	log Log state
+  * @param	cursor Cursor from eeprom_LogFirst
+  * @param	record recordSize bytes to read into
+  * @retval	error state. EepromStorageError once there are no more records.
+  */
+EepromErrorState eeprom_LogNext(EepromLog* log, EepromLogCursor* cursor, void* record)
+{
+	while(TRUE)
+	{
+		if((int32_t)(cursor->seq - log->tailSeq) < 0)
+		{
+			cursor->seq = log->tailSeq;
+			cursor->index = 0;
+			cursor->count = 0;
+		}
+		if(cursor->seq == log->headSeq)
+		{
+			if(cursor->index >= log->bufCount)
+			{
+				return EepromStorageError;
+			}
+			memcpy(record, &log->pageBuf[EEPROM_LOG_PAGE_HEADER_SIZE + (cursor->index * log->recordSize)], log->recordSize);
+			cursor->index++;
+			return EepromOk;
+		}
+
+		uint32_t page = (log->headPage + log->numPages - (log->headSeq - cursor->seq)) % log->numPages;
+		if(cursor->count == 0)
+		{
+			uint8_t header[EEPROM_LOG_PAGE_HEADER_SIZE];
+			EepromErrorState status = eeprom_Read(log->eeprom, header, EEPROM_LOG_PAGE_HEADER_SIZE, log_PageAddr(log, page));
+			if(status != EepromOk)
+			{
+				return status;
+			}
+			uint32_t seq = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+			uint16_t count = header[4] | (header[5] << 8);
+			if(seq == cursor->seq && count <= log->recordsPerPage)
+			{
+				cursor->count = count;
+			}
+		}
+		if(cursor->index < cursor->count)
+		{
+			uint32_t addr = log_PageAddr(log, page) + EEPROM_LOG_PAGE_HEADER_SIZE + (cursor->index * log->recordSize);
+			cursor->index++;
+			return eeprom_Read(log->eeprom, (uint8_t*)record, log->recordSize, addr);
+		}
+		cursor->seq++;
+		cursor->index = 0;
+		cursor->count = 0;
+	}
+}
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Writes the page buffer to the head page, erasing the sector ahead first when
+  * the head enters a new sector.
+  */
+static EepromErrorState log_WritePage(EepromLog* log)
+{
+	EepromErrorState status;
+	if(log->bufCount == 0)
+	{
+		return EepromOk;
+	}
+#if defined(M95P32)
+	if((log->headPage % log->sectorPages) == 0)
+	{
+		uint32_t nextSector = ((log->headPage / log->sectorPages) + 1) % log->numSectors;
+		status = eeprom_EraseSector(log->eeprom, log->start + (nextSector * LOG_SECTOR_SIZE));
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		log->sectorsErased++;
+		// The oldest page left is the first of the sector after the erased one
+		uint32_t oldestPage = ((nextSector + 1) % log->numSectors) * log->sectorPages;
+		uint32_t oldestSeq = log->headSeq - ((log->headPage + log->numPages - oldestPage) % log->numPages);
+		if((int32_t)(oldestSeq - log->tailSeq) > 0)
+		{
+			log->tailSeq = oldestSeq;
+		}
+	}
+#endif
+	uint8_t* header = log->pageBuf;
+	header[0] = (uint8_t)(log->headSeq & 0xff);
+	header[1] = (uint8_t)((log->headSeq >> 8) & 0xff);
+	header[2] = (uint8_t)((log->headSeq >> 16) & 0xff);
+	header[3] = (uint8_t)((log->headSeq >> 24) & 0xff);
+	header[4] = (uint8_t)(log->bufCount & 0xff);
+	header[5] = (uint8_t)(log->bufCount >> 8);
+	uint32_t payloadLen = (uint32_t)log->bufCount * log->recordSize;
+	uint16_t crc = eeprom_Crc16(header, 6, 0xffff);
+	crc = eeprom_Crc16(&log->pageBuf[EEPROM_LOG_PAGE_HEADER_SIZE], payloadLen, crc);
+	header[6] = (uint8_t)(crc & 0xff);
+	header[7] = (uint8_t)(crc >> 8);
+
+	uint32_t addr = log_PageAddr(log, log->headPage);
+#if defined(M95P32)
+	if(log->headErased)
+	{
+		status = eeprom_ProgramPage(log->eeprom, log->pageBuf, EEPROM_LOG_PAGE_HEADER_SIZE + payloadLen, addr);
+	}
+	else
+	{
+		// Full page so no stale bytes of a torn page survive past the records
+		memset(&log->pageBuf[EEPROM_LOG_PAGE_HEADER_SIZE + payloadLen], 0xff, PAGE_WIDTH - EEPROM_LOG_PAGE_HEADER_SIZE - payloadLen);
+		status = eeprom_Write(log->eeprom, log->pageBuf, PAGE_WIDTH, addr);
+	}
+#else
+	status = eeprom_Write(log->eeprom, log->pageBuf, EEPROM_LOG_PAGE_HEADER_SIZE + payloadLen, addr);
+#endif
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	log->pagesWritten++;
+	log->headPage = (log->headPage + 1) % log->numPages;
+	log->headSeq++;
+#if defined(M95P32)
+	// The rest of the head sector and the sector ahead are erased
+	log->headErased = TRUE;
+#else
+	if(log->headSeq - log->tailSeq > log->numPages)
+	{
+		log->tailSeq = log->headSeq - log->numPages;
+	}
+#endif
+	log->bufCount = 0;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Reads a page and checks its header and CRC. Only used while the page buffer
+  * is empty (at init), as the buffer is used to hold the page.
+  * @retval	TRUE if the page holds a valid log page
+  */
+static uint8_t log_PageValid(EepromLog* log, uint32_t page, uint32_t* seq)
+{
+	uint8_t* header = log->pageBuf;
+	uint32_t addr = log_PageAddr(log, page);
+	log->bootReads++;
+	if(eeprom_Read(log->eeprom, header, EEPROM_LOG_PAGE_HEADER_SIZE, addr) != EepromOk)
+	{
+		return FALSE;
+	}
+	uint16_t count = header[4] | (header[5] << 8);
+	if(count == 0 || count > log->recordsPerPage)
+	{
+		return FALSE;
+	}
+	uint32_t payloadLen = (uint32_t)count * log->recordSize;
+	if(eeprom_Read(log->eeprom, &log->pageBuf[EEPROM_LOG_PAGE_HEADER_SIZE], payloadLen, addr + EEPROM_LOG_PAGE_HEADER_SIZE) != EepromOk)
+	{
+		return FALSE;
+	}
+	uint16_t crc = eeprom_Crc16(header, 6, 0xffff);
+	crc = eeprom_Crc16(&log->pageBuf[EEPROM_LOG_PAGE_HEADER_SIZE], payloadLen, crc);
+	if(crc != (header[6] | (header[7] << 8)))
+	{
+		return FALSE;
+	}
+	*seq = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+	return TRUE;
+}
+
+static inline uint32_t log_PageAddr(EepromLog* log, uint32_t page)
+{
+	return log->start + (page * PAGE_WIDTH);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
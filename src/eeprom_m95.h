@@ -0,0 +1,134 @@
+/*
+ * eeprom_m95.h
+ *
+ * Private device definitions and low level functions shared by the driver modules.
+ */
+
+#ifndef EEPROM_M95_H_
+#define EEPROM_M95_H_
+
+#include "eeprom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRUE	1
+#define FALSE	0
+
+// M95 EEPROM Devices
+#ifdef EEPROM_M95
+#define PAGE_WIDTH 				EEPROM_PAGE_SIZE	// Maximum number of bytes in a page write
+
+#if defined(M95M04)
+#define MAX_WRITE_CYCLES		4000000	// Maximum number of writes allowed per cell
+#define DEVICE_SIZE 			EEPROM_DEVICE_SIZE	// EEPROM storage size in bytes
+#define NUM_EEPROM_PAGES		1000		// Equal to the device size / page size
+
+#define WRITE_CYCLE_TIME		5				// Required time for the device to complete an internal  write operation (mS)
+#define READ_CYCLE_TIME			5				// Required time for the device to complete an internal  read operation (mS)
+#define READY_CHECK_TIMEOUT		15
+
+// Command bytes
+#define WREN_CMD	0b00000110		// Write enable
+#define WRDI_CMD	0b00000100		// Write disable
+#define RDSR_CMD	0b00000101		// Read Status register
+#define WRSR_CMD	0b00000001		// Write Status register
+#define READ_CMD	0b00000011		// Read from Memory array
+#define WRITE_CMD	0b00000010		// Write to Memory array
+#define RDID_CMD	0b10000011		// Read Identification page
+#define WRID_CMD	0b10000010		// Write Identification page
+#define RDLS_CMD	0b10000011		// Reads the Identification page lock status
+#define LID_CMD		0b10000010		// Locks the Identification page in read-only mode
+
+// Status register bit positions
+#define WIP_BIT		0
+#define WEL_BIT 	1
+#define BP0_BIT		2
+#define BP1_BIT		3
+#define SRWD_BIT	4
+#endif
+
+#if defined (M95P32)
+#define MAX_WRITE_CYCLES		5000000		// Maximum number of writes allowed per cell
+#define DEVICE_SIZE 			EEPROM_DEVICE_SIZE	// EEPROM storage size in bytes (32 Mbit = 4 MB)
+#define NUM_EEPROM_PAGES		8192		// Equal to the device size / page size (512 bytes/page)
+#define SECTOR_SIZE				EEPROM_SECTOR_SIZE	// Sector size in bytes (4 Kbytes)
+#define NUM_SECTORS				1024		// Equal to the device size / sector size
+#define BLOCK_SIZE				EEPROM_BLOCK_SIZE	// Block size in bytes (64 Kbytes)
+#define NUM_BLOCKS				64			// Equal to the device size / block size
+
+#define WRITE_CYCLE_TIME		5				// Required time for the device to complete a page write (erase+program) cycle (mS). Datasheet tPW max is 4.5mS
+#define READ_CYCLE_TIME			5				// Required time for the device to complete an internal read operation (mS)
+#define READY_CHECK_TIMEOUT		15			// Page write/program/erase poll timeout (tPW/tPE max 4.5mS)
+#define SECTOR_ERASE_TIMEOUT	15			// Sector erase poll timeout (tSE max 5mS)
+#define BLOCK_ERASE_TIMEOUT		25			// Block erase poll timeout (tBE max 8mS)
+#define CHIP_ERASE_TIMEOUT		75			// Chip erase poll timeout (tCE max 25mS)
+#define WRSR_TIMEOUT			30			// Write status/configuration registers poll timeout (tWSCR max 9mS)
+
+// Command bytes
+#define WREN_CMD	0b00000110		// Write enable
+#define WRDI_CMD	0b00000100		// Write disable
+#define RDSR_CMD	0b00000101		// Read status register
+#define WRSR_CMD	0b00000001		// Write status and configuration registers
+#define READ_CMD	0b00000011		// Read data single output from memory array
+#define FREAD_CMD	0b00001011		// Fast read single output with one dummy byte
+#define FDREAD_CMD	0b00111011		// Fast read dual output with one dummy byte
+#define FQREAD_CMD	0b01101011		// Fast read quad output with one dummy byte
+#define WRITE_CMD	0b00000010		// Page write: self-timed erase + program (PGWR), used for generic byte-alterable writes
+#define PGPR_CMD	0b00001010		// Page program: programs a pre-erased page only (PGPR)
+#define PGER_CMD	0b11011011		// Page erase (512 bytes)
+#define SCER_CMD	0b00100000		// Sector erase (4 Kbytes)
+#define BKER_CMD	0b11011000		// Block erase (64 Kbytes)
+#define CHER_CMD	0b11000111		// Chip erase
+#define RDID_CMD	0b10000011		// Read identification page
+#define FRDID_CMD	0b10001011		// Fast read identification page with one dummy byte
+#define WRID_CMD	0b10000010		// Write identification page
+#define DPD_CMD		0b10111001		// Deep power-down enter
+#define RDPD_CMD	0b10101011		// Deep power-down release
+#define JEDID_CMD	0b10011111		// JEDEC identification
+#define RDCR_CMD	0b00010101		// Read configuration and safety registers
+#define RDVR_CMD	0b10000101		// Read volatile register
+#define WRVR_CMD	0b10000001		// Write volatile register
+#define CLRSF_CMD	0b01010000		// Clear safety register sticky flags
+#define RDSFDP_CMD	0b01011010		// Read SFDP register
+#define RSTEN_CMD	0b01100110		// Enable reset
+#define RESET_CMD	0b10011001		// Software reset
+
+// Status register bit positions
+#define WIP_BIT		0
+#define WEL_BIT		1
+#define BP0_BIT		2
+#define BP1_BIT		3
+#define BP2_BIT		4
+#define TB_BIT		6
+#define SRWD_BIT	7
+#define STATUS_NV_MASK	((1 << SRWD_BIT) | (1 << TB_BIT) | (1 << BP2_BIT) | (1 << BP1_BIT) | (1 << BP0_BIT))
+#endif
+
+//-------------------- Private Function Prototypes --------------------//
+EepromErrorState m95_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments);
+EepromErrorState m95_Read(Eeprom* eeprom, uint8_t *pData, uint32_t dataAddr, uint32_t size);
+EepromErrorState m95_Write(Eeprom* eeprom, uint8_t *data, uint32_t dataAddr, uint32_t size);
+EepromErrorState m95_PollReady(Eeprom* eeprom, uint32_t timeoutMs);
+EepromErrorState m95_WriteEnable(Eeprom* eeprom);
+EepromErrorState m95_WriteDisable(Eeprom* eeprom);
+EepromErrorState m95_ReadStatusRegister(Eeprom* eeprom, uint8_t* data);
+uint16_t eeprom_Crc16(const uint8_t* pData, uint32_t len, uint16_t crc);
+#if defined(M95P32)
+EepromErrorState m95p32_SendCommand(Eeprom* eeprom, uint8_t cmd);
+EepromErrorState m95p32_Erase(Eeprom* eeprom, uint8_t cmd, uint32_t dataAddr, uint8_t hasAddress, uint32_t timeoutMs);
+EepromErrorState m95p32_EraseStart(Eeprom* eeprom, uint8_t cmd, uint32_t dataAddr, uint8_t traceOp, uint32_t size);
+EepromErrorState m95p32_WriteStatusConfigRegisters(Eeprom* eeprom, uint8_t statusReg, uint8_t configReg, uint8_t writeConfig);
+void m95p32_UpdateStatusShadow(Eeprom* eeprom, uint8_t statusReg);
+EepromErrorState m95p32_LoadShadow(Eeprom* eeprom, uint8_t which);
+EepromErrorState m95p32_CheckWritable(Eeprom* eeprom, uint32_t dataAddr, uint32_t len);
+EepromErrorState m95p32_CheckErasable(Eeprom* eeprom);
+#endif
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_M95_H_ */
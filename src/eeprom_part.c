@@ -0,0 +1,286 @@
+/*
+ * eeprom_part.c
+ *
+ * Named region partitioner aligned to the device erase geometry.
+ */
+
+#include "eeprom_part.h"
+#include "eeprom_m95.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+// Devices without sector/block erase still honour the same alignment units
+#ifdef EEPROM_SECTOR_SIZE
+#define PART_SECTOR_SIZE		EEPROM_SECTOR_SIZE
+#define PART_BLOCK_SIZE			EEPROM_BLOCK_SIZE
+#else
+#define PART_SECTOR_SIZE		4096
+#define PART_BLOCK_SIZE			65536
+#endif
+
+//-------------------- Private Function Prototypes --------------------//
+static uint32_t part_AlignUnit(uint8_t align);
+static inline uint32_t part_RoundUp(uint32_t value, uint32_t unit);
+static EepromErrorState part_CheckRange(const EepromRegion* region, uint32_t len, uint32_t offset);
+
+static uint8_t erasedPage[PAGE_WIDTH];
+
+/**
+  * @brief 	Lays out the regions. Unprotected regions are placed from the bottom of the
+  * array in declaration order; protected regions from the start of the protected zone at
+  * the top. The zone is the smallest block protection area that fits them all.
+  * @param	table Partition table to initialise
+  * @param	regions Region array. Must stay valid for the lifetime of the table.
+  * @param	numRegions Number of regions
+  * @retval	error state. EepromStorageError if a region is invalid, names are duplicated,
+  * 		or the regions do not fit.
+  */
+EepromErrorState eeprom_PartitionInit(EepromPartitionTable* table, EepromRegion* regions, uint8_t numRegions)
+{
+	table->regions = regions;
+	table->numRegions = numRegions;
+	table->protectLevel = 0;
+	table->protectApplied = FALSE;
+	table->protectStart = EEPROM_DEVICE_SIZE;
+
+	// Size the protected zone
+	uint32_t protectSize = 0;
+	for(uint8_t i=0; i<numRegions; i++)
+	{
+		uint32_t unit = part_AlignUnit(regions[i].align);
+		if(unit == 0 || regions[i].size == 0 || regions[i].size > EEPROM_DEVICE_SIZE || regions[i].name == NULL)
+		{
+			return EepromStorageError;
+		}
+		for(uint8_t j=0; j<i; j++)
+		{
+			if(strcmp(regions[i].name, regions[j].name) == 0)
+			{
+				return EepromStorageError;
+			}
+		}
+		if(regions[i].flags & EEPROM_REGION_PROTECT)
+		{
+			protectSize = part_RoundUp(protectSize, unit) + part_RoundUp(regions[i].size, unit);
+		}
+	}
+	if(protectSize > 0)
+	{
+#if defined(M95P32)
+		// BP levels 1-6 protect the upper 1/64 to 1/2 of the array, 7 the whole array
+		uint8_t level = 1;
+		while(level < 7 && ((uint32_t)EEPROM_DEVICE_SIZE >> (7 - level)) < protectSize)
+		{
+			level++;
+		}
+		table->protectLevel = level;
+		table->protectStart = (level == 7) ? 0 : (EEPROM_DEVICE_SIZE - ((uint32_t)EEPROM_DEVICE_SIZE >> (7 - level)));
+#else
+		// No block protection: the zone is only used for placement
+		if(protectSize > EEPROM_DEVICE_SIZE)
+		{
+			return EepromStorageError;
+		}
+		table->protectStart = EEPROM_DEVICE_SIZE - part_RoundUp(protectSize, PAGE_WIDTH);
+#endif
+	}
+
+	// Place the regions
+	uint32_t freeAddr = 0;
+	uint32_t protectAddr = table->protectStart;
+	for(uint8_t i=0; i<numRegions; i++)
+	{
+		uint32_t unit = part_AlignUnit(regions[i].align);
+		uint32_t size = part_RoundUp(regions[i].size, unit);
+		uint32_t* addr = (regions[i].flags & EEPROM_REGION_PROTECT) ? &protectAddr : &freeAddr;
+		uint32_t limit = (regions[i].flags & EEPROM_REGION_PROTECT) ? EEPROM_DEVICE_SIZE : table->protectStart;
+		*addr = part_RoundUp(*addr, unit);
+		if(*addr > limit || size > (limit - *addr))
+		{
+			return EepromStorageError;
+		}
+		regions[i].start = *addr;
+		*addr += size;
+	}
+	table->freeStart = freeAddr;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Looks up a region by name.
+  * @retval	Pointer to the region, or NULL if there is none with that name
+  */
+EepromRegion* eeprom_RegionFind(EepromPartitionTable* table, const char* name)
+{
+	for(uint8_t i=0; i<table->numRegions; i++)
+	{
+		if(strcmp(table->regions[i].name, name) == 0)
+		{
+			return &table->regions[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+  * @brief 	Reads from a region.
+  * @param	eeprom eeprom struct
+  * @param	region Region to read from
+  * @param 	pData Pointer for the data to read to
+  * @param	len Number of bytes to be read
+  * @param	offset Offset within the region to begin reading from
+  * @retval	error state. EepromStorageError if the range exceeds the region.
+  */
+EepromErrorState eeprom_RegionRead(Eeprom* eeprom, const EepromRegion* region, uint8_t *pData, uint32_t len, uint32_t offset)
+{
+	EepromErrorState status = part_CheckRange(region, len, offset);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	return eeprom_Read(eeprom, pData, len, region->start + offset);
+}
+
+/**
+  * @brief 	Writes to a region.
+  * @param	eeprom eeprom struct
+  * @param	table Partition table the region belongs to
+  * @param	region Region to write to
+  * @param 	pData Pointer for the data to write
+  * @param	len Number of bytes to be written
+  * @param	offset Offset within the region to begin writing to
+  * @retval	error state. EepromStorageError if the range exceeds the region, or the region
+  * 		is currently write protected.
+  */
+EepromErrorState eeprom_RegionWrite(Eeprom* eeprom, EepromPartitionTable* table, const EepromRegion* region, uint8_t *pData, uint32_t len, uint32_t offset)
+{
+	EepromErrorState status = part_CheckRange(region, len, offset);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(table->protectApplied && region->start >= table->protectStart)
+	{
+		return EepromStorageError;
+	}
+	return eeprom_Write(eeprom, pData, len, region->start + offset);
+}
+
+/**
+  * @brief 	Erases a whole region to 0xff.
+  * On the M95P32 the region is covered with the largest erase instructions that fit
+  * (block, then sector, then page), or a chip erase if it spans the whole array.
+  * While block protection is applied, erase instructions are rejected by the device,
+  * so unprotected regions are erased with page writes instead.
+  * @param	eeprom eeprom struct
+  * @param	table Partition table the region belongs to
+  * @param	region Region to erase
+  * @retval	error state. EepromStorageError if the region is currently write protected.
+  */
+EepromErrorState eeprom_RegionErase(Eeprom* eeprom, EepromPartitionTable* table, const EepromRegion* region)
+{
+	if(table->protectApplied && region->start >= table->protectStart)
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status = EepromOk;
+	uint32_t addr = region->start;
+	uint32_t end = region->start + part_RoundUp(region->size, part_AlignUnit(region->align));
+
+#if defined(M95P32)
+	if(!table->protectApplied)
+	{
+		if(addr == 0 && end == EEPROM_DEVICE_SIZE)
+		{
+			return eeprom_EraseChip(eeprom);
+		}
+		while(addr < end && status == EepromOk)
+		{
+			if((addr % BLOCK_SIZE) == 0 && (end - addr) >= BLOCK_SIZE)
+			{
+				status = eeprom_EraseBlock(eeprom, addr);
+				addr += BLOCK_SIZE;
+			}
+			else if((addr % SECTOR_SIZE) == 0 && (end - addr) >= SECTOR_SIZE)
+			{
+				status = eeprom_EraseSector(eeprom, addr);
+				addr += SECTOR_SIZE;
+			}
+			else
+			{
+				status = eeprom_ErasePage(eeprom, addr);
+				addr += PAGE_WIDTH;
+			}
+		}
+		return status;
+	}
+#endif
+	memset(erasedPage, 0xff, PAGE_WIDTH);
+	while(addr < end && status == EepromOk)
+	{
+		status = eeprom_Write(eeprom, erasedPage, PAGE_WIDTH, addr);
+		addr += PAGE_WIDTH;
+	}
+	return status;
+}
+
+#if defined(M95P32)
+/**
+  * @brief 	Applies or removes block protection for the protected zone.
+  * @param	eeprom eeprom struct
+  * @param	table Partition table
+  * @param	enable TRUE to protect the zone, FALSE to unprotect the array
+  * @retval	error state. EepromStorageError if the table has no protected regions.
+  */
+EepromErrorState eeprom_PartitionProtect(Eeprom* eeprom, EepromPartitionTable* table, uint8_t enable)
+{
+	if(enable && table->protectLevel == 0)
+	{
+		return EepromStorageError;
+	}
+	EepromErrorState status = eeprom_SetBlockProtection(eeprom, enable ? table->protectLevel : 0, FALSE);
+	if(status == EepromOk)
+	{
+		table->protectApplied = enable ? TRUE : FALSE;
+	}
+	return status;
+}
+#endif
+
+
+//-------------------- Private Functions --------------------//
+static uint32_t part_AlignUnit(uint8_t align)
+{
+	switch(align)
+	{
+		case EepromAlignPage: return PAGE_WIDTH;
+		case EepromAlignSector: return PART_SECTOR_SIZE;
+		case EepromAlignBlock: return PART_BLOCK_SIZE;
+		default: return 0;
+	}
+}
+
+static inline uint32_t part_RoundUp(uint32_t value, uint32_t unit)
+{
+	return ((value + unit - 1) / unit) * unit;
+}
+
+static EepromErrorState part_CheckRange(const EepromRegion* region, uint32_t len, uint32_t offset)
+{
+	uint32_t size = part_RoundUp(region->size, part_AlignUnit(region->align));
+	if(len == 0 || offset >= size || len > (size - offset))
+	{
+		return EepromStorageError;
+	}
+	return EepromOk;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
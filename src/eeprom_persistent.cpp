@@ -0,0 +1,219 @@
+/*
+ * eeprom_persistent.cpp
+ *
+ * Typed persistent variables with lazy, page-batched write-back.
+ */
+
+#include "eeprom_persistent.hpp"
+
+#ifdef EEPROM_M95
+
+EepromPersistentBase::EepromPersistentBase(EepromStore& store, uint32_t addr, uint32_t size, void* data)
+	: store(store), addr(addr), size(size), data((uint8_t*)data), dirty(false), next(NULL)
+{
+	// Keep the list in address order so adjacent variables can share a write
+	EepromPersistentBase** link = &store.head;
+	while(*link != NULL && (*link)->addr < addr)
+	{
+		link = &(*link)->next;
+	}
+	next = *link;
+	*link = this;
+}
+
+EepromPersistentBase::~EepromPersistentBase()
+{
+	EepromPersistentBase** link = &store.head;
+	while(*link != NULL && *link != this)
+	{
+		link = &(*link)->next;
+	}
+	if(*link == this)
+	{
+		*link = next;
+	}
+	if(dirty)
+	{
+		store.numDirty--;
+	}
+}
+
+void EepromPersistentBase::markDirty()
+{
+	if(dirty)
+	{
+		return;
+	}
+	dirty = true;
+	if(store.numDirty++ == 0)
+	{
+		const EepromTransport* transport = store.eeprom->transport;
+		store.dirtySinceMs = (transport != NULL) ? transport->getTick(store.eeprom) : 0;
+	}
+}
+
+/**
+  * @brief 	Creates a store. Variables register themselves with it when constructed.
+  * @param	eeprom Eeprom struct (initialised before load/commit)
+  * @param	delayMs Time poll waits after the first change before committing
+  */
+EepromStore::EepromStore(Eeprom* eeprom, uint32_t delayMs)
+	: writes(0), bytesWritten(0), eeprom(eeprom), delayMs(delayMs), dirtySinceMs(0), numDirty(0), head(NULL)
+{
+}
+
+/**
+  * @brief 	Reads every registered variable, one eeprom_Read per run of adjacent
+  * variables in a page. Pending changes are discarded.
+  * @retval	error state
+  */
+EepromErrorState EepromStore::load()
+{
+	EepromErrorState status = forEachRun(false);
+	if(status == EepromOk)
+	{
+		for(EepromPersistentBase* var = head; var != NULL; var = var->next)
+		{
+			var->dirty = false;
+		}
+		numDirty = 0;
+	}
+	return status;
+}
+
+/**
+  * @brief 	Writes the dirty variables, one eeprom_Write per run of adjacent variables in a
+  * page. Clean variables between dirty ones in a run are rewritten with their current value.
+  * @retval	error state. Variables that were not written stay dirty.
+  */
+EepromErrorState EepromStore::commit()
+{
+	if(numDirty == 0)
+	{
+		return EepromOk;
+	}
+	return forEachRun(true);
+}
+
+/**
+  * @brief 	Commits once the oldest uncommitted change is delayMs old. Call periodically.
+  * @retval	error state
+  */
+EepromErrorState EepromStore::poll()
+{
+	if(numDirty == 0 || (eeprom->transport->getTick(eeprom) - dirtySinceMs) < delayMs)
+	{
+		return EepromOk;
+	}
+	return commit();
+}
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Groups variables into runs of adjacent variables within one page and reads or
+  * writes each run. Runs being written start and end on a dirty variable. Variables
+  * larger than a page are transferred on their own.
+  */
+EepromErrorState EepromStore::forEachRun(bool write)
+{
+	EepromErrorState status;
+	EepromPersistentBase* first = NULL;
+	EepromPersistentBase* last = NULL;
+	uint32_t runEnd = 0;
+	for(EepromPersistentBase* var = head; var != NULL; var = var->next)
+	{
+		bool wanted = !write || var->dirty;
+		bool adjacent = (first != NULL) && var->size <= EEPROM_PAGE_SIZE && var->addr == runEnd
+				&& (var->addr / EEPROM_PAGE_SIZE) == (first->addr / EEPROM_PAGE_SIZE);
+		if(!adjacent && first != NULL)
+		{
+			status = transferRun(first, last, write);
+			if(status != EepromOk)
+			{
+				return status;
+			}
+			first = NULL;
+		}
+		if(var->size > EEPROM_PAGE_SIZE)
+		{
+			if(wanted)
+			{
+				status = transferRun(var, var, write);
+				if(status != EepromOk)
+				{
+					return status;
+				}
+			}
+			continue;
+		}
+		if(first == NULL)
+		{
+			if(!wanted)
+			{
+				continue;
+			}
+			first = var;
+		}
+		runEnd = var->addr + var->size;
+		if(wanted)
+		{
+			last = var;
+		}
+	}
+	if(first != NULL)
+	{
+		return transferRun(first, last, write);
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Reads or writes the variables from first to last, which are adjacent and within
+  * one page (or first == last), through the page buffer.
+  */
+EepromErrorState EepromStore::transferRun(EepromPersistentBase* first, EepromPersistentBase* last, bool write)
+{
+	EepromErrorState status;
+	uint32_t len = (last->addr + last->size) - first->addr;
+	EepromPersistentBase* stop = last->next;
+	if(first == last && first->size > EEPROM_PAGE_SIZE)
+	{
+		status = write ? eeprom_Write(eeprom, first->data, len, first->addr) : eeprom_Read(eeprom, first->data, len, first->addr);
+	}
+	else if(write)
+	{
+		for(EepromPersistentBase* var = first; var != stop; var = var->next)
+		{
+			memcpy(&pageBuf[var->addr - first->addr], var->data, var->size);
+		}
+		status = eeprom_Write(eeprom, pageBuf, len, first->addr);
+	}
+	else
+	{
+		status = eeprom_Read(eeprom, pageBuf, len, first->addr);
+		if(status == EepromOk)
+		{
+			for(EepromPersistentBase* var = first; var != stop; var = var->next)
+			{
+				memcpy(var->data, &pageBuf[var->addr - first->addr], var->size);
+			}
+		}
+	}
+	if(status != EepromOk || !write)
+	{
+		return status;
+	}
+	writes++;
+	bytesWritten += len;
+	for(EepromPersistentBase* var = first; var != stop; var = var->next)
+	{
+		if(var->dirty)
+		{
+			var->dirty = false;
+			numDirty--;
+		}
+	}
+	return EepromOk;
+}
+#endif
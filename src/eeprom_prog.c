@@ -0,0 +1,337 @@
+/*
+ * eeprom_prog.c
+ *
+ * Production image programming and verification.
+ */
+
+#include "eeprom_prog.h"
+#include "eeprom_checksum.h"
+#include "eeprom_m95.h"
+#include "eeprom_trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+#define PROG_SECTOR_SIZE			EEPROM_CHECKSUM_SECTOR_SIZE
+#define PROG_NO_MISMATCH			0xffffffff
+
+static uint8_t pageBuf[PAGE_WIDTH];
+static uint8_t verifyBuf[EEPROM_PROG_VERIFY_CHUNK];
+
+//-------------------- Private Function Prototypes --------------------//
+static uint8_t prog_SectorMapped(const EepromProgImage* image, uint32_t sector);
+static EepromErrorState prog_Program(Eeprom* eeprom, const EepromProgImage* image, uint32_t regionLen, uint8_t flags,
+		EepromProgResult* result);
+static EepromErrorState prog_VerifyData(Eeprom* eeprom, const EepromProgImage* image, uint32_t regionLen, EepromProgResult* result);
+static EepromErrorState prog_VerifyChecksums(Eeprom* eeprom, const EepromProgImage* image, uint32_t regionLen, EepromProgResult* result);
+#if defined(M95P32)
+static EepromErrorState prog_Erase(Eeprom* eeprom, uint32_t dataAddr, uint32_t regionLen, uint8_t flags, EepromProgResult* result);
+#endif
+
+/**
+  * @brief 	Builds the sector map, and optionally the sector CRC table, of an image. Runs on
+  * the host when the image is prepared (or on the target if the image is in memory).
+  * @param	data Image data
+  * @param	len Image length in bytes
+  * @param	sectorMap (sectors + 7) / 8 byte bitmap, set for sectors holding any byte other than 0xff
+  * @param	sectorCrc CRC-32 of each whole sector, padded with 0xff past the image end, or NULL
+  */
+void eeprom_ProgBuildMap(const uint8_t* data, uint32_t len, uint8_t* sectorMap, uint32_t* sectorCrc)
+{
+	uint32_t numSectors = (len + PROG_SECTOR_SIZE - 1) / PROG_SECTOR_SIZE;
+	for(uint32_t sector=0; sector<numSectors; sector++)
+	{
+		uint32_t offset = sector * PROG_SECTOR_SIZE;
+		uint32_t sectorLen = (len - offset < PROG_SECTOR_SIZE) ? len - offset : PROG_SECTOR_SIZE;
+		uint8_t used = FALSE;
+		for(uint32_t i=0; i<sectorLen && !used; i++)
+		{
+			used = (data[offset + i] != 0xff);
+		}
+		if((sector % 8) == 0)
+		{
+			sectorMap[sector / 8] = 0;
+		}
+		if(used)
+		{
+			sectorMap[sector / 8] |= (uint8_t)(1 << (sector % 8));
+		}
+		if(sectorCrc != NULL)
+		{
+			uint32_t state = eeprom_ChecksumBegin(EepromChecksumCrc32);
+			state = eeprom_ChecksumUpdate(EepromChecksumCrc32, state, &data[offset], sectorLen);
+			for(uint32_t i=0; i<PAGE_WIDTH; i++)
+			{
+				pageBuf[i] = 0xff;
+			}
+			for(uint32_t pad=PROG_SECTOR_SIZE - sectorLen; pad > 0; )
+			{
+				uint32_t n = (pad < PAGE_WIDTH) ? pad : PAGE_WIDTH;
+				state = eeprom_ChecksumUpdate(EepromChecksumCrc32, state, pageBuf, n);
+				pad -= n;
+			}
+			sectorCrc[sector] = eeprom_ChecksumEnd(EepromChecksumCrc32, state);
+		}
+	}
+}
+
+/**
+  * @brief 	Erases the image region, programs the image, and verifies it.
+  * @param	eeprom eeprom struct
+  * @param	image Image, sector map and CRC table
+  * @param	flags EEPROM_PROG_x flags
+  * @param	result Returns the operation counts and the first mismatch, or NULL
+  * @retval	error state. EepromDeviceError if verification fails, EepromStorageError if the
+  * 		region is invalid (or the CRC table is missing for checksum verification).
+  */
+EepromErrorState eeprom_ProgImage(Eeprom* eeprom, const EepromProgImage* image, uint8_t flags, EepromProgResult* result)
+{
+	EepromProgResult localResult;
+	if(result == NULL)
+	{
+		result = &localResult;
+	}
+	result->erases = 0;
+	result->pagesProgrammed = 0;
+	result->pagesSkipped = 0;
+	result->mismatchAddr = PROG_NO_MISMATCH;
+	if((image->addr % PROG_SECTOR_SIZE) != 0 || image->len == 0 || image->data == NULL || image->addr >= DEVICE_SIZE
+			|| image->len > DEVICE_SIZE - image->addr)
+	{
+		return EepromStorageError;
+	}
+	uint32_t regionLen = ((image->len + PROG_SECTOR_SIZE - 1) / PROG_SECTOR_SIZE) * PROG_SECTOR_SIZE;
+	EepromErrorState status = EepromOk;
+#if defined(M95P32)
+	if(!(flags & EEPROM_PROG_BLANK))
+	{
+		status = prog_Erase(eeprom, image->addr, regionLen, flags, result);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		flags |= EEPROM_PROG_BLANK;
+	}
+#endif
+	status = prog_Program(eeprom, image, regionLen, flags, result);
+	if(status != EepromOk || (flags & EEPROM_PROG_NO_VERIFY))
+	{
+		return status;
+	}
+	return eeprom_ProgVerify(eeprom, image, flags, result);
+}
+
+/**
+  * @brief 	Verifies a programmed image, by reading the region back in one continuous fast
+  * read and comparing it with the image data, or with EEPROM_PROG_VERIFY_CHECKSUM by
+  * comparing per-sector CRC-32s with the image's table.
+  * @param	eeprom eeprom struct
+  * @param	image Image, sector map and CRC table
+  * @param	flags EEPROM_PROG_x flags
+  * @param	result Returns the first mismatching address (or sector start), or NULL
+  * @retval	error state. EepromDeviceError on a mismatch.
+  */
+EepromErrorState eeprom_ProgVerify(Eeprom* eeprom, const EepromProgImage* image, uint8_t flags, EepromProgResult* result)
+{
+	EepromProgResult localResult;
+	if(result == NULL)
+	{
+		result = &localResult;
+	}
+	result->mismatchAddr = PROG_NO_MISMATCH;
+	uint8_t useChecksum = (flags & EEPROM_PROG_VERIFY_CHECKSUM) != 0;
+	if((image->addr % PROG_SECTOR_SIZE) != 0 || image->len == 0 || image->addr >= DEVICE_SIZE
+			|| image->len > DEVICE_SIZE - image->addr || (useChecksum ? image->sectorCrc == NULL : image->data == NULL))
+	{
+		return EepromStorageError;
+	}
+	uint32_t regionLen = ((image->len + PROG_SECTOR_SIZE - 1) / PROG_SECTOR_SIZE) * PROG_SECTOR_SIZE;
+	if(useChecksum)
+	{
+		return prog_VerifyChecksums(eeprom, image, regionLen, result);
+	}
+	return prog_VerifyData(eeprom, image, regionLen, result);
+}
+
+
+//-------------------- Private Functions --------------------//
+static uint8_t prog_SectorMapped(const EepromProgImage* image, uint32_t sector)
+{
+	if(image->sectorMap == NULL)
+	{
+		return TRUE;
+	}
+	return (image->sectorMap[sector / 8] >> (sector % 8)) & 1;
+}
+
+/**
+  * @brief 	Programs the pages of the region. Pages that are all 0xff are skipped when the
+  * region is erased (EEPROM_PROG_BLANK); otherwise they are written to clear old data.
+  */
+static EepromErrorState prog_Program(Eeprom* eeprom, const EepromProgImage* image, uint32_t regionLen, uint8_t flags,
+		EepromProgResult* result)
+{
+	uint8_t blank = (flags & EEPROM_PROG_BLANK) != 0;
+	for(uint32_t offset=0; offset<regionLen; offset += PAGE_WIDTH)
+	{
+		uint32_t sector = offset / PROG_SECTOR_SIZE;
+		if(blank && !prog_SectorMapped(image, sector))
+		{
+			// The whole sector is 0xff: skip to the next one
+			result->pagesSkipped += PROG_SECTOR_SIZE / PAGE_WIDTH;
+			offset = (sector + 1) * PROG_SECTOR_SIZE - PAGE_WIDTH;
+			continue;
+		}
+		uint32_t dataLen = (offset >= image->len) ? 0 : image->len - offset;
+		dataLen = (dataLen < PAGE_WIDTH) ? dataLen : PAGE_WIDTH;
+		const uint8_t* pData = &image->data[offset];
+		uint8_t pageBlank = TRUE;
+		for(uint32_t i=0; i<dataLen && pageBlank; i++)
+		{
+			pageBlank = (pData[i] == 0xff);
+		}
+		if(pageBlank && blank)
+		{
+			result->pagesSkipped++;
+			continue;
+		}
+		EepromErrorState status;
+	#if defined(M95P32)
+		if(blank)
+		{
+			status = eeprom_ProgramPage(eeprom, (uint8_t*)pData, dataLen, image->addr + offset);
+		}
+		else
+	#endif
+		{
+			// A full page write, padded with 0xff past the image end
+			for(uint32_t i=0; i<PAGE_WIDTH; i++)
+			{
+				pageBuf[i] = (i < dataLen) ? pData[i] : 0xff;
+			}
+			status = eeprom_Write(eeprom, pageBuf, PAGE_WIDTH, image->addr + offset);
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		result->pagesProgrammed++;
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Reads the region back in one transaction and compares it with the image,
+  * and with 0xff past the image end.
+  */
+static EepromErrorState prog_VerifyData(Eeprom* eeprom, const EepromProgImage* image, uint32_t regionLen, EepromProgResult* result)
+{
+	const EepromTransport* transport = eeprom->transport;
+	uint32_t dataAddr = image->addr;
+#if defined(M95P32)
+	uint8_t header[5];
+	header[0] = FREAD_CMD;
+	header[4] = 0;
+#else
+	uint8_t header[4];
+	header[0] = READ_CMD;
+#endif
+	header[1] = (uint8_t)((dataAddr >> 16) & 0xff);
+	header[2] = (uint8_t)((dataAddr >> 8) & 0xff);
+	header[3] = (uint8_t)(dataAddr & 0xff);
+
+	EEPROM_TRACE_BEGIN(eeprom);
+	transport->select(eeprom);
+	EepromErrorState status = transport->transmit(eeprom, header, sizeof(header));
+	for(uint32_t offset=0; offset<regionLen && status == EepromOk; offset += EEPROM_PROG_VERIFY_CHUNK)
+	{
+		uint32_t chunkLen = (regionLen - offset < EEPROM_PROG_VERIFY_CHUNK) ? regionLen - offset : EEPROM_PROG_VERIFY_CHUNK;
+		status = transport->receive(eeprom, verifyBuf, chunkLen);
+		for(uint32_t i=0; i<chunkLen && status == EepromOk; i++)
+		{
+			uint8_t expected = (offset + i < image->len) ? image->data[offset + i] : 0xff;
+			if(verifyBuf[i] != expected)
+			{
+				result->mismatchAddr = dataAddr + offset + i;
+				status = EepromDeviceError;
+			}
+		}
+	}
+	transport->deselect(eeprom);
+	EEPROM_TRACE_END(eeprom, EepromTraceRead, dataAddr, regionLen, status);
+	return status;
+}
+
+/**
+  * @brief 	Computes the CRC-32 of each sector of the region, EEPROM_CHECKSUM_SECTOR_RUN
+  * sectors per read transaction, and compares them with the image's table.
+  */
+static EepromErrorState prog_VerifyChecksums(Eeprom* eeprom, const EepromProgImage* image, uint32_t regionLen, EepromProgResult* result)
+{
+	uint32_t crcs[EEPROM_CHECKSUM_SECTOR_RUN];
+	uint32_t numSectors = regionLen / PROG_SECTOR_SIZE;
+	for(uint32_t i=0; i<numSectors; i += EEPROM_CHECKSUM_SECTOR_RUN)
+	{
+		uint32_t run = (numSectors - i < EEPROM_CHECKSUM_SECTOR_RUN) ? numSectors - i : EEPROM_CHECKSUM_SECTOR_RUN;
+		EepromErrorState status = eeprom_ChecksumSectors(eeprom, image->addr + (i * PROG_SECTOR_SIZE), run,
+				EepromChecksumCrc32, crcs, NULL);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		for(uint32_t j=0; j<run; j++)
+		{
+			if(crcs[j] != image->sectorCrc[i + j])
+			{
+				result->mismatchAddr = image->addr + ((i + j) * PROG_SECTOR_SIZE);
+				return EepromDeviceError;
+			}
+		}
+	}
+	return EepromOk;
+}
+
+#if defined(M95P32)
+/**
+  * @brief 	Erases the region with one chip erase (EEPROM_PROG_CHIP_ERASE, or when the
+  * region is the whole device), otherwise with 64 KB block erases and 4 KB sector erases
+  * at unaligned ends.
+  */
+static EepromErrorState prog_Erase(Eeprom* eeprom, uint32_t dataAddr, uint32_t regionLen, uint8_t flags, EepromProgResult* result)
+{
+	if((flags & EEPROM_PROG_CHIP_ERASE) || (dataAddr == 0 && regionLen == DEVICE_SIZE))
+	{
+		result->erases++;
+		return eeprom_EraseChip(eeprom);
+	}
+	uint32_t end = dataAddr + regionLen;
+	while(dataAddr < end)
+	{
+		EepromErrorState status;
+		if((dataAddr % BLOCK_SIZE) == 0 && end - dataAddr >= BLOCK_SIZE)
+		{
+			status = eeprom_EraseBlock(eeprom, dataAddr);
+			dataAddr += BLOCK_SIZE;
+		}
+		else
+		{
+			status = eeprom_EraseSector(eeprom, dataAddr);
+			dataAddr += SECTOR_SIZE;
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		result->erases++;
+	}
+	return EepromOk;
+}
+#endif
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,356 @@
+/*
+ * eeprom_remap.c
+ *
+ * Failed-page retirement and spare remapping.
+ */
+
+#include "eeprom_remap.h"
+#include "eeprom_m95.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+#define REMAP_RECOVER_TIMEOUT		100			// Wait for a failed cycle that outlasted the ready timeout (mS)
+
+//-------------------- Private Function Prototypes --------------------//
+static EepromErrorState remap_WritePage(EepromRemap* remap, uint16_t page, uint16_t offset, uint8_t* pData, uint16_t len);
+static EepromErrorState remap_Retire(EepromRemap* remap, uint16_t logicalPage, uint8_t* pData, uint16_t offset, uint16_t len);
+static EepromErrorState remap_SaveTable(EepromRemap* remap);
+static uint8_t remap_CheckTable(EepromRemap* remap, const uint8_t* table, uint32_t* seq);
+
+static uint8_t remapPage[PAGE_WIDTH];
+static uint8_t remapTable[PAGE_WIDTH];
+
+/**
+  * @brief 	Initialises the remap layer and loads the newest valid persistent table.
+  * @param	remap Remap state
+  * @param	eeprom Initialised eeprom struct
+  * @param	map numPages entries of RAM for the translation table
+  * @param	numPages Number of logical pages (physical pages 0 to numPages-1)
+  * @param	spareStart First physical page of the spare pool. Must be at or above numPages.
+  * @param	numSpares Pages in the spare pool (up to EEPROM_REMAP_MAX_SPARES)
+  * @param	tablePage First of the two pages holding the persistent table, outside both
+  * 		the logical pages and the spare pool
+  * @retval	error state. EepromStorageError if the layout is invalid.
+  */
+EepromErrorState eeprom_RemapInit(EepromRemap* remap, Eeprom* eeprom, uint16_t* map, uint16_t numPages,
+		uint16_t spareStart, uint16_t numSpares, uint16_t tablePage)
+{
+	uint32_t devicePages = DEVICE_SIZE / PAGE_WIDTH;
+	uint32_t spareEnd = (uint32_t)spareStart + numSpares;
+	if(numPages == 0 || numSpares > EEPROM_REMAP_MAX_SPARES || spareStart < numPages
+			|| spareEnd > devicePages || (uint32_t)tablePage + 2 > devicePages
+			|| tablePage < numPages || ((uint32_t)tablePage + 2 > spareStart && tablePage < spareEnd))
+	{
+		return EepromStorageError;
+	}
+	remap->eeprom = eeprom;
+	remap->map = map;
+	remap->numPages = numPages;
+	remap->spareStart = spareStart;
+	remap->numSpares = numSpares;
+	remap->tablePage = tablePage;
+	remap->sparesUsed = 0;
+	remap->tableSlot = 1;
+	remap->tableSeq = 0;
+	remap->retired = 0;
+	for(uint16_t i=0; i<numPages; i++)
+	{
+		map[i] = i;
+	}
+
+	// Pick the newest valid table copy
+	int8_t best = -1;
+	uint32_t bestSeq = 0;
+	for(uint8_t slot=0; slot<2; slot++)
+	{
+		uint32_t seq;
+		EepromErrorState status = eeprom_Read(eeprom, remapTable, PAGE_WIDTH, (uint32_t)(tablePage + slot) * PAGE_WIDTH);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		if(remap_CheckTable(remap, remapTable, &seq) && (best < 0 || (int32_t)(seq - bestSeq) > 0))
+		{
+			best = slot;
+			bestSeq = seq;
+		}
+	}
+	if(best < 0)
+	{
+		return EepromOk;
+	}
+	EepromErrorState status = eeprom_Read(eeprom, remapTable, PAGE_WIDTH, (uint32_t)(tablePage + best) * PAGE_WIDTH);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	uint16_t count = remapTable[8] | (remapTable[9] << 8);
+	for(uint16_t i=0; i<count; i++)
+	{
+		const uint8_t* entry = &remapTable[EEPROM_REMAP_HEADER_SIZE + (i * 4)];
+		map[entry[0] | (entry[1] << 8)] = entry[2] | (entry[3] << 8);
+	}
+	remap->sparesUsed = remapTable[10] | (remapTable[11] << 8);
+	remap->tableSlot = (uint8_t)best;
+	remap->tableSeq = bestSeq;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Reads from the logical address space. Runs of pages that are physically
+  * contiguous are read in one transaction.
+  * @param	remap Remap state
+  * @param 	pData Pointer for the data to read to
+  * @param	len Number of bytes to be read
+  * @param	dataAddr Logical address to begin reading from
+  * @retval	error state
+  */
+EepromErrorState eeprom_RemapRead(EepromRemap* remap, uint8_t *pData, uint32_t len, uint32_t dataAddr)
+{
+	if(dataAddr > (uint32_t)remap->numPages * PAGE_WIDTH || len > ((uint32_t)remap->numPages * PAGE_WIDTH) - dataAddr)
+	{
+		return EepromStorageError;
+	}
+	while(len > 0)
+	{
+		uint32_t page = dataAddr / PAGE_WIDTH;
+		uint32_t runLen = PAGE_WIDTH - (dataAddr % PAGE_WIDTH);
+		while(runLen < len && remap->map[page + 1] == remap->map[page] + 1)
+		{
+			page++;
+			runLen += PAGE_WIDTH;
+		}
+		if(runLen > len)
+		{
+			runLen = len;
+		}
+		EepromErrorState status = eeprom_Read(remap->eeprom, pData, runLen, eeprom_RemapTranslate(remap, dataAddr));
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		pData += runLen;
+		dataAddr += runLen;
+		len -= runLen;
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Writes to the logical address space, retiring any page whose write fails.
+  * @param	remap Remap state
+  * @param 	pData Data to write
+  * @param	len Number of bytes to be written
+  * @param	dataAddr Logical address to begin writing to
+  * @retval	error state. EepromStorageError if a page failed and the spare pool is exhausted.
+  */
+EepromErrorState eeprom_RemapWrite(EepromRemap* remap, uint8_t *pData, uint32_t len, uint32_t dataAddr)
+{
+	if(dataAddr > (uint32_t)remap->numPages * PAGE_WIDTH || len > ((uint32_t)remap->numPages * PAGE_WIDTH) - dataAddr)
+	{
+		return EepromStorageError;
+	}
+	while(len > 0)
+	{
+		uint16_t page = (uint16_t)(dataAddr / PAGE_WIDTH);
+		uint16_t offset = dataAddr % PAGE_WIDTH;
+		uint16_t num = PAGE_WIDTH - offset;
+		if(num > len)
+		{
+			num = (uint16_t)len;
+		}
+		EepromErrorState status = remap_WritePage(remap, remap->map[page], offset, pData, num);
+		if(status == EepromDeviceError)
+		{
+			status = remap_Retire(remap, page, pData, offset, num);
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		pData += num;
+		dataAddr += num;
+		len -= num;
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Retires a logical page to the spare pool, e.g. when the application detects
+  * degradation through its own checks.
+  * @param	remap Remap state
+  * @param	logicalPage Page to move
+  * @retval	error state
+  */
+EepromErrorState eeprom_RemapRetire(EepromRemap* remap, uint16_t logicalPage)
+{
+	if(logicalPage >= remap->numPages)
+	{
+		return EepromStorageError;
+	}
+	return remap_Retire(remap, logicalPage, NULL, 0, 0);
+}
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Writes within one physical page and checks the cycle completed.
+  * @retval	error state. EepromDeviceError if the program/erase cycle failed.
+  */
+static EepromErrorState remap_WritePage(EepromRemap* remap, uint16_t page, uint16_t offset, uint8_t* pData, uint16_t len)
+{
+	Eeprom* eeprom = remap->eeprom;
+	EepromErrorState status = eeprom_Write(eeprom, pData, len, ((uint32_t)page * PAGE_WIDTH) + offset);
+	if(status == EepromBusy)
+	{
+		// The cycle outlasted the ready timeout. Let it finish before the next instruction
+		m95_PollReady(eeprom, REMAP_RECOVER_TIMEOUT);
+		return EepromDeviceError;
+	}
+	if(status != EepromOk)
+	{
+		return status;
+	}
+#if defined(M95P32)
+	uint8_t configReg, safetyReg;
+	status = eeprom_ReadConfigRegisters(eeprom, &configReg, &safetyReg);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(safetyReg & ((1 << EEPROM_SAFETY_PRF_BIT) | (1 << EEPROM_SAFETY_ERF_BIT)))
+	{
+		eeprom_ClearSafetyFlags(eeprom);
+		return EepromDeviceError;
+	}
+#endif
+	return EepromOk;
+}
+
+/**
+  * @brief 	Moves a logical page to the next working spare, merging in the data whose
+  * write failed, and saves the table.
+  */
+static EepromErrorState remap_Retire(EepromRemap* remap, uint16_t logicalPage, uint8_t* pData, uint16_t offset, uint16_t len)
+{
+	// Recover what the failing page still holds
+	EepromErrorState status = eeprom_Read(remap->eeprom, remapPage, PAGE_WIDTH, (uint32_t)remap->map[logicalPage] * PAGE_WIDTH);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	if(pData != NULL)
+	{
+		memcpy(&remapPage[offset], pData, len);
+	}
+	while(remap->sparesUsed < remap->numSpares)
+	{
+		uint16_t spare = remap->spareStart + remap->sparesUsed;
+		remap->sparesUsed++;
+		status = remap_WritePage(remap, spare, 0, remapPage, PAGE_WIDTH);
+		if(status == EepromDeviceError)
+		{
+			// The spare is bad too, it stays allocated and unused
+			continue;
+		}
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		remap->map[logicalPage] = spare;
+		remap->retired++;
+		return remap_SaveTable(remap);
+	}
+	return EepromStorageError;
+}
+
+/**
+  * @brief 	Writes the remapped entries to the table page not holding the current table.
+  */
+static EepromErrorState remap_SaveTable(EepromRemap* remap)
+{
+	uint16_t count = 0;
+	memset(remapTable, 0xff, PAGE_WIDTH);
+	for(uint16_t i=0; i<remap->numPages; i++)
+	{
+		if(remap->map[i] != i)
+		{
+			uint8_t* entry = &remapTable[EEPROM_REMAP_HEADER_SIZE + (count * 4)];
+			entry[0] = (uint8_t)(i & 0xff);
+			entry[1] = (uint8_t)(i >> 8);
+			entry[2] = (uint8_t)(remap->map[i] & 0xff);
+			entry[3] = (uint8_t)(remap->map[i] >> 8);
+			count++;
+		}
+	}
+	uint32_t seq = remap->tableSeq + 1;
+	remapTable[0] = (uint8_t)(EEPROM_REMAP_MAGIC & 0xff);
+	remapTable[1] = (uint8_t)((EEPROM_REMAP_MAGIC >> 8) & 0xff);
+	remapTable[2] = (uint8_t)((EEPROM_REMAP_MAGIC >> 16) & 0xff);
+	remapTable[3] = (uint8_t)((EEPROM_REMAP_MAGIC >> 24) & 0xff);
+	remapTable[4] = (uint8_t)(seq & 0xff);
+	remapTable[5] = (uint8_t)((seq >> 8) & 0xff);
+	remapTable[6] = (uint8_t)((seq >> 16) & 0xff);
+	remapTable[7] = (uint8_t)((seq >> 24) & 0xff);
+	remapTable[8] = (uint8_t)(count & 0xff);
+	remapTable[9] = (uint8_t)(count >> 8);
+	remapTable[10] = (uint8_t)(remap->sparesUsed & 0xff);
+	remapTable[11] = (uint8_t)(remap->sparesUsed >> 8);
+	uint16_t crc = eeprom_Crc16(remapTable, 12, 0xffff);
+	crc = eeprom_Crc16(&remapTable[EEPROM_REMAP_HEADER_SIZE], (uint32_t)count * 4, crc);
+	remapTable[12] = (uint8_t)(crc & 0xff);
+	remapTable[13] = (uint8_t)(crc >> 8);
+
+	uint8_t slot = remap->tableSlot ^ 1;
+	EepromErrorState status = remap_WritePage(remap, remap->tablePage + slot, 0, remapTable, PAGE_WIDTH);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	remap->tableSlot = slot;
+	remap->tableSeq = seq;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Validates a table copy against the current layout.
+  * @retval	TRUE if the table is usable
+  */
+static uint8_t remap_CheckTable(EepromRemap* remap, const uint8_t* table, uint32_t* seq)
+{
+	uint32_t magic = table[0] | (table[1] << 8) | (table[2] << 16) | ((uint32_t)table[3] << 24);
+	uint16_t count = table[8] | (table[9] << 8);
+	uint16_t sparesUsed = table[10] | (table[11] << 8);
+	if(magic != EEPROM_REMAP_MAGIC || count > remap->numSpares || sparesUsed > remap->numSpares)
+	{
+		return FALSE;
+	}
+	uint16_t crc = eeprom_Crc16(table, 12, 0xffff);
+	crc = eeprom_Crc16(&table[EEPROM_REMAP_HEADER_SIZE], (uint32_t)count * 4, crc);
+	if(crc != (table[12] | (table[13] << 8)))
+	{
+		return FALSE;
+	}
+	for(uint16_t i=0; i<count; i++)
+	{
+		const uint8_t* entry = &table[EEPROM_REMAP_HEADER_SIZE + (i * 4)];
+		uint16_t logical = entry[0] | (entry[1] << 8);
+		uint16_t physical = entry[2] | (entry[3] << 8);
+		if(logical >= remap->numPages || physical < remap->spareStart || physical >= remap->spareStart + remap->numSpares)
+		{
+			return FALSE;
+		}
+	}
+	*seq = table[4] | (table[5] << 8) | (table[6] << 16) | ((uint32_t)table[7] << 24);
+	return TRUE;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
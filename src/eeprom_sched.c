@@ -0,0 +1,346 @@
+/*
+ * eeprom_sched.c
+ *
+ * Latency-aware I/O scheduler with priority classes.
+ */
+
+#include "eeprom_sched.h"
+#include "eeprom_m95.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+//-------------------- Private Function Prototypes --------------------//
+static EepromErrorState sched_StartUnit(EepromScheduler* sched, EepromRequest* req, uint32_t now);
+static void sched_Finish(EepromScheduler* sched, EepromRequest* req, EepromErrorState result);
+static uint8_t sched_Pending(EepromScheduler* sched);
+static uint8_t sched_MayPass(EepromScheduler* sched, EepromRequest* req, EepromRequest* queued);
+
+#if !defined(M95P32)
+static uint8_t erasedPage[PAGE_WIDTH];
+#endif
+
+/**
+  * @brief 	Initialises a scheduler for one device.
+  * @param	sched Scheduler state
+  * @param	eeprom Initialised eeprom struct. While the scheduler has work queued, the
+  * 		application must not access the device directly.
+  */
+void eeprom_SchedInit(EepromScheduler* sched, Eeprom* eeprom)
+{
+	memset(sched, 0, sizeof(EepromScheduler));
+	sched->eeprom = eeprom;
+#if !defined(M95P32)
+	memset(erasedPage, 0xff, PAGE_WIDTH);
+#endif
+}
+
+/**
+  * @brief 	Queues a request in its priority class, behind requests with an earlier deadline.
+  * A request without a deadline goes to the back of its class.
+  * @param	sched Scheduler state
+  * @param	req Request. Must stay valid until req->pending clears.
+  * @retval	error state. EepromBusy if req is already queued, EepromStorageError if it is invalid.
+  */
+EepromErrorState eeprom_SchedSubmit(EepromScheduler* sched, EepromRequest* req)
+{
+	if(req->pending)
+	{
+		return EepromBusy;
+	}
+	if(req->op > EepromReqErase || req->priority >= EEPROM_SCHED_NUM_PRIORITIES
+			|| req->len == 0 || req->addr >= DEVICE_SIZE || req->len > DEVICE_SIZE - req->addr)
+	{
+		return EepromStorageError;
+	}
+	if(req->op == EepromReqErase && ((req->addr % PAGE_WIDTH) != 0 || (req->len % PAGE_WIDTH) != 0))
+	{
+		return EepromStorageError;
+	}
+	if(req->op != EepromReqErase && req->pData == NULL)
+	{
+		return EepromStorageError;
+	}
+	req->submitMs = sched->eeprom->transport->getTick(sched->eeprom);
+	req->doneLen = 0;
+	req->missed = FALSE;
+	req->latencyMs = 0;
+	req->result = EepromBusy;
+	req->next = NULL;
+	req->pending = TRUE;
+
+	// Earliest deadline first, behind any request it must not pass
+	EepromRequest* prev = sched->tail[req->priority];
+	if(req->deadlineMs != 0)
+	{
+		prev = NULL;
+		for(EepromRequest* queued = sched->head[req->priority]; queued != NULL; queued = queued->next)
+		{
+			if(!sched_MayPass(sched, req, queued))
+			{
+				prev = queued;
+			}
+		}
+	}
+	if(prev == NULL)
+	{
+		req->next = sched->head[req->priority];
+		sched->head[req->priority] = req;
+	}
+	else
+	{
+		req->next = prev->next;
+		prev->next = req;
+	}
+	if(req->next == NULL)
+	{
+		sched->tail[req->priority] = req;
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Advances the scheduler by at most one unit: completes the program/erase unit
+  * in progress once the device is ready, then starts the next unit of the highest
+  * priority request. Call repeatedly from the main loop or a task.
+  * @param	sched Scheduler state
+  * @retval	EepromBusy while requests remain, EepromOk once idle
+  */
+EepromErrorState eeprom_SchedPoll(EepromScheduler* sched)
+{
+	Eeprom* eeprom = sched->eeprom;
+	uint32_t now = eeprom->transport->getTick(eeprom);
+	EepromErrorState status;
+	uint8_t busy;
+
+	if(sched->active != NULL)
+	{
+		EepromRequest* req = sched->active;
+		status = eeprom_IsBusy(eeprom, &busy);
+		if(status == EepromOk && busy)
+		{
+			if((now - sched->unitStartMs) < sched->unitTimeoutMs)
+			{
+				return EepromBusy;
+			}
+			status = EepromBusy;
+		}
+		sched->active = NULL;
+		if(status != EepromOk)
+		{
+			if(status == EepromBusy)
+			{
+				// The cycle may still complete: wait for it before starting the next unit
+				sched->settling = TRUE;
+				sched->unitStartMs = now;
+				sched->unitTimeoutMs = EEPROM_SCHED_SETTLE_TIMEOUT;
+			}
+			sched_Finish(sched, req, status);
+			return sched_Pending(sched) ? EepromBusy : EepromOk;
+		}
+		req->doneLen += sched->unitLen;
+		if(req->doneLen >= req->len)
+		{
+			sched_Finish(sched, req, EepromOk);
+		}
+	}
+
+	if(sched->settling)
+	{
+		status = eeprom_IsBusy(eeprom, &busy);
+		if(status == EepromOk && busy && (now - sched->unitStartMs) < sched->unitTimeoutMs)
+		{
+			return sched_Pending(sched) ? EepromBusy : EepromOk;
+		}
+		sched->settling = FALSE;
+	}
+
+	// Highest priority class first, in queue order within a class
+	EepromRequest* req = NULL;
+	for(uint8_t i=0; i<EEPROM_SCHED_NUM_PRIORITIES && req == NULL; i++)
+	{
+		req = sched->head[i];
+	}
+	if(req == NULL)
+	{
+		return EepromOk;
+	}
+	if(req->doneLen == 0 && (req->flags & EEPROM_REQ_DROP_LATE)
+			&& req->deadlineMs != 0 && (now - req->submitMs) > req->deadlineMs)
+	{
+		sched->dropped++;
+		sched_Finish(sched, req, EepromBusy);
+	}
+	else
+	{
+		status = sched_StartUnit(sched, req, now);
+		if(status != EepromOk)
+		{
+			sched_Finish(sched, req, status);
+		}
+	}
+	return sched_Pending(sched) ? EepromBusy : EepromOk;
+}
+
+/**
+  * @brief 	Polls until every queued request has completed.
+  * @param	sched Scheduler state
+  * @retval	EepromOk
+  */
+EepromErrorState eeprom_SchedFlush(EepromScheduler* sched)
+{
+	while(eeprom_SchedPoll(sched) == EepromBusy);
+	return EepromOk;
+}
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Executes a read chunk, or starts a program/erase unit without waiting for it.
+  */
+static EepromErrorState sched_StartUnit(EepromScheduler* sched, EepromRequest* req, uint32_t now)
+{
+	Eeprom* eeprom = sched->eeprom;
+	uint32_t addr = req->addr + req->doneLen;
+	uint32_t remaining = req->len - req->doneLen;
+	uint32_t unitLen;
+	EepromErrorState status;
+
+	if(req->op == EepromReqRead)
+	{
+		unitLen = (remaining > EEPROM_SCHED_READ_CHUNK) ? EEPROM_SCHED_READ_CHUNK : remaining;
+		status = eeprom_Read(eeprom, &req->pData[req->doneLen], unitLen, addr);
+		if(status != EepromOk)
+		{
+			return status;
+		}
+		req->doneLen += unitLen;
+		if(req->doneLen >= req->len)
+		{
+			sched_Finish(sched, req, EepromOk);
+		}
+		return EepromOk;
+	}
+
+	sched->unitTimeoutMs = READY_CHECK_TIMEOUT;
+	if(req->op == EepromReqWrite)
+	{
+		unitLen = PAGE_WIDTH - (addr % PAGE_WIDTH);
+		if(unitLen > remaining)
+		{
+			unitLen = remaining;
+		}
+		status = eeprom_WritePageStart(eeprom, &req->pData[req->doneLen], unitLen, addr);
+	}
+	else
+	{
+	#if defined(M95P32)
+		// Sector erases take about as long as a page erase, block erases (8mS) are not used
+		if((addr % SECTOR_SIZE) == 0 && remaining >= SECTOR_SIZE)
+		{
+			unitLen = SECTOR_SIZE;
+			sched->unitTimeoutMs = SECTOR_ERASE_TIMEOUT;
+			status = eeprom_EraseSectorStart(eeprom, addr);
+		}
+		else
+		{
+			unitLen = PAGE_WIDTH;
+			status = eeprom_ErasePageStart(eeprom, addr);
+		}
+	#else
+		unitLen = PAGE_WIDTH;
+		status = eeprom_WritePageStart(eeprom, erasedPage, PAGE_WIDTH, addr);
+	#endif
+	}
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	sched->active = req;
+	sched->unitLen = unitLen;
+	sched->unitStartMs = now;
+	return EepromOk;
+}
+
+/**
+  * @brief 	Removes a request from the head of its queue and reports its completion.
+  */
+static void sched_Finish(EepromScheduler* sched, EepromRequest* req, EepromErrorState result)
+{
+	sched->head[req->priority] = req->next;
+	if(sched->head[req->priority] == NULL)
+	{
+		sched->tail[req->priority] = NULL;
+	}
+	req->next = NULL;
+	req->result = result;
+	req->latencyMs = sched->eeprom->transport->getTick(sched->eeprom) - req->submitMs;
+	if(req->deadlineMs != 0 && req->latencyMs > req->deadlineMs)
+	{
+		req->missed = TRUE;
+		sched->deadlineMisses++;
+	}
+	if(req->latencyMs > sched->maxLatencyMs[req->priority])
+	{
+		sched->maxLatencyMs[req->priority] = req->latencyMs;
+	}
+	sched->completed++;
+	if(result != EepromOk)
+	{
+		sched->failed++;
+	}
+	req->pending = FALSE;
+	if(req->complete != NULL)
+	{
+		req->complete(req);
+	}
+}
+
+/**
+  * @brief 	Checks whether a request with a deadline may be queued ahead of a queued request:
+  * the queued request has not started, has a later deadline or none, and the two do not
+  * touch the same bytes unless both are reads.
+  */
+static uint8_t sched_MayPass(EepromScheduler* sched, EepromRequest* req, EepromRequest* queued)
+{
+	if(queued->doneLen != 0 || queued == sched->active)
+	{
+		return FALSE;
+	}
+	if(queued->deadlineMs != 0
+			&& (int32_t)((queued->submitMs + queued->deadlineMs) - (req->submitMs + req->deadlineMs)) <= 0)
+	{
+		return FALSE;
+	}
+	if((req->op != EepromReqRead || queued->op != EepromReqRead)
+			&& req->addr < queued->addr + queued->len && queued->addr < req->addr + req->len)
+	{
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static uint8_t sched_Pending(EepromScheduler* sched)
+{
+	if(sched->active != NULL)
+	{
+		return TRUE;
+	}
+	for(uint8_t i=0; i<EEPROM_SCHED_NUM_PRIORITIES; i++)
+	{
+		if(sched->head[i] != NULL)
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
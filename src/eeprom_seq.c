@@ -0,0 +1,287 @@
+/*
+ * eeprom_seq.c
+ *
+ * Chained command sequence engine.
+ */
+
+#include "eeprom_seq.h"
+#include "eeprom_m95.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef EEPROM_M95
+
+#ifdef EEPROM_SEQ_DMA
+//-------------------- Private Function Prototypes --------------------//
+static void seq_StartStep(EepromSeq* seq);
+static void seq_StartPoll(EepromSeq* seq);
+static void seq_Finish(EepromSeq* seq, EepromErrorState result);
+static void seq_TransferComplete(Eeprom* eeprom, void* arg);
+#endif
+
+/**
+  * @brief 	Executes a sequence of steps, blocking until the last one completes.
+  * Consecutive steps share one chip select window while EEPROM_SEQ_HOLD_CS is set.
+  * @param	eeprom eeprom struct
+  * @param	steps Step array
+  * @param	numSteps Number of steps
+  * @retval	error state of the first failing step, or EepromOk
+  */
+EepromErrorState eeprom_SeqRun(Eeprom* eeprom, const EepromSeqStep* steps, uint8_t numSteps)
+{
+	EepromSegment segments[EEPROM_SEQ_MAX_SEGMENTS];
+	uint8_t numSegments = 0;
+	EepromErrorState status;
+	for(uint8_t i=0; i<numSteps; i++)
+	{
+		const EepromSeqStep* step = &steps[i];
+		if(step->op == EepromSeqPollReady)
+		{
+			// A held chip select window is closed before polling
+			if(numSegments > 0)
+			{
+				status = m95_Transfer(eeprom, segments, numSegments);
+				numSegments = 0;
+				if(status != EepromOk)
+				{
+					return status;
+				}
+			}
+			status = m95_PollReady(eeprom, step->len);
+			if(status != EepromOk)
+			{
+				return status;
+			}
+			continue;
+		}
+
+		// Steps sharing a chip select window are collected into one transaction
+		if(numSegments == EEPROM_SEQ_MAX_SEGMENTS)
+		{
+			return EepromStorageError;
+		}
+		segments[numSegments].tx = (step->op == EepromSeqRx) ? NULL : step->tx;
+		segments[numSegments].rx = (step->op == EepromSeqTx) ? NULL : step->rx;
+		segments[numSegments].len = step->len;
+		numSegments++;
+		if(!(step->flags & EEPROM_SEQ_HOLD_CS))
+		{
+			status = m95_Transfer(eeprom, segments, numSegments);
+			numSegments = 0;
+			if(status != EepromOk)
+			{
+				return status;
+			}
+		}
+	}
+	if(numSegments > 0)
+	{
+		return m95_Transfer(eeprom, segments, numSegments);
+	}
+	return EepromOk;
+}
+
+/**
+  * @brief 	Builds a page write sequence: wait ready, WREN, command + address header,
+  * payload (sent directly from pData), wait ready.
+  * @param	seq Storage for the sequence. Must stay valid while the sequence runs.
+  * @param 	pData Data to write. Must not cross a page boundary.
+  * @param	len Number of bytes to write (1 to EEPROM_PAGE_SIZE)
+  * @param	dataAddr Address to begin writing to
+  * @param	preErased TRUE to use page program (PGPR) on a pre-erased page. M95P32 only,
+  * 		ignored on other devices.
+  * @retval	Number of steps in seq->steps
+  */
+uint8_t eeprom_SeqBuildPageWrite(EepromSeqPageWrite* seq, uint8_t* pData, uint16_t len, uint32_t dataAddr, uint8_t preErased)
+{
+	seq->wren = WREN_CMD;
+	seq->header[0] = WRITE_CMD;
+#if defined(M95P32)
+	if(preErased)
+	{
+		seq->header[0] = PGPR_CMD;
+	}
+#else
+	(void)preErased;
+#endif
+	seq->header[1] = (uint8_t)((dataAddr >> 16) & 0xff);
+	seq->header[2] = (uint8_t)((dataAddr >> 8) & 0xff);
+	seq->header[3] = (uint8_t)(dataAddr & 0xff);
+
+	seq->steps[0] = (EepromSeqStep){EepromSeqPollReady, 0, READY_CHECK_TIMEOUT, NULL, NULL};
+	seq->steps[1] = (EepromSeqStep){EepromSeqTx, 0, 1, &seq->wren, NULL};
+	seq->steps[2] = (EepromSeqStep){EepromSeqTx, EEPROM_SEQ_HOLD_CS, 4, seq->header, NULL};
+	seq->steps[3] = (EepromSeqStep){EepromSeqTx, 0, len, pData, NULL};
+	seq->steps[4] = (EepromSeqStep){EepromSeqPollReady, 0, READY_CHECK_TIMEOUT, NULL, NULL};
+	return 5;
+}
+
+#ifdef EEPROM_SEQ_DMA
+/**
+  * @brief 	Starts an interrupt driven sequence. Data steps run as asynchronous transport
+  * transfers and each completion starts the next step, so the CPU is only involved once
+  * per step. Ready polling steps issue one RDSR per eeprom_SeqTick.
+  * The eeprom's transport must have EEPROM_TRANSPORT_CAP_ASYNC.
+  * @param	seq Sequence state. Must stay valid until seq->running clears.
+  * @param	eeprom eeprom struct
+  * @param	steps Step array. Must stay valid until seq->running clears.
+  * @param	numSteps Number of steps
+  * @retval	EepromBusy if seq is already running, otherwise EepromOk. The sequence
+  * 		result is reported in seq->result once seq->running clears.
+  */
+EepromErrorState eeprom_SeqStart(EepromSeq* seq, Eeprom* eeprom, const EepromSeqStep* steps, uint8_t numSteps)
+{
+	if(seq->running)
+	{
+		return EepromBusy;
+	}
+	if(!(eeprom->transport->caps & EEPROM_TRANSPORT_CAP_ASYNC))
+	{
+		return EepromHalError;
+	}
+	seq->eeprom = eeprom;
+	seq->steps = steps;
+	seq->numSteps = numSteps;
+	seq->index = 0;
+	seq->transferActive = FALSE;
+	seq->result = EepromBusy;
+	seq->running = TRUE;
+	eeprom->asyncArg = seq;
+	eeprom->asyncComplete = seq_TransferComplete;
+	seq_StartStep(seq);
+	return EepromOk;
+}
+
+/**
+  * @brief 	Advances a running sequence after a step's transfer completes.
+  * Called through eeprom_TransportComplete while the sequence is running.
+  * @param	seq Sequence state
+  */
+void eeprom_SeqCallback(EepromSeq* seq)
+{
+	if(!seq->running || !seq->transferActive)
+	{
+		return;
+	}
+	seq->transferActive = FALSE;
+	Eeprom* eeprom = seq->eeprom;
+	const EepromSeqStep* step = &seq->steps[seq->index];
+
+	if(step->op == EepromSeqPollReady)
+	{
+		eeprom->transport->deselect(eeprom);
+		if((seq->pollRx[1] >> WIP_BIT) & 1)
+		{
+			// Still busy, eeprom_SeqTick polls again
+			return;
+		}
+	}
+	else if(!(step->flags & EEPROM_SEQ_HOLD_CS))
+	{
+		eeprom->transport->deselect(eeprom);
+	}
+	seq->index++;
+	seq_StartStep(seq);
+}
+
+/**
+  * @brief 	Re-polls the status register while a sequence waits on a ready polling step,
+  * and times the step out. Call periodically (e.g. from the 1mS tick).
+  * @param	seq Sequence state
+  */
+void eeprom_SeqTick(EepromSeq* seq)
+{
+	if(!seq->running || seq->transferActive || seq->steps[seq->index].op != EepromSeqPollReady)
+	{
+		return;
+	}
+	if((seq->eeprom->transport->getTick(seq->eeprom) - seq->pollStartMs) >= seq->steps[seq->index].len)
+	{
+		seq_Finish(seq, EepromBusy);
+		return;
+	}
+	seq_StartPoll(seq);
+}
+
+
+//-------------------- Private Functions --------------------//
+/**
+  * @brief 	Starts the current step, or finishes the sequence after the last one.
+  */
+static void seq_StartStep(EepromSeq* seq)
+{
+	if(seq->index >= seq->numSteps)
+	{
+		seq_Finish(seq, EepromOk);
+		return;
+	}
+	Eeprom* eeprom = seq->eeprom;
+	const EepromSeqStep* step = &seq->steps[seq->index];
+	if(step->op == EepromSeqPollReady)
+	{
+		seq->pollStartMs = eeprom->transport->getTick(eeprom);
+		seq_StartPoll(seq);
+		return;
+	}
+
+	EepromSegment segment;
+	segment.tx = (step->op == EepromSeqRx) ? NULL : step->tx;
+	segment.rx = (step->op == EepromSeqTx) ? NULL : step->rx;
+	segment.len = step->len;
+	// Chip select is still asserted if the previous step held it
+	if(seq->index == 0 || !(seq->steps[seq->index - 1].flags & EEPROM_SEQ_HOLD_CS))
+	{
+		eeprom->transport->select(eeprom);
+	}
+	seq->transferActive = TRUE;
+	if(eeprom->transport->startAsync(eeprom, &segment) != EepromOk)
+	{
+		seq->transferActive = FALSE;
+		eeprom->transport->deselect(eeprom);
+		seq_Finish(seq, EepromHalError);
+	}
+}
+
+/**
+  * @brief 	Issues a single status register read for a ready polling step.
+  */
+static void seq_StartPoll(EepromSeq* seq)
+{
+	Eeprom* eeprom = seq->eeprom;
+	seq->pollTx[0] = RDSR_CMD;
+	seq->pollTx[1] = 0;
+	EepromSegment segment = {seq->pollTx, seq->pollRx, 2};
+	eeprom->transport->select(eeprom);
+	seq->transferActive = TRUE;
+	if(eeprom->transport->startAsync(eeprom, &segment) != EepromOk)
+	{
+		seq->transferActive = FALSE;
+		eeprom->transport->deselect(eeprom);
+		seq_Finish(seq, EepromHalError);
+	}
+}
+
+static void seq_Finish(EepromSeq* seq, EepromErrorState result)
+{
+	seq->eeprom->asyncComplete = NULL;
+	seq->result = result;
+	seq->running = FALSE;
+	if(seq->complete != NULL)
+	{
+		seq->complete(seq);
+	}
+}
+
+static void seq_TransferComplete(Eeprom* eeprom, void* arg)
+{
+	(void)eeprom;
+	eeprom_SeqCallback((EepromSeq*)arg);
+}
+#endif
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,668 @@
+/*
+ * eeprom_sim.c
+ *
+ * Simulated M95 device transport for host builds.
+ */
+
+#include "eeprom_sim.h"
+#include "eeprom_m95.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(EEPROM_SIM) && defined(EEPROM_M95)
+
+#if defined(M95P32)
+#define SIM_STATUS_NV_MASK		((1 << BP0_BIT) | (1 << BP1_BIT) | (1 << BP2_BIT) | (1 << TB_BIT) | (1 << SRWD_BIT))
+#else
+#define SIM_STATUS_NV_MASK		((1 << BP0_BIT) | (1 << BP1_BIT) | (1 << SRWD_BIT))
+#endif
+
+#define SIM_DEFAULT_CLOCK_HZ	10000000
+#define SIM_DEFAULT_OVERHEAD_NS	1000
+
+//-------------------- Private Function Prototypes --------------------//
+static void sim_Select(Eeprom* eeprom);
+static void sim_Deselect(Eeprom* eeprom);
+static EepromErrorState sim_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+static EepromErrorState sim_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+static EepromErrorState sim_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len);
+static uint32_t sim_GetTick(Eeprom* eeprom);
+static EepromErrorState sim_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments);
+static EepromErrorState sim_StartAsync(Eeprom* eeprom, const EepromSegment* segment);
+static void sim_Charge(EepromSim* sim, uint32_t bytes);
+static void sim_Begin(EepromSim* sim);
+static void sim_End(EepromSim* sim);
+static void sim_Segment(EepromSim* sim, uint8_t* txData, uint8_t* rxData, uint32_t len);
+static uint8_t sim_Clock(EepromSim* sim, uint8_t in);
+static void sim_Execute(EepromSim* sim);
+static void sim_Cycle(EepromSim* sim, uint64_t ns);
+static uint8_t sim_Fails(EepromSim* sim, uint32_t addr, uint32_t len, uint8_t flagBit, uint64_t ns);
+static void sim_Wear(EepromSim* sim, uint32_t addr, uint32_t len);
+
+const EepromTransport eepromTransportSim =
+{
+	0,
+	NULL,
+	sim_Select,
+	sim_Deselect,
+	sim_Transmit,
+	sim_Receive,
+	sim_TransmitReceive,
+	sim_GetTick,
+	NULL,
+	NULL
+};
+
+const EepromTransport eepromTransportSimBurst =
+{
+	EEPROM_TRANSPORT_CAP_SEGMENTS | EEPROM_TRANSPORT_CAP_ASYNC,
+	NULL,
+	sim_Select,
+	sim_Deselect,
+	sim_Transmit,
+	sim_Receive,
+	sim_TransmitReceive,
+	sim_GetTick,
+	sim_Transfer,
+	sim_StartAsync
+};
+
+/**
+  * @brief 	Initialises a simulated device in its delivered state (array erased,
+  * registers at their defaults) and clears the statistics.
+  * @param	sim Simulator state
+  * @param	mem EEPROM_DEVICE_SIZE bytes of array storage
+  * @param	wear Optional per-page wear counters (EEPROM_SIM_NUM_PAGES entries), or NULL
+  */
+void eeprom_SimInit(EepromSim* sim, uint8_t* mem, uint32_t* wear)
+{
+	memset(sim, 0, sizeof(EepromSim));
+	sim->mem = mem;
+	sim->wear = wear;
+	sim->spiClockHz = SIM_DEFAULT_CLOCK_HZ;
+	sim->callOverheadNs = SIM_DEFAULT_OVERHEAD_NS;
+	sim->rng = 1;
+	memset(mem, 0xff, EEPROM_DEVICE_SIZE);
+	if(wear != NULL)
+	{
+		memset(wear, 0, EEPROM_SIM_NUM_PAGES * sizeof(uint32_t));
+	}
+#if defined(M95P32)
+	sim->configReg = (1 << EEPROM_CONFIG_DRV0_BIT);
+	memset(sim->idPages, 0xff, sizeof(sim->idPages));
+#endif
+}
+
+/**
+  * @brief 	Advances simulated time without bus activity (e.g. application work).
+  */
+void eeprom_SimIdle(EepromSim* sim, uint64_t ns)
+{
+	sim->timeNs += ns;
+}
+
+/**
+  * @brief 	Clock step callback for eeprom_CalibrateSpi with the simulated transport.
+  * Step 0 = kernel clock /256 up to step 7 = /2.
+  */
+EepromErrorState eeprom_SimSetClockStep(Eeprom* eeprom, uint8_t clockStep)
+{
+	if(clockStep >= EEPROM_SIM_CLOCK_STEPS)
+	{
+		return EepromStorageError;
+	}
+	((EepromSim*)eeprom->transportCtx)->spiClockHz = EEPROM_SIM_KERNEL_CLOCK_HZ >> (EEPROM_SIM_CLOCK_STEPS - clockStep);
+	return EepromOk;
+}
+
+
+//-------------------- Private Functions --------------------//
+static void sim_Select(Eeprom* eeprom)
+{
+	EepromSim* sim = (EepromSim*)eeprom->transportCtx;
+	sim_Charge(sim, 0);
+	sim_Begin(sim);
+}
+
+static void sim_Deselect(Eeprom* eeprom)
+{
+	EepromSim* sim = (EepromSim*)eeprom->transportCtx;
+	sim_Charge(sim, 0);
+	sim_End(sim);
+}
+
+static EepromErrorState sim_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	EepromSim* sim = (EepromSim*)eeprom->transportCtx;
+	sim_Charge(sim, len);
+	sim_Segment(sim, pData, NULL, len);
+	return EepromOk;
+}
+
+static EepromErrorState sim_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	EepromSim* sim = (EepromSim*)eeprom->transportCtx;
+	sim_Charge(sim, len);
+	sim_Segment(sim, NULL, pData, len);
+	return EepromOk;
+}
+
+static EepromErrorState sim_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len)
+{
+	EepromSim* sim = (EepromSim*)eeprom->transportCtx;
+	sim_Charge(sim, len);
+	sim_Segment(sim, txData, rxData, len);
+	return EepromOk;
+}
+
+static uint32_t sim_GetTick(Eeprom* eeprom)
+{
+	return (uint32_t)(((EepromSim*)eeprom->transportCtx)->timeNs / 1000000);
+}
+
+/**
+  * @brief 	Runs a whole transaction as one call: a single call overhead for the
+  * chip select window and all of its segments.
+  */
+static EepromErrorState sim_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments)
+{
+	EepromSim* sim = (EepromSim*)eeprom->transportCtx;
+	uint32_t bytes = 0;
+	for(uint8_t i=0; i<numSegments; i++)
+	{
+		bytes += segments[i].len;
+	}
+	sim_Charge(sim, bytes);
+	sim_Begin(sim);
+	for(uint8_t i=0; i<numSegments; i++)
+	{
+		sim_Segment(sim, segments[i].tx, segments[i].rx, segments[i].len);
+	}
+	sim_End(sim);
+	return EepromOk;
+}
+
+/**
+  * @brief 	Asynchronous transfers complete immediately in simulated time.
+  */
+static EepromErrorState sim_StartAsync(Eeprom* eeprom, const EepromSegment* segment)
+{
+	EepromSim* sim = (EepromSim*)eeprom->transportCtx;
+	sim_Charge(sim, segment->len);
+	sim_Segment(sim, segment->tx, segment->rx, segment->len);
+	eeprom_TransportComplete(eeprom);
+	return EepromOk;
+}
+
+static void sim_Charge(EepromSim* sim, uint32_t bytes)
+{
+	sim->calls++;
+	sim->busBytes += bytes;
+	sim->timeNs += sim->callOverheadNs + (((uint64_t)bytes * 8000000000ull) / sim->spiClockHz);
+}
+
+static void sim_Begin(EepromSim* sim)
+{
+	sim->count = 0;
+	sim->ignore = FALSE;
+	memset(sim->pageLoaded, 0, sizeof(sim->pageLoaded));
+}
+
+static void sim_End(EepromSim* sim)
+{
+	if(sim->count > 0 && !sim->ignore)
+	{
+		sim_Execute(sim);
+	}
+	sim->count = 0;
+}
+
+static void sim_Segment(EepromSim* sim, uint8_t* txData, uint8_t* rxData, uint32_t len)
+{
+	uint32_t errorAboveHz = sim->errorAboveHz;
+#if defined(M95P32)
+	if(sim->lowDriveErrorAboveHz != 0 && ((sim->configReg >> EEPROM_CONFIG_DRV0_BIT) & 0x03) == EEPROM_DRIVE_LOW)
+	{
+		errorAboveHz = sim->lowDriveErrorAboveHz;
+	}
+#endif
+	uint8_t corrupt = (errorAboveHz != 0 && sim->spiClockHz > errorAboveHz);
+	for(uint32_t i=0; i<len; i++)
+	{
+		uint8_t out = sim_Clock(sim, (txData != NULL) ? txData[i] : 0xff);
+		if(rxData == NULL)
+		{
+			continue;
+		}
+		if(corrupt)
+		{
+			// Roughly one byte in 16 gets a flipped bit
+			sim->rng = (sim->rng * 1103515245u) + 12345u;
+			if(((sim->rng >> 16) & 0x0f) == 0)
+			{
+				out ^= (uint8_t)(1 << ((sim->rng >> 8) & 7));
+				sim->bitErrors++;
+			}
+		}
+		rxData[i] = out;
+	}
+}
+
+static inline uint8_t sim_Busy(EepromSim* sim)
+{
+	return sim->timeNs < sim->busyUntilNs;
+}
+
+#if defined(M95P32)
+static uint8_t sim_Protected(EepromSim* sim, uint32_t addr)
+{
+	uint8_t level = (sim->statusReg >> BP0_BIT) & 7;
+	if(level == 0)
+	{
+		return FALSE;
+	}
+	if(level == 7)
+	{
+		return TRUE;
+	}
+	uint32_t size = (uint32_t)EEPROM_DEVICE_SIZE >> (7 - level);
+	if((sim->statusReg >> TB_BIT) & 1)
+	{
+		return addr < size;
+	}
+	return addr >= (EEPROM_DEVICE_SIZE - size);
+}
+#endif
+
+/**
+  * @brief 	Clocks one byte through the device.
+  * @retval	Byte output by the device (0xff when it is not driving the bus)
+  */
+static uint8_t sim_Clock(EepromSim* sim, uint8_t in)
+{
+	if(sim->count == 0)
+	{
+		sim->cmd = in;
+		sim->addr = 0;
+		sim->count = 1;
+		// Only the status register can be read during a write cycle
+		sim->ignore = sim_Busy(sim) && in != RDSR_CMD;
+		return 0xff;
+	}
+	uint32_t n = sim->count++;
+	if(sim->ignore)
+	{
+		return 0xff;
+	}
+	uint8_t out = 0xff;
+	uint32_t offset;
+	switch(sim->cmd)
+	{
+		case RDSR_CMD:
+			out = (sim->statusReg & ~(1 << WIP_BIT)) | (sim_Busy(sim) << WIP_BIT);
+			break;
+		case READ_CMD:
+	#if defined(M95P32)
+		case FREAD_CMD:
+	#endif
+			if(n <= 3)
+			{
+				sim->addr = (sim->addr << 8) | in;
+			}
+	#if defined(M95P32)
+			else if(sim->cmd == FREAD_CMD && n == 4)
+			{
+				// Dummy byte
+			}
+	#endif
+			else
+			{
+				out = sim->mem[sim->addr % EEPROM_DEVICE_SIZE];
+				sim->addr = (sim->addr + 1) % EEPROM_DEVICE_SIZE;
+			}
+			break;
+		case WRITE_CMD:
+	#if defined(M95P32)
+		case PGPR_CMD:
+		case WRID_CMD:
+	#endif
+			if(n <= 3)
+			{
+				sim->addr = (sim->addr << 8) | in;
+			}
+			else
+			{
+				// Data wraps within the page
+				offset = sim->addr % EEPROM_PAGE_SIZE;
+				sim->pageBuf[offset] = in;
+				sim->pageLoaded[offset / 8] |= (uint8_t)(1 << (offset % 8));
+				sim->addr = (sim->addr - offset) + ((offset + 1) % EEPROM_PAGE_SIZE);
+			}
+			break;
+		case WRSR_CMD:
+			if(n <= 2)
+			{
+				sim->args[n - 1] = in;
+			}
+			break;
+	#if defined(M95P32)
+		case PGER_CMD:
+		case SCER_CMD:
+		case BKER_CMD:
+			if(n <= 3)
+			{
+				sim->addr = (sim->addr << 8) | in;
+			}
+			break;
+		case RDID_CMD:
+			if(n <= 3)
+			{
+				sim->addr = (sim->addr << 8) | in;
+			}
+			else
+			{
+				out = sim->idPages[sim->addr % sizeof(sim->idPages)];
+				sim->addr = (sim->addr + 1) % sizeof(sim->idPages);
+			}
+			break;
+		case RDCR_CMD:
+			out = (n == 1) ? sim->configReg : sim->safetyReg;
+			break;
+		case RDVR_CMD:
+			out = sim->volatileReg;
+			break;
+		case WRVR_CMD:
+			if(n == 1)
+			{
+				sim->args[0] = in;
+			}
+			break;
+	#endif
+		default:
+			break;
+	}
+	return out;
+}
+
+/**
+  * @brief 	Executes the instruction of the transaction that just ended.
+  */
+static void sim_Execute(EepromSim* sim)
+{
+	uint8_t wel = (sim->statusReg >> WEL_BIT) & 1;
+#if defined(M95P32)
+	// Reset must immediately follow the reset enable instruction
+	uint8_t resetEnabled = sim->resetEnabled;
+	sim->resetEnabled = FALSE;
+#endif
+	uint32_t pageAddr = sim->addr - (sim->addr % EEPROM_PAGE_SIZE);
+
+	switch(sim->cmd)
+	{
+		case WREN_CMD:
+			sim->statusReg |= (1 << WEL_BIT);
+			return;
+		case WRDI_CMD:
+			sim->statusReg &= ~(1 << WEL_BIT);
+			return;
+		case WRITE_CMD:
+	#if defined(M95P32)
+		case PGPR_CMD:
+	#endif
+			if(sim->count <= 4 || pageAddr >= EEPROM_DEVICE_SIZE)
+			{
+				return;
+			}
+			if(!wel)
+			{
+				sim->rejected++;
+				return;
+			}
+	#if defined(M95P32)
+			if(sim_Protected(sim, pageAddr))
+			{
+				sim->safetyReg |= (1 << EEPROM_SAFETY_PAMAF_BIT);
+				sim->statusReg &= ~(1 << WEL_BIT);
+				sim->rejected++;
+				return;
+			}
+	#endif
+		#if defined(M95P32)
+			if(sim_Fails(sim, pageAddr, EEPROM_PAGE_SIZE, EEPROM_SAFETY_PRF_BIT,
+					(sim->cmd == PGPR_CMD) ? EEPROM_SIM_PAGE_PROGRAM_NS : EEPROM_SIM_PAGE_WRITE_NS))
+		#else
+			if(sim_Fails(sim, pageAddr, EEPROM_PAGE_SIZE, 0, EEPROM_SIM_PAGE_WRITE_NS))
+		#endif
+			{
+				return;
+			}
+			for(uint32_t i=0; i<EEPROM_PAGE_SIZE; i++)
+			{
+				if((sim->pageLoaded[i / 8] >> (i % 8)) & 1)
+				{
+				#if defined(M95P32)
+					// Page program can only clear bits
+					if(sim->cmd == PGPR_CMD)
+					{
+						sim->mem[pageAddr + i] &= sim->pageBuf[i];
+						continue;
+					}
+				#endif
+					sim->mem[pageAddr + i] = sim->pageBuf[i];
+				}
+			}
+			sim_Wear(sim, pageAddr, EEPROM_PAGE_SIZE);
+		#if defined(M95P32)
+			if(sim->cmd == PGPR_CMD)
+			{
+				sim->pagePrograms++;
+				sim_Cycle(sim, EEPROM_SIM_PAGE_PROGRAM_NS);
+				return;
+			}
+		#endif
+			sim->pageWrites++;
+			sim_Cycle(sim, EEPROM_SIM_PAGE_WRITE_NS);
+			return;
+		case WRSR_CMD:
+			if(sim->count < 2)
+			{
+				return;
+			}
+			if(!wel)
+			{
+				sim->rejected++;
+				return;
+			}
+			sim->statusReg = (sim->statusReg & ~SIM_STATUS_NV_MASK) | (sim->args[0] & SIM_STATUS_NV_MASK);
+	#if defined(M95P32)
+			if(sim->count >= 3)
+			{
+				// The ID page lock can be set but never cleared
+				sim->configReg = sim->args[1] | (sim->configReg & (1 << EEPROM_CONFIG_LID_BIT));
+			}
+	#endif
+			sim->registerWrites++;
+			sim_Cycle(sim, EEPROM_SIM_WRSR_NS);
+			return;
+	#if defined(M95P32)
+		case PGER_CMD:
+		case SCER_CMD:
+		case BKER_CMD:
+		case CHER_CMD:
+		{
+			uint32_t size = EEPROM_DEVICE_SIZE;
+			uint64_t ns = EEPROM_SIM_CHIP_ERASE_NS;
+			if(sim->cmd == PGER_CMD)
+			{
+				size = EEPROM_PAGE_SIZE;
+				ns = EEPROM_SIM_PAGE_ERASE_NS;
+			}
+			else if(sim->cmd == SCER_CMD)
+			{
+				size = EEPROM_SECTOR_SIZE;
+				ns = EEPROM_SIM_SECTOR_ERASE_NS;
+			}
+			else if(sim->cmd == BKER_CMD)
+			{
+				size = EEPROM_BLOCK_SIZE;
+				ns = EEPROM_SIM_BLOCK_ERASE_NS;
+			}
+			if((sim->cmd == CHER_CMD) ? (sim->count != 1) : (sim->count != 4))
+			{
+				return;
+			}
+			if(!wel)
+			{
+				sim->rejected++;
+				return;
+			}
+			// Erase instructions are only accepted when the array is fully unprotected
+			if(((sim->statusReg >> BP0_BIT) & 7) != 0)
+			{
+				sim->safetyReg |= (1 << EEPROM_SAFETY_PAMAF_BIT);
+				sim->statusReg &= ~(1 << WEL_BIT);
+				sim->rejected++;
+				return;
+			}
+			uint32_t start = (sim->addr % EEPROM_DEVICE_SIZE) & ~(size - 1);
+			if(sim_Fails(sim, start, size, EEPROM_SAFETY_ERF_BIT, ns))
+			{
+				return;
+			}
+			memset(&sim->mem[start], 0xff, size);
+			sim_Wear(sim, start, size);
+			if(sim->cmd == PGER_CMD)
+			{
+				sim->pageErases++;
+			}
+			else if(sim->cmd == SCER_CMD)
+			{
+				sim->sectorErases++;
+			}
+			else if(sim->cmd == BKER_CMD)
+			{
+				sim->blockErases++;
+			}
+			else
+			{
+				sim->chipErases++;
+			}
+			sim_Cycle(sim, ns);
+			return;
+		}
+		case WRID_CMD:
+			if(sim->count <= 4)
+			{
+				return;
+			}
+			if(!wel)
+			{
+				sim->rejected++;
+				return;
+			}
+			if((sim->configReg >> EEPROM_CONFIG_LID_BIT) & 1)
+			{
+				sim->safetyReg |= (1 << EEPROM_SAFETY_PAMAF_BIT);
+				sim->statusReg &= ~(1 << WEL_BIT);
+				sim->rejected++;
+				return;
+			}
+			pageAddr = pageAddr % sizeof(sim->idPages);
+			for(uint32_t i=0; i<EEPROM_ID_PAGE_SIZE; i++)
+			{
+				if((sim->pageLoaded[i / 8] >> (i % 8)) & 1)
+				{
+					sim->idPages[pageAddr + i] = sim->pageBuf[i];
+				}
+			}
+			sim->pageWrites++;
+			sim_Cycle(sim, EEPROM_SIM_PAGE_WRITE_NS);
+			return;
+		case WRVR_CMD:
+			if(sim->count >= 2)
+			{
+				sim->volatileReg = sim->args[0] & (1 << EEPROM_VOLATILE_BUFEN_BIT);
+				sim->statusReg &= ~(1 << WEL_BIT);
+			}
+			return;
+		case CLRSF_CMD:
+			sim->safetyReg = 0;
+			return;
+		case RSTEN_CMD:
+			sim->resetEnabled = TRUE;
+			return;
+		case RESET_CMD:
+			if(resetEnabled)
+			{
+				sim->statusReg &= ~(1 << WEL_BIT);
+				sim->volatileReg = 0;
+			}
+			return;
+	#endif
+		default:
+			return;
+	}
+}
+
+/**
+  * @brief 	Starts a self-timed cycle: WIP is set for its duration and WEL is reset.
+  */
+static void sim_Cycle(EepromSim* sim, uint64_t ns)
+{
+	sim->busyUntilNs = sim->timeNs + ns;
+	sim->statusReg &= ~(1 << WEL_BIT);
+}
+
+/**
+  * @brief 	Fails the cycle if any page in the range is marked in failPages.
+  * @param	flagBit Safety register flag reported in EepromSimFailFlag mode (M95P32)
+  * @param	ns Normal cycle time
+  * @retval	TRUE if the cycle failed and must not change the array
+  */
+static uint8_t sim_Fails(EepromSim* sim, uint32_t addr, uint32_t len, uint8_t flagBit, uint64_t ns)
+{
+	if(sim->failPages == NULL)
+	{
+		return FALSE;
+	}
+	for(uint32_t page = addr / EEPROM_PAGE_SIZE; page < (addr + len) / EEPROM_PAGE_SIZE; page++)
+	{
+		if((sim->failPages[page / 8] >> (page % 8)) & 1)
+		{
+			sim->failedCycles++;
+			if(sim->failMode == EepromSimFailTimeout)
+			{
+				sim_Cycle(sim, EEPROM_SIM_FAIL_BUSY_NS);
+				return TRUE;
+			}
+		#if defined(M95P32)
+			sim->safetyReg |= (1 << flagBit);
+		#else
+			(void)flagBit;
+		#endif
+			sim_Cycle(sim, ns);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static void sim_Wear(EepromSim* sim, uint32_t addr, uint32_t len)
+{
+	if(sim->wear == NULL)
+	{
+		return;
+	}
+	for(uint32_t page = addr / EEPROM_PAGE_SIZE; page < (addr + len) / EEPROM_PAGE_SIZE; page++)
+	{
+		sim->wear[page]++;
+	}
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
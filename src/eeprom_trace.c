@@ -0,0 +1,199 @@
+/*
+ * eeprom_trace.c
+ *
+ * Operation trace ring buffer and binary trace format.
+ */
+
+#include "eeprom_trace.h"
+#include "eeprom_m95.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//-------------------- Private Function Prototypes --------------------//
+static inline void trace_Put32(uint8_t* pData, uint32_t value);
+static inline void trace_Put16(uint8_t* pData, uint16_t value);
+static inline uint32_t trace_Get32(const uint8_t* pData);
+static inline uint16_t trace_Get16(const uint8_t* pData);
+
+/**
+  * @brief 	Initialises a trace ring buffer and enables logging.
+  * Assign it to eeprom->trace to start tracing that device.
+  * @param	trace Trace state
+  * @param	records Record storage
+  * @param	numRecords Number of records in the ring buffer
+  */
+void eeprom_TraceInit(EepromTrace* trace, EepromTraceRecord* records, uint32_t numRecords)
+{
+	trace->records = records;
+	trace->numRecords = numRecords;
+	trace->enabled = TRUE;
+	eeprom_TraceClear(trace);
+}
+
+/**
+  * @brief 	Discards all logged records.
+  */
+void eeprom_TraceClear(EepromTrace* trace)
+{
+	trace->head = 0;
+	trace->count = 0;
+}
+
+/**
+  * @brief 	Serialises the trace, oldest record first, into the binary trace format.
+  * Logging should be paused (trace->enabled cleared) while exporting.
+  * @param	trace Trace state
+  * @param	pData Destination buffer
+  * @param	maxLen Size of pData. The newest records are left out if they do not fit.
+  * @retval	Number of bytes written, 0 if pData cannot hold the header
+  */
+uint32_t eeprom_TraceExport(EepromTrace* trace, uint8_t* pData, uint32_t maxLen)
+{
+	if(maxLen < EEPROM_TRACE_HEADER_SIZE)
+	{
+		return 0;
+	}
+	uint32_t stored = (trace->count < trace->numRecords) ? trace->count : trace->numRecords;
+	uint32_t num = (maxLen - EEPROM_TRACE_HEADER_SIZE) / EEPROM_TRACE_RECORD_SIZE;
+	if(num > stored)
+	{
+		num = stored;
+	}
+
+	trace_Put32(&pData[0], EEPROM_TRACE_MAGIC);
+	trace_Put16(&pData[4], EEPROM_TRACE_VERSION);
+	trace_Put16(&pData[6], EEPROM_TRACE_RECORD_SIZE);
+	trace_Put32(&pData[8], num);
+	trace_Put32(&pData[12], trace->count - stored);
+	if(trace->numRecords == 0)
+	{
+		// A trace without a buffer exports an empty header
+		return EEPROM_TRACE_HEADER_SIZE;
+	}
+	uint32_t oldest = (trace->head + trace->numRecords - stored) % trace->numRecords;
+	uint8_t* pRecord = &pData[EEPROM_TRACE_HEADER_SIZE];
+	for(uint32_t i=0; i<num; i++)
+	{
+		const EepromTraceRecord* record = &trace->records[(oldest + i) % trace->numRecords];
+		trace_Put32(&pRecord[0], record->timestamp);
+		trace_Put32(&pRecord[4], record->addr);
+		trace_Put32(&pRecord[8], record->len);
+		trace_Put16(&pRecord[12], record->duration);
+		pRecord[14] = record->op;
+		pRecord[15] = record->result;
+		pRecord += EEPROM_TRACE_RECORD_SIZE;
+	}
+	return EEPROM_TRACE_HEADER_SIZE + (num * EEPROM_TRACE_RECORD_SIZE);
+}
+
+/**
+  * @brief 	Checks and decodes a serialised trace header.
+  * @param	pData EEPROM_TRACE_HEADER_SIZE bytes of header
+  * @param	numRecords Number of records following the header
+  * @param	lost Records overwritten in the ring buffer before the export
+  * @retval	TRUE if the header is a supported trace header
+  */
+uint8_t eeprom_TraceDecodeHeader(const uint8_t* pData, uint32_t* numRecords, uint32_t* lost)
+{
+	if(trace_Get32(&pData[0]) != EEPROM_TRACE_MAGIC
+			|| trace_Get16(&pData[4]) != EEPROM_TRACE_VERSION
+			|| trace_Get16(&pData[6]) != EEPROM_TRACE_RECORD_SIZE)
+	{
+		return FALSE;
+	}
+	*numRecords = trace_Get32(&pData[8]);
+	*lost = trace_Get32(&pData[12]);
+	return TRUE;
+}
+
+/**
+  * @brief 	Decodes one serialised trace record.
+  * @param	pData EEPROM_TRACE_RECORD_SIZE bytes of record
+  * @param	record Decoded record
+  */
+void eeprom_TraceDecodeRecord(const uint8_t* pData, EepromTraceRecord* record)
+{
+	record->timestamp = trace_Get32(&pData[0]);
+	record->addr = trace_Get32(&pData[4]);
+	record->len = trace_Get32(&pData[8]);
+	record->duration = trace_Get16(&pData[12]);
+	record->op = pData[14];
+	record->result = pData[15];
+}
+
+#ifdef EEPROM_TRACE
+/**
+  * @brief 	Returns the timestamp for the start of a traced call.
+  */
+uint32_t eeprom_TraceTick(Eeprom* eeprom)
+{
+	if(eeprom->trace == NULL || !eeprom->trace->enabled)
+	{
+		return 0;
+	}
+	return eeprom->transport->getTick(eeprom);
+}
+
+/**
+  * @brief 	Logs a completed call to the eeprom's trace, overwriting the oldest record
+  * once the ring buffer is full. Not reentrant: calls must not be traced from an interrupt
+  * that can preempt another traced call on the same trace.
+  * @param	eeprom eeprom struct
+  * @param	op EepromTraceOp
+  * @param	addr Address passed to the call
+  * @param	len Length passed to the call, or the erase size
+  * @param	start Timestamp from eeprom_TraceTick at the start of the call
+  * @param	result Result of the call
+  */
+void eeprom_TraceLog(Eeprom* eeprom, uint8_t op, uint32_t addr, uint32_t len, uint32_t start, EepromErrorState result)
+{
+	EepromTrace* trace = eeprom->trace;
+	if(trace == NULL || !trace->enabled || trace->numRecords == 0)
+	{
+		return;
+	}
+	uint32_t duration = eeprom->transport->getTick(eeprom) - start;
+	EepromTraceRecord* record = &trace->records[trace->head];
+	record->timestamp = start;
+	record->addr = addr;
+	record->len = len;
+	record->duration = (duration > 0xffff) ? 0xffff : (uint16_t)duration;
+	record->op = op;
+	record->result = (uint8_t)result;
+	trace->head = (trace->head + 1) % trace->numRecords;
+	trace->count++;
+}
+#endif
+
+
+//-------------------- Private Functions --------------------//
+static inline void trace_Put32(uint8_t* pData, uint32_t value)
+{
+	pData[0] = (uint8_t)(value & 0xff);
+	pData[1] = (uint8_t)((value >> 8) & 0xff);
+	pData[2] = (uint8_t)((value >> 16) & 0xff);
+	pData[3] = (uint8_t)((value >> 24) & 0xff);
+}
+
+static inline void trace_Put16(uint8_t* pData, uint16_t value)
+{
+	pData[0] = (uint8_t)(value & 0xff);
+	pData[1] = (uint8_t)((value >> 8) & 0xff);
+}
+
+static inline uint32_t trace_Get32(const uint8_t* pData)
+{
+	return (uint32_t)pData[0] | ((uint32_t)pData[1] << 8) | ((uint32_t)pData[2] << 16) | ((uint32_t)pData[3] << 24);
+}
+
+static inline uint16_t trace_Get16(const uint8_t* pData)
+{
+	return (uint16_t)(pData[0] | (pData[1] << 8));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,142 @@
+/*
+ * eeprom_transport_arduino.cpp
+ *
+ * Arduino SPI library transport. Chip select is a digital pin (csPin), the bus is the
+ * SPIClass instance in spi (NULL for the default SPI) at spiClock Hz. A segment list runs
+ * in one transfer call inside a single bus transaction.
+ */
+
+#include "eeprom.h"
+
+#if FRAMEWORK_ARDUINO
+#include <SPI.h>
+#include <string.h>
+
+#ifndef EEPROM_ARDUINO_DEFAULT_CLOCK
+#define EEPROM_ARDUINO_DEFAULT_CLOCK	8000000
+#endif
+
+//-------------------- Private Function Prototypes --------------------//
+static EepromErrorState arduino_Init(Eeprom* eeprom);
+static void arduino_Select(Eeprom* eeprom);
+static void arduino_Deselect(Eeprom* eeprom);
+static EepromErrorState arduino_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+static EepromErrorState arduino_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+static EepromErrorState arduino_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len);
+static uint32_t arduino_GetTick(Eeprom* eeprom);
+static EepromErrorState arduino_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments);
+
+const EepromTransport eepromTransportArduino =
+{
+	EEPROM_TRANSPORT_CAP_SEGMENTS,
+	arduino_Init,
+	arduino_Select,
+	arduino_Deselect,
+	arduino_Transmit,
+	arduino_Receive,
+	arduino_TransmitReceive,
+	arduino_GetTick,
+	arduino_Transfer,
+	NULL
+};
+
+
+//-------------------- Private Functions --------------------//
+static inline SPIClass* arduino_Spi(Eeprom* eeprom)
+{
+	return (eeprom->spi != NULL) ? (SPIClass*)eeprom->spi : &SPI;
+}
+
+static EepromErrorState arduino_Init(Eeprom* eeprom)
+{
+	pinMode(eeprom->csPin, OUTPUT);
+	digitalWrite(eeprom->csPin, HIGH);
+	arduino_Spi(eeprom)->begin();
+	return EepromOk;
+}
+
+static void arduino_Select(Eeprom* eeprom)
+{
+	uint32_t clock = (eeprom->spiClock != 0) ? eeprom->spiClock : EEPROM_ARDUINO_DEFAULT_CLOCK;
+	arduino_Spi(eeprom)->beginTransaction(SPISettings(clock, MSBFIRST, SPI_MODE0));
+	digitalWrite(eeprom->csPin, LOW);
+}
+
+static void arduino_Deselect(Eeprom* eeprom)
+{
+	digitalWrite(eeprom->csPin, HIGH);
+	arduino_Spi(eeprom)->endTransaction();
+}
+
+static EepromErrorState arduino_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	SPIClass* spi = arduino_Spi(eeprom);
+#if defined(ARDUINO_ARCH_RP2040)
+	// Separate buffer burst transfer, no copy needed to keep the source intact
+	spi->transfer(pData, NULL, len);
+#else
+	for(uint32_t i=0; i<len; i++)
+	{
+		spi->transfer(pData[i]);
+	}
+#endif
+	return EepromOk;
+}
+
+static EepromErrorState arduino_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	// In-place burst transfer, clocking out 0xff
+	memset(pData, 0xff, len);
+	arduino_Spi(eeprom)->transfer(pData, len);
+	return EepromOk;
+}
+
+static EepromErrorState arduino_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len)
+{
+#if defined(ARDUINO_ARCH_RP2040)
+	arduino_Spi(eeprom)->transfer(txData, rxData, len);
+#else
+	memmove(rxData, txData, len);
+	arduino_Spi(eeprom)->transfer(rxData, len);
+#endif
+	return EepromOk;
+}
+
+static uint32_t arduino_GetTick(Eeprom* eeprom)
+{
+	(void)eeprom;
+	return millis();
+}
+
+static EepromErrorState arduino_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments)
+{
+	EepromErrorState status = EepromOk;
+	arduino_Select(eeprom);
+	for(uint8_t i=0; i<numSegments && status == EepromOk; i++)
+	{
+		const EepromSegment* segment = &segments[i];
+	#if defined(ARDUINO_ARCH_RP2040)
+		// One burst per segment: a NULL tx clocks out 0xff, a NULL rx discards
+		if(segment->tx != NULL || segment->rx != NULL)
+		{
+			arduino_Spi(eeprom)->transfer(segment->tx, segment->rx, segment->len);
+		}
+	#else
+		if(segment->tx != NULL && segment->rx != NULL)
+		{
+			status = arduino_TransmitReceive(eeprom, segment->tx, segment->rx, segment->len);
+		}
+		else if(segment->rx != NULL)
+		{
+			status = arduino_Receive(eeprom, segment->rx, segment->len);
+		}
+		else if(segment->tx != NULL)
+		{
+			status = arduino_Transmit(eeprom, segment->tx, segment->len);
+		}
+	#endif
+	}
+	arduino_Deselect(eeprom);
+	return status;
+}
+#endif
@@ -0,0 +1,274 @@
+/*
+ * eeprom_transport_stm32.c
+ *
+ * STM32 HAL transports: blocking transfers, and DMA transfers with asynchronous support.
+ */
+
+#include "eeprom_m95.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if FRAMEWORK_STM32CUBE
+
+#ifndef EEPROM_DMA_THRESHOLD
+#define EEPROM_DMA_THRESHOLD		16			// Shorter transfers are cheaper without DMA setup
+#endif
+
+#define HAL_MAX_TRANSFER			0xffff		// HAL transfer sizes are 16-bit
+
+//-------------------- Private Function Prototypes --------------------//
+static void hal_Select(Eeprom* eeprom);
+static void hal_Deselect(Eeprom* eeprom);
+static EepromErrorState hal_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+static EepromErrorState hal_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+static EepromErrorState hal_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len);
+static uint32_t hal_GetTick(Eeprom* eeprom);
+static EepromErrorState hal_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments);
+static EepromErrorState halDma_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments);
+static EepromErrorState hal_RunSegments(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments, uint8_t dma);
+static EepromErrorState halDma_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+static EepromErrorState halDma_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len);
+static EepromErrorState halDma_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len);
+static EepromErrorState halDma_StartAsync(Eeprom* eeprom, const EepromSegment* segment);
+static EepromErrorState halDma_Start(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint16_t len);
+
+/*
+ * Blocking HAL transfers. Chip select is a GPIO driven from hspi/csPort/csPin. A segment
+ * list runs in one transfer call with chip select asserted once.
+ */
+const EepromTransport eepromTransportHal =
+{
+	EEPROM_TRANSPORT_CAP_SEGMENTS,
+	NULL,
+	hal_Select,
+	hal_Deselect,
+	hal_Transmit,
+	hal_Receive,
+	hal_TransmitReceive,
+	hal_GetTick,
+	hal_Transfer,
+	NULL
+};
+
+/*
+ * DMA HAL transfers. Transfers of EEPROM_DMA_THRESHOLD bytes or more run by DMA; blocking
+ * calls wait for completion, startAsync returns immediately. The SPI handle needs its DMA
+ * channels linked, buffers must be DMA accessible (and cache maintained on STM32H7), and
+ * the application forwards HAL_SPI_TxCpltCallback, HAL_SPI_RxCpltCallback and
+ * HAL_SPI_TxRxCpltCallback for this handle to eeprom_TransportComplete.
+ */
+const EepromTransport eepromTransportHalDma =
+{
+	EEPROM_TRANSPORT_CAP_SEGMENTS | EEPROM_TRANSPORT_CAP_ASYNC,
+	NULL,
+	hal_Select,
+	hal_Deselect,
+	halDma_Transmit,
+	halDma_Receive,
+	halDma_TransmitReceive,
+	hal_GetTick,
+	halDma_Transfer,
+	halDma_StartAsync
+};
+
+
+//-------------------- Private Functions --------------------//
+static void hal_Select(Eeprom* eeprom)
+{
+	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_RESET);
+}
+
+static void hal_Deselect(Eeprom* eeprom)
+{
+	HAL_GPIO_WritePin(eeprom->csPort, eeprom->csPin, GPIO_PIN_SET);
+}
+
+static EepromErrorState hal_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	while(len > 0)
+	{
+		uint16_t num = (len > HAL_MAX_TRANSFER) ? HAL_MAX_TRANSFER : (uint16_t)len;
+		while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
+		if(HAL_SPI_Transmit(eeprom->hspi, pData, num, HAL_MAX_DELAY) != HAL_OK)
+		{
+			return EepromHalError;
+		}
+		pData += num;
+		len -= num;
+	}
+	return EepromOk;
+}
+
+static EepromErrorState hal_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	while(len > 0)
+	{
+		uint16_t num = (len > HAL_MAX_TRANSFER) ? HAL_MAX_TRANSFER : (uint16_t)len;
+		while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
+		if(HAL_SPI_Receive(eeprom->hspi, pData, num, HAL_MAX_DELAY) != HAL_OK)
+		{
+			return EepromHalError;
+		}
+		pData += num;
+		len -= num;
+	}
+	return EepromOk;
+}
+
+static EepromErrorState hal_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len)
+{
+	while(len > 0)
+	{
+		uint16_t num = (len > HAL_MAX_TRANSFER) ? HAL_MAX_TRANSFER : (uint16_t)len;
+		while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
+		if(HAL_SPI_TransmitReceive(eeprom->hspi, txData, rxData, num, HAL_MAX_DELAY) != HAL_OK)
+		{
+			return EepromHalError;
+		}
+		txData += num;
+		rxData += num;
+		len -= num;
+	}
+	return EepromOk;
+}
+
+static uint32_t hal_GetTick(Eeprom* eeprom)
+{
+	(void)eeprom;
+	return HAL_GetTick();
+}
+
+static EepromErrorState hal_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments)
+{
+	return hal_RunSegments(eeprom, segments, numSegments, FALSE);
+}
+
+static EepromErrorState halDma_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments)
+{
+	return hal_RunSegments(eeprom, segments, numSegments, TRUE);
+}
+
+/**
+  * @brief 	Runs a segment list with chip select asserted once. With dma set, segments of
+  * EEPROM_DMA_THRESHOLD bytes or more run by DMA.
+  */
+static EepromErrorState hal_RunSegments(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments, uint8_t dma)
+{
+	EepromErrorState status = EepromOk;
+	hal_Select(eeprom);
+	for(uint8_t i=0; i<numSegments && status == EepromOk; i++)
+	{
+		const EepromSegment* segment = &segments[i];
+		if(segment->tx != NULL && segment->rx != NULL)
+		{
+			status = dma ? halDma_TransmitReceive(eeprom, segment->tx, segment->rx, segment->len)
+					: hal_TransmitReceive(eeprom, segment->tx, segment->rx, segment->len);
+		}
+		else if(segment->rx != NULL)
+		{
+			status = dma ? halDma_Receive(eeprom, segment->rx, segment->len) : hal_Receive(eeprom, segment->rx, segment->len);
+		}
+		else if(segment->tx != NULL)
+		{
+			status = dma ? halDma_Transmit(eeprom, segment->tx, segment->len) : hal_Transmit(eeprom, segment->tx, segment->len);
+		}
+	}
+	hal_Deselect(eeprom);
+	return status;
+}
+
+static EepromErrorState halDma_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	if(len < EEPROM_DMA_THRESHOLD)
+	{
+		return hal_Transmit(eeprom, pData, len);
+	}
+	while(len > 0)
+	{
+		uint16_t num = (len > HAL_MAX_TRANSFER) ? HAL_MAX_TRANSFER : (uint16_t)len;
+		if(halDma_Start(eeprom, pData, NULL, num) != EepromOk)
+		{
+			return EepromHalError;
+		}
+		while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
+		pData += num;
+		len -= num;
+	}
+	return EepromOk;
+}
+
+static EepromErrorState halDma_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	if(len < EEPROM_DMA_THRESHOLD)
+	{
+		return hal_Receive(eeprom, pData, len);
+	}
+	while(len > 0)
+	{
+		uint16_t num = (len > HAL_MAX_TRANSFER) ? HAL_MAX_TRANSFER : (uint16_t)len;
+		if(halDma_Start(eeprom, NULL, pData, num) != EepromOk)
+		{
+			return EepromHalError;
+		}
+		while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
+		pData += num;
+		len -= num;
+	}
+	return EepromOk;
+}
+
+static EepromErrorState halDma_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len)
+{
+	if(len < EEPROM_DMA_THRESHOLD)
+	{
+		return hal_TransmitReceive(eeprom, txData, rxData, len);
+	}
+	while(len > 0)
+	{
+		uint16_t num = (len > HAL_MAX_TRANSFER) ? HAL_MAX_TRANSFER : (uint16_t)len;
+		if(halDma_Start(eeprom, txData, rxData, num) != EepromOk)
+		{
+			return EepromHalError;
+		}
+		while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
+		txData += num;
+		rxData += num;
+		len -= num;
+	}
+	return EepromOk;
+}
+
+static EepromErrorState halDma_StartAsync(Eeprom* eeprom, const EepromSegment* segment)
+{
+	if(segment->len == 0 || segment->len > HAL_MAX_TRANSFER)
+	{
+		return EepromStorageError;
+	}
+	return halDma_Start(eeprom, segment->tx, segment->rx, (uint16_t)segment->len);
+}
+
+static EepromErrorState halDma_Start(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint16_t len)
+{
+	HAL_StatusTypeDef halStatus;
+	while(HAL_SPI_GetState(eeprom->hspi) != HAL_SPI_STATE_READY);
+	if(txData != NULL && rxData != NULL)
+	{
+		halStatus = HAL_SPI_TransmitReceive_DMA(eeprom->hspi, txData, rxData, len);
+	}
+	else if(rxData != NULL)
+	{
+		halStatus = HAL_SPI_Receive_DMA(eeprom->hspi, rxData, len);
+	}
+	else
+	{
+		halStatus = HAL_SPI_Transmit_DMA(eeprom->hspi, txData, len);
+	}
+	return (halStatus == HAL_OK) ? EepromOk : EepromHalError;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
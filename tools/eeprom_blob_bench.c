@@ -0,0 +1,165 @@
+/*
+ * eeprom_blob_bench.c
+ *
+ * Host tool: stores representative assets (a preset bank, a lookup table, text and random
+ * data) raw with eeprom_Write and as compressed blobs with eeprom_BlobSave on the simulated
+ * device. Reports the compression ratio, simulated save, load and random access times,
+ * and the blob module's RAM use, and checks every blob reads back.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_blob_bench tools/eeprom_blob_bench.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_blob.c
+ *
+ * Simulated times are bus and cycle time only; decompression runs on the host CPU.
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_blob.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASSET_LEN			(64 * 1024)
+#define RAW_ADDR			0
+#define BLOB_ADDR			(128 * 1024)
+#define ACCESS_LEN			64
+#define NUM_ACCESSES		32
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t asset[ASSET_LEN];
+static uint8_t readBack[ASSET_LEN];
+
+static void setup(uint8_t* mem)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+}
+
+// 128 presets of 512 bytes: a name, then parameters that mostly keep their defaults
+static void makePresets(uint8_t* data)
+{
+	for(uint32_t preset=0; preset<ASSET_LEN / 512; preset++)
+	{
+		uint8_t* p = &data[preset * 512];
+		memset(p, 0, 512);
+		snprintf((char*)p, 32, "Preset %03u", preset);
+		for(uint32_t param=32; param<512; param += 4)
+		{
+			uint32_t value = (param * 7) & 0x7f;
+			if((uint32_t)rand() % 8 == 0)
+			{
+				value = (uint32_t)rand() & 0x3fff;
+			}
+			p[param] = (uint8_t)(value & 0xff);
+			p[param + 1] = (uint8_t)(value >> 8);
+		}
+	}
+}
+
+// 16-bit exponential response curve, as used for parameter scaling
+static void makeTable(uint8_t* data)
+{
+	for(uint32_t i=0; i<ASSET_LEN / 2; i++)
+	{
+		uint32_t x = i >> 2;
+		uint32_t value = (x * x) >> 10;
+		data[2 * i] = (uint8_t)(value & 0xff);
+		data[(2 * i) + 1] = (uint8_t)((value >> 8) & 0xff);
+	}
+}
+
+static void makeText(uint8_t* data)
+{
+	static const char* words[] = {"the", "preset", "bank", "stores", "settings", "for", "each", "channel", "and",
+			"output", "level", "filter", "cutoff", "is", "applied", "when", "a", "note", "starts", "to", "play"};
+	uint32_t fill = 0;
+	while(fill < ASSET_LEN)
+	{
+		const char* word = words[(uint32_t)rand() % (sizeof(words) / sizeof(words[0]))];
+		for(uint32_t i=0; word[i] != 0 && fill < ASSET_LEN; i++)
+		{
+			data[fill++] = (uint8_t)word[i];
+		}
+		if(fill < ASSET_LEN)
+		{
+			data[fill++] = ((uint32_t)rand() % 12 == 0) ? '\n' : ' ';
+		}
+	}
+}
+
+static void makeRandom(uint8_t* data)
+{
+	for(uint32_t i=0; i<ASSET_LEN; i++)
+	{
+		data[i] = (uint8_t)rand();
+	}
+}
+
+static int run(uint8_t* mem, const char* name)
+{
+	setup(mem);
+	uint64_t startNs = sim.timeNs;
+	eeprom_Write(&eeprom, asset, ASSET_LEN, RAW_ADDR);
+	double rawSaveMs = (sim.timeNs - startNs) / 1e6;
+	startNs = sim.timeNs;
+	eeprom_Read(&eeprom, readBack, ASSET_LEN, RAW_ADDR);
+	double rawLoadMs = (sim.timeNs - startNs) / 1e6;
+	startNs = sim.timeNs;
+	for(uint32_t i=0; i<NUM_ACCESSES; i++)
+	{
+		eeprom_Read(&eeprom, readBack, ACCESS_LEN, RAW_ADDR + ((i * 1999) % (ASSET_LEN - ACCESS_LEN)));
+	}
+	double rawAccessUs = (sim.timeNs - startNs) / 1e3 / NUM_ACCESSES;
+
+	uint32_t storedLen = 0;
+	startNs = sim.timeNs;
+	EepromErrorState status = eeprom_BlobSave(&eeprom, BLOB_ADDR, EEPROM_BLOB_MAX_STORED_SIZE(ASSET_LEN), asset, ASSET_LEN, &storedLen);
+	double blobSaveMs = (sim.timeNs - startNs) / 1e6;
+	memset(readBack, 0, ASSET_LEN);
+	startNs = sim.timeNs;
+	if(status == EepromOk)
+	{
+		status = eeprom_BlobRead(&eeprom, BLOB_ADDR, readBack, ASSET_LEN, 0);
+	}
+	double blobLoadMs = (sim.timeNs - startNs) / 1e6;
+	int ok = (status == EepromOk) && memcmp(readBack, asset, ASSET_LEN) == 0;
+	startNs = sim.timeNs;
+	for(uint32_t i=0; i<NUM_ACCESSES && ok; i++)
+	{
+		uint32_t offset = (i * 1999) % (ASSET_LEN - ACCESS_LEN);
+		status = eeprom_BlobRead(&eeprom, BLOB_ADDR, readBack, ACCESS_LEN, offset);
+		ok = (status == EepromOk) && memcmp(readBack, &asset[offset], ACCESS_LEN) == 0;
+	}
+	double blobAccessUs = (sim.timeNs - startNs) / 1e3 / NUM_ACCESSES;
+
+	printf("%-10s %5.2f:1  save %7.1f / %7.1f mS  load %6.2f / %6.2f mS  %u B access %5.1f / %5.1f uS  %s\n", name,
+			(double)ASSET_LEN / storedLen, rawSaveMs, blobSaveMs, rawLoadMs, blobLoadMs, ACCESS_LEN, rawAccessUs,
+			blobAccessUs, ok ? "ok" : "MISMATCH");
+	return !ok;
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	printf("%u KB assets, raw / blob. Blob RAM %u bytes static (chunk %u bytes)\n", ASSET_LEN / 1024,
+			(2 * EEPROM_BLOB_CHUNK_SIZE) + EEPROM_PAGE_SIZE + (2 * EEPROM_BLOB_HASH_SIZE), EEPROM_BLOB_CHUNK_SIZE);
+	int rc = 0;
+	srand(1);
+	makePresets(asset);
+	rc |= run(mem, "presets");
+	makeTable(asset);
+	rc |= run(mem, "table");
+	makeText(asset);
+	rc |= run(mem, "text");
+	makeRandom(asset);
+	rc |= run(mem, "random");
+	return rc;
+}
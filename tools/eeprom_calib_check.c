@@ -0,0 +1,116 @@
+/*
+ * eeprom_calib_check.c
+ *
+ * Host tool: runs eeprom_CalibrateSpi on the simulated device with bit errors injected
+ * above a set SCK rate (optionally a lower rate while the output drive is low), and checks
+ * the selected clock step and drive, the stored record applied by eeprom_ApplySpiCalibration,
+ * and that a stored setting that no longer reads back cleanly is rejected.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_calib_check tools/eeprom_calib_check.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_calib.c
+ *
+ * Clock steps run from 625 kHz (step 0) to 80 MHz (step 7), doubling each step.
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_calib.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CALIB_ADDR			(EEPROM_DEVICE_SIZE - EEPROM_PAGE_SIZE)
+
+#if defined(M95P32)
+#define TIE_DRIVE			EEPROM_DRIVE_LOW		// Equal steps go to the weaker drive
+#else
+#define TIE_DRIVE			0
+#endif
+
+static EepromSim sim;
+static Eeprom eeprom;
+
+typedef struct
+{
+	const char* name;
+	uint32_t errorAboveHz;
+	uint32_t lowDriveErrorAboveHz;
+	uint8_t expectedStep;
+	uint8_t expectedDrive;
+} CalibCase;
+
+static uint32_t stepHz(uint8_t clockStep)
+{
+	return (uint32_t)EEPROM_SIM_KERNEL_CLOCK_HZ >> (EEPROM_SIM_CLOCK_STEPS - clockStep);
+}
+
+static uint8_t simDrive(void)
+{
+#if defined(M95P32)
+	return (sim.configReg >> EEPROM_CONFIG_DRV0_BIT) & 0x03;
+#else
+	return 0;
+#endif
+}
+
+static int run(uint8_t* mem, const CalibCase* test)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	sim.errorAboveHz = test->errorAboveHz;
+	sim.lowDriveErrorAboveHz = test->lowDriveErrorAboveHz;
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+
+	EepromSpiCalibration calib = {0xff, 0xff};
+	EepromErrorState status = eeprom_CalibrateSpi(&eeprom, eeprom_SimSetClockStep, EEPROM_SIM_CLOCK_STEPS, CALIB_ADDR, &calib);
+	int ok = (status == EepromOk && calib.clockStep == test->expectedStep && calib.drive == test->expectedDrive
+			&& simDrive() == test->expectedDrive && sim.spiClockHz == stepHz(calib.clockStep));
+	printf("%-28s step %u (%5.2f MHz) drive %u, expected step %u drive %u, %u bit errors  %s\n", test->name,
+			calib.clockStep, sim.spiClockHz / 1e6, calib.drive, test->expectedStep, test->expectedDrive, sim.bitErrors,
+			ok ? "ok" : "FAIL");
+
+	// The next boot applies the stored record directly
+	eeprom_SimSetClockStep(&eeprom, 0);
+	EepromSpiCalibration applied = {0xff, 0xff};
+	status = eeprom_ApplySpiCalibration(&eeprom, eeprom_SimSetClockStep, EEPROM_SIM_CLOCK_STEPS, CALIB_ADDR, &applied);
+	int applyOk = (status == EepromOk && applied.clockStep == calib.clockStep && applied.drive == calib.drive);
+
+	// A record made with a different number of steps is not applied
+	status = eeprom_ApplySpiCalibration(&eeprom, eeprom_SimSetClockStep, EEPROM_SIM_CLOCK_STEPS - 1, CALIB_ADDR, &applied);
+	applyOk &= (status == EepromStorageError);
+
+	// Margins shrink (e.g. temperature): the stored step now fails and the clock drops to step 0
+	sim.errorAboveHz = stepHz(1);
+	sim.lowDriveErrorAboveHz = 0;
+	status = eeprom_ApplySpiCalibration(&eeprom, eeprom_SimSetClockStep, EEPROM_SIM_CLOCK_STEPS, CALIB_ADDR, &applied);
+	applyOk &= (calib.clockStep == 0) ? (status == EepromOk)
+			: (status == EepromDeviceError && sim.spiClockHz == stepHz(0));
+	printf("%-28s apply stored, rejected with wrong steps, rejected when failing  %s\n", "", applyOk ? "ok" : "FAIL");
+	return !(ok && applyOk);
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	static const CalibCase cases[] =
+	{
+		{"no errors", 0, 0, 7, TIE_DRIVE},
+		{"errors above 25 MHz", 25000000, 0, 5, TIE_DRIVE},
+		{"errors above 1 MHz", 1000000, 0, 0, TIE_DRIVE},
+#if defined(M95P32)
+		{"45 MHz, 15 MHz at low drive", 45000000, 15000000, 6, EEPROM_DRIVE_MEDIUM},
+		{"15 MHz, 45 MHz at low drive", 15000000, 45000000, 6, EEPROM_DRIVE_LOW},
+#endif
+	};
+	int rc = 0;
+	for(uint32_t i=0; i<sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		rc |= run(mem, &cases[i]);
+	}
+	return rc;
+}
@@ -0,0 +1,148 @@
+/*
+ * eeprom_checksum_bench.c
+ *
+ * Host tool: compares eeprom_ChecksumRange against reading a region with eeprom_Read in
+ * buffer sized pieces and hashing each piece, on the simulated device. Reports simulated
+ * bus time, transport calls and RAM, checks both give the checksum of the data in RAM, and
+ * times the software hashes on the host.
+ *
+ * Expect eeprom_ChecksumRange to match the bus time of large reads, not beat it: its
+ * advantage is that RAM stays at one or two chunks, with fewer calls than reads of the
+ * same size.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_checksum_bench tools/eeprom_checksum_bench.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_checksum.c
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_checksum.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REGION_ADDR			0
+#define REGION_LEN			(256 * 1024)
+#define NUM_SECTORS			(REGION_LEN / EEPROM_CHECKSUM_SECTOR_SIZE)
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t readBuf[4096];
+static uint32_t table[NUM_SECTORS];
+static uint8_t changed[(NUM_SECTORS + 7) / 8];
+
+// Resets the simulated device, filling the array with the same random contents each time
+static void setup(uint8_t* mem, const EepromTransport* transport)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	srand(1);
+	for(uint32_t i=0; i<EEPROM_DEVICE_SIZE; i++)
+	{
+		mem[i] = (uint8_t)rand();
+	}
+	eeprom.transport = transport;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+}
+
+static void report(const char* name, uint64_t startNs, uint32_t startCalls, uint32_t ram, uint32_t checksum, uint32_t expected)
+{
+	uint64_t ns = sim.timeNs - startNs;
+	printf("%-28s %7.2f mS  %6.2f MB/s  %5u calls  %5u bytes RAM  %s\n", name, ns / 1e6, REGION_LEN / (ns / 1e3),
+			sim.calls - startCalls, ram, (checksum == expected) ? "ok" : "MISMATCH");
+}
+
+static uint32_t readThenHash(uint32_t bufLen, uint8_t algo)
+{
+	uint32_t state = eeprom_ChecksumBegin(algo);
+	for(uint32_t offset=0; offset<REGION_LEN; offset += bufLen)
+	{
+		eeprom_Read(&eeprom, readBuf, bufLen, REGION_ADDR + offset);
+		state = eeprom_ChecksumUpdate(algo, state, readBuf, bufLen);
+	}
+	return eeprom_ChecksumEnd(algo, state);
+}
+
+static double hashMBps(const uint8_t* data, uint8_t algo)
+{
+	clock_t start = clock();
+	uint32_t rounds = 0;
+	volatile uint32_t sink = 0;
+	while(clock() - start < CLOCKS_PER_SEC / 4)
+	{
+		sink ^= eeprom_ChecksumUpdate(algo, eeprom_ChecksumBegin(algo), data, REGION_LEN);
+		rounds++;
+	}
+	return (double)rounds * REGION_LEN / ((double)(clock() - start) / CLOCKS_PER_SEC) / 1e6;
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	setup(mem, &eepromTransportSim);
+	const char* algoNames[2] = {"CRC-32", "FNV-1a"};
+	int rc = 0;
+
+	for(uint8_t algo=EepromChecksumCrc32; algo<=EepromChecksumFnv1a; algo++)
+	{
+		uint32_t expected = eeprom_ChecksumEnd(algo, eeprom_ChecksumUpdate(algo, eeprom_ChecksumBegin(algo), &mem[REGION_ADDR], REGION_LEN));
+		printf("%s over %u KB (host hash %.0f MB/s)\n", algoNames[algo], REGION_LEN / 1024, hashMBps(&mem[REGION_ADDR], algo));
+		setup(mem, &eepromTransportSim);
+		for(uint32_t bufLen=256; bufLen<=sizeof(readBuf); bufLen *= 16)
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "read then hash, %u B reads", bufLen);
+			uint64_t startNs = sim.timeNs;
+			uint32_t startCalls = sim.calls;
+			uint32_t checksum = readThenHash(bufLen, algo);
+			report(name, startNs, startCalls, bufLen, checksum, expected);
+			rc |= (checksum != expected);
+		}
+		const EepromTransport* transports[2] = {&eepromTransportSim, &eepromTransportSimBurst};
+		const char* transportNames[2] = {"eeprom_ChecksumRange", "eeprom_ChecksumRange, async"};
+		for(uint8_t t=0; t<2; t++)
+		{
+			setup(mem, transports[t]);
+			uint32_t checksum = 0;
+			uint64_t startNs = sim.timeNs;
+			uint32_t startCalls = sim.calls;
+			eeprom_ChecksumRange(&eeprom, REGION_ADDR, REGION_LEN, algo, &checksum);
+			uint32_t ram = EEPROM_CHECKSUM_CHUNK * ((transports[t]->caps & EEPROM_TRANSPORT_CAP_ASYNC) ? 2 : 1);
+			report(transportNames[t], startNs, startCalls, ram, checksum, expected);
+			rc |= (checksum != expected);
+		}
+	}
+
+	// Change detection: a one byte change must flag exactly its sector
+	setup(mem, &eepromTransportSim);
+	eeprom_ChecksumSectors(&eeprom, REGION_ADDR, NUM_SECTORS, EepromChecksumFnv1a, table, NULL);
+	uint8_t byte = 0x5a;
+	uint32_t changeAddr = REGION_ADDR + (5 * EEPROM_CHECKSUM_SECTOR_SIZE) + 100;
+	if(mem[changeAddr] == byte)
+	{
+		byte = 0xa5;
+	}
+	eeprom_Write(&eeprom, &byte, 1, changeAddr);
+	uint64_t startNs = sim.timeNs;
+	eeprom_ChecksumSectors(&eeprom, REGION_ADDR, NUM_SECTORS, EepromChecksumFnv1a, table, changed);
+	uint32_t numChanged = 0;
+	uint32_t changedSector = 0;
+	for(uint32_t i=0; i<NUM_SECTORS; i++)
+	{
+		if(changed[i / 8] & (1 << (i % 8)))
+		{
+			numChanged++;
+			changedSector = i;
+		}
+	}
+	printf("sector table: %u sectors checked in %.2f mS, %u changed (sector %u)\n", NUM_SECTORS,
+			(sim.timeNs - startNs) / 1e6, numChanged, changedSector);
+	rc |= (numChanged != 1 || changedSector != 5);
+	return rc;
+}
@@ -0,0 +1,253 @@
+/*
+ * eeprom_coro_bench.cpp
+ *
+ * Host tool: runs three coroutines on a small round-robin executor over the simulated
+ * device (a UI task that wants to run every millisecond, a task reading settings every
+ * 10 mS, and a task saving a large image), once with the save calling the blocking
+ * eeprom_Write and once awaiting EepromAsync::write. Reports how much the other tasks
+ * progressed while the image was written, and checks the image reads back.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -c src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c
+ *   g++ -O2 -std=c++20 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_coro_bench \
+ *       tools/eeprom_coro_bench.cpp src/eeprom_coro.cpp eeprom.o eeprom_seq.o eeprom_sim.o
+ *
+ * Usage: eeprom_coro_bench [-a]
+ *   -a    asynchronous transport (transfers complete through eeprom_TransportComplete)
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_coro.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <coroutine>
+
+#define IMAGE_ADDR			0x10000
+#define IMAGE_LEN			(32 * 1024)
+#define SAVE_CHUNK			4096
+#define SETTINGS_ADDR		0x1000
+#define SETTINGS_LEN		64
+#define UI_PERIOD_US		1000
+#define READ_PERIOD_US		10000
+#define LOOP_US				20			// Executor overhead per iteration
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t image[IMAGE_LEN];
+static uint8_t readBack[IMAGE_LEN];
+
+static uint64_t nowUs() { return sim.timeNs / 1000; }
+
+//-------------------- Executor --------------------//
+// The application's own task type, unrelated to EepromTask
+struct AppTask
+{
+	struct promise_type
+	{
+		AppTask get_return_object() { return AppTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { abort(); }
+	};
+	explicit AppTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+	AppTask(AppTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+	~AppTask() { if(handle) handle.destroy(); }
+	std::coroutine_handle<promise_type> handle;
+};
+
+struct Executor
+{
+	static const int MAX_TASKS = 4;
+	std::coroutine_handle<> sleeping[MAX_TASKS];
+	uint64_t wakeUs[MAX_TASKS];
+	int numSleeping = 0;
+	EepromAsync* async = nullptr;
+
+	// Suspends the calling task until the simulated time reaches wakeAt
+	struct Sleep
+	{
+		Executor* executor;
+		uint64_t wakeAt;
+		bool await_ready() { return nowUs() >= wakeAt; }
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			executor->sleeping[executor->numSleeping] = handle;
+			executor->wakeUs[executor->numSleeping++] = wakeAt;
+		}
+		void await_resume() {}
+	};
+	Sleep sleepUntil(uint64_t us) { return Sleep{this, us}; }
+
+	void run(AppTask* tasks, int numTasks)
+	{
+		for(int i=0; i<numTasks; i++)
+		{
+			tasks[i].handle.resume();
+		}
+		while(true)
+		{
+			bool allDone = true;
+			for(int i=0; i<numTasks; i++)
+			{
+				allDone &= tasks[i].handle.done();
+			}
+			if(allDone)
+			{
+				return;
+			}
+			if(async != nullptr)
+			{
+				async->poll();
+			}
+			for(int i=0; i<numSleeping; )
+			{
+				if(nowUs() >= wakeUs[i])
+				{
+					std::coroutine_handle<> handle = sleeping[i];
+					sleeping[i] = sleeping[--numSleeping];
+					wakeUs[i] = wakeUs[numSleeping];
+					handle.resume();
+					continue;
+				}
+				i++;
+			}
+			eeprom_SimIdle(&sim, LOOP_US * 1000);
+		}
+	}
+};
+
+//-------------------- Application tasks --------------------//
+struct Stats
+{
+	bool saving;
+	uint64_t saveStartUs;
+	uint64_t saveEndUs;
+	uint32_t uiPeriods;				// UI periods due while the image was being saved
+	uint32_t uiRuns;				// Of those, runs on time (within a period)
+	uint64_t uiMaxLateUs;
+	uint32_t reads;
+	uint64_t readMaxUs;
+	EepromErrorState saveStatus;
+};
+
+static AppTask uiTask(Executor& executor, Stats& stats)
+{
+	uint64_t next = nowUs();
+	while(stats.saveEndUs == 0)
+	{
+		next += UI_PERIOD_US;
+		co_await executor.sleepUntil(next);
+		// A blocked executor runs the missed periods late, back to back
+		uint64_t late = nowUs() - next;
+		stats.uiMaxLateUs = (late > stats.uiMaxLateUs) ? late : stats.uiMaxLateUs;
+		if(stats.saveStartUs != 0 && next >= stats.saveStartUs && (stats.saveEndUs == 0 || next < stats.saveEndUs))
+		{
+			stats.uiPeriods++;
+			if(late < UI_PERIOD_US)
+			{
+				stats.uiRuns++;
+			}
+		}
+	}
+	// Periods due before the save ended that never ran
+	for(next += UI_PERIOD_US; next < stats.saveEndUs; next += UI_PERIOD_US)
+	{
+		stats.uiPeriods++;
+	}
+}
+
+static AppTask readTask(Executor& executor, EepromAsync* async, Stats& stats)
+{
+	uint8_t settings[SETTINGS_LEN];
+	uint64_t next = nowUs();
+	while(stats.saveEndUs == 0)
+	{
+		next += READ_PERIOD_US;
+		co_await executor.sleepUntil(next);
+		if(async != nullptr)
+		{
+			co_await async->read(settings, SETTINGS_LEN, SETTINGS_ADDR);
+		}
+		else
+		{
+			eeprom_Read(&eeprom, settings, SETTINGS_LEN, SETTINGS_ADDR);
+		}
+		uint64_t latency = nowUs() - next;
+		stats.readMaxUs = (latency > stats.readMaxUs) ? latency : stats.readMaxUs;
+		if(stats.saving)
+		{
+			stats.reads++;
+		}
+	}
+}
+
+static AppTask saveTask(Executor& executor, EepromAsync* async, Stats& stats)
+{
+	co_await executor.sleepUntil(nowUs() + 3 * UI_PERIOD_US / 2);
+	stats.saving = true;
+	stats.saveStartUs = nowUs();
+	stats.saveStatus = EepromOk;
+	for(uint32_t offset=0; offset<IMAGE_LEN && stats.saveStatus == EepromOk; offset+=SAVE_CHUNK)
+	{
+		if(async != nullptr)
+		{
+			stats.saveStatus = co_await async->write(&image[offset], SAVE_CHUNK, IMAGE_ADDR + offset);
+		}
+		else
+		{
+			stats.saveStatus = eeprom_Write(&eeprom, &image[offset], SAVE_CHUNK, IMAGE_ADDR + offset);
+			co_await executor.sleepUntil(nowUs() + 1);
+		}
+	}
+	stats.saving = false;
+	stats.saveEndUs = nowUs();
+}
+
+static int run(const char* name, uint8_t* mem, const EepromTransport* transport, bool useAsync)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	eeprom.transport = transport;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+	EepromAsync async(&eeprom);
+	Executor executor;
+	executor.async = useAsync ? &async : nullptr;
+	Stats stats = {};
+	AppTask tasks[3] = {uiTask(executor, stats), readTask(executor, executor.async, stats), saveTask(executor, executor.async, stats)};
+	executor.run(tasks, 3);
+
+	eeprom_Read(&eeprom, readBack, IMAGE_LEN, IMAGE_ADDR);
+	bool ok = stats.saveStatus == EepromOk && memcmp(readBack, image, IMAGE_LEN) == 0;
+	double saveMs = (stats.saveEndUs - stats.saveStartUs) / 1e3;
+	printf("%-22s save %7.1f mS  UI on time %4u of %4u (max %6.2f mS late)  %3u reads (max %6.2f mS)  %s\n", name,
+			saveMs, stats.uiRuns, stats.uiPeriods, stats.uiMaxLateUs / 1e3, stats.reads,
+			stats.readMaxUs / 1e3, ok ? "verified" : "MISMATCH");
+	if(useAsync)
+	{
+		printf("%-22s %u suspensions, %u status polls while busy\n", "", async.suspensions, async.busyPolls);
+	}
+	return !ok;
+}
+
+int main(int argc, char** argv)
+{
+	uint8_t* mem = (uint8_t*)malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	for(uint32_t i=0; i<IMAGE_LEN; i++)
+	{
+		image[i] = (uint8_t)rand();
+	}
+	const EepromTransport* transport = (argc > 1 && strcmp(argv[1], "-a") == 0) ? &eepromTransportSimBurst : &eepromTransportSim;
+	printf("%u KB image in %u byte writes, UI every %u uS, settings read every %u uS\n", IMAGE_LEN / 1024, SAVE_CHUNK,
+			UI_PERIOD_US, READ_PERIOD_US);
+	int rc = 0;
+	rc |= run("blocking eeprom_Write", mem, transport, false);
+	rc |= run("co_await write", mem, transport, true);
+	return rc;
+}
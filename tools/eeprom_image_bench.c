@@ -0,0 +1,122 @@
+/*
+ * eeprom_image_bench.c
+ *
+ * Host tool: measures end-to-end image write time on the simulated device, from the first
+ * chunk arriving to the image being written and verified, with the streaming image writer
+ * and with each chunk written by eeprom_Write as it arrives.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_image_bench tools/eeprom_image_bench.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_checksum.c src/eeprom_image.c
+ *
+ * Chunks of 1 to MAX_CHUNK bytes arrive at the link rate; between chunks the application
+ * runs a LOOP_US main loop, calling eeprom_ImagePoll once per iteration.
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_checksum.h"
+#include "eeprom_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_ADDR			0x20000
+#define IMAGE_LEN			(192 * 1024 + 333)
+#define MAX_CHUNK			300
+#define LOOP_US				100
+
+static EepromSim sim;
+static Eeprom eeprom;
+static EepromImageWriter writer;
+static uint8_t image[IMAGE_LEN];
+static uint32_t chunkLens[IMAGE_LEN];
+
+static void setup(uint8_t* mem)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	// Leave old contents in the image region, as after a previous update
+	memset(&mem[IMAGE_ADDR], 0x5a, IMAGE_LEN);
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+}
+
+// Idles in the main loop until the chunk ending at offset has arrived
+static void waitForChunk(uint32_t offset, uint32_t linkBytesPerSec, uint8_t poll)
+{
+	uint64_t arrivalNs = (uint64_t)offset * 1000000000ull / linkBytesPerSec;
+	while(sim.timeNs < arrivalNs)
+	{
+		if(poll)
+		{
+			eeprom_ImagePoll(&writer);
+		}
+		sim.timeNs += LOOP_US * 1000;
+	}
+}
+
+static int run(uint8_t* mem, uint32_t linkBytesPerSec)
+{
+	uint32_t numChunks = 0;
+	srand(2);
+	for(uint32_t offset=0; offset<IMAGE_LEN; numChunks++)
+	{
+		uint32_t len = 1 + ((uint32_t)rand() % MAX_CHUNK);
+		len = (len < IMAGE_LEN - offset) ? len : IMAGE_LEN - offset;
+		chunkLens[numChunks] = len;
+		offset += len;
+	}
+	printf("link %u KB/s (%.1f mS to receive), %u chunks:\n", linkBytesPerSec / 1000,
+			(double)IMAGE_LEN * 1000 / linkBytesPerSec, numChunks);
+
+	// Each chunk written as it arrives, then read back for verification
+	setup(mem);
+	uint32_t offset = 0;
+	for(uint32_t i=0; i<numChunks; i++)
+	{
+		waitForChunk(offset + chunkLens[i], linkBytesPerSec, 0);
+		eeprom_Write(&eeprom, &image[offset], chunkLens[i], IMAGE_ADDR + offset);
+		offset += chunkLens[i];
+	}
+	uint32_t crc;
+	eeprom_ChecksumRange(&eeprom, IMAGE_ADDR, IMAGE_LEN, EepromChecksumCrc32, &crc);
+	int ok = (crc == eeprom_ChecksumEnd(EepromChecksumCrc32, eeprom_ChecksumUpdate(EepromChecksumCrc32,
+			eeprom_ChecksumBegin(EepromChecksumCrc32), image, IMAGE_LEN)));
+	printf("  eeprom_Write per chunk  %8.1f mS  %5u page cycles            %s\n", sim.timeNs / 1e6,
+			sim.pageWrites + sim.pagePrograms, ok ? "verified" : "MISMATCH");
+
+	// Streaming writer
+	setup(mem);
+	eeprom_ImageOpen(&writer, &eeprom, IMAGE_ADDR, IMAGE_LEN);
+	offset = 0;
+	for(uint32_t i=0; i<numChunks; i++)
+	{
+		waitForChunk(offset + chunkLens[i], linkBytesPerSec, 1);
+		eeprom_ImageAppend(&writer, &image[offset], chunkLens[i]);
+		offset += chunkLens[i];
+	}
+	EepromErrorState status = eeprom_ImageFinish(&writer, &crc);
+	ok &= (status == EepromOk);
+	printf("  eeprom_Image            %8.1f mS  %5u page cycles, %u erases  %s (%u pages waited)\n", sim.timeNs / 1e6,
+			sim.pageWrites + sim.pagePrograms, writer.erases, (status == EepromOk) ? "verified" : "MISMATCH", writer.waits);
+	return !ok;
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	for(uint32_t i=0; i<IMAGE_LEN; i++)
+	{
+		image[i] = (uint8_t)rand();
+	}
+	int rc = 0;
+	rc |= run(mem, 100000000);		// Data already in RAM
+	rc |= run(mem, 1000000);		// USB full speed
+	rc |= run(mem, 100000);
+	return rc;
+}
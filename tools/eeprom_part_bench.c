@@ -0,0 +1,135 @@
+/*
+ * eeprom_part_bench.c
+ *
+ * Host tool: compares clearing application regions on the simulated device page by page
+ * (writing 0xff pages), erasing the same regions at hard-coded addresses that have drifted
+ * off the erase geometry, and eeprom_RegionErase on a partition table laid out by
+ * eeprom_PartitionInit. Reports the simulated erase time per region and checks every
+ * region reads back erased.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_part_bench tools/eeprom_part_bench.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_part.c
+ *
+ * The M95M04 has no erase instructions, so every method writes pages there.
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_part.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if EEPROM_DEVICE_SIZE >= (2 * 1024 * 1024)
+#define SAMPLES_SIZE		(1024 * 1024)
+#else
+#define SAMPLES_SIZE		(192 * 1024)
+#endif
+#define DRIFT_START			0x200		// Hard-coded layouts start after a header page
+#define NUM_REGIONS			4
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t erasedPage[EEPROM_PAGE_SIZE];
+
+static void setup(uint8_t* mem)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	// Old contents everywhere, so every method has something to erase
+	memset(mem, 0x5a, EEPROM_DEVICE_SIZE);
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+}
+
+static int erased(const uint8_t* mem, uint32_t addr, uint32_t size)
+{
+	for(uint32_t i=0; i<size; i++)
+	{
+		if(mem[addr + i] != 0xff)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static EepromErrorState clearPages(uint32_t addr, uint32_t size)
+{
+	EepromErrorState status = EepromOk;
+	for(uint32_t offset=0; offset<size && status == EepromOk; offset += EEPROM_PAGE_SIZE)
+	{
+		status = eeprom_Write(&eeprom, erasedPage, EEPROM_PAGE_SIZE, addr + offset);
+	}
+	return status;
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	memset(erasedPage, 0xff, sizeof(erasedPage));
+	EepromRegion regions[NUM_REGIONS] =
+	{
+		{"settings", 6000, EepromAlignPage, 0, 0},
+		{"presets", 200 * 1024, EepromAlignSector, 0, 0},
+		{"samples", SAMPLES_SIZE, EepromAlignBlock, 0, 0},
+		{"calibration", 4096, EepromAlignSector, 0, 0}
+	};
+	EepromPartitionTable table;
+	if(eeprom_PartitionInit(&table, regions, NUM_REGIONS) != EepromOk)
+	{
+		printf("partition layout failed\n");
+		return 1;
+	}
+
+	// The same regions packed back to back on page boundaries, as hard-coded address ranges drift
+	EepromPartitionTable driftTable = {NULL, 0, 0, EEPROM_DEVICE_SIZE, 0, 0};
+	EepromRegion drifted[NUM_REGIONS];
+	uint32_t driftAddr = DRIFT_START;
+	for(uint8_t i=0; i<NUM_REGIONS; i++)
+	{
+		drifted[i] = regions[i];
+		drifted[i].align = EepromAlignPage;
+		drifted[i].start = driftAddr;
+		driftAddr += ((regions[i].size + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE) * EEPROM_PAGE_SIZE;
+	}
+
+	printf("%-12s %8s  %12s  %12s  %12s\n", "region", "KB", "page writes", "drifted", "RegionErase");
+	double totals[3] = {0, 0, 0};
+	int rc = 0;
+	for(uint8_t i=0; i<NUM_REGIONS; i++)
+	{
+		double ms[3];
+		for(uint8_t method=0; method<3; method++)
+		{
+			setup(mem);
+			const EepromRegion* region = (method == 1) ? &drifted[i] : &regions[i];
+			uint32_t size = regions[i].size;
+			uint64_t startNs = sim.timeNs;
+			EepromErrorState status;
+			if(method == 0)
+			{
+				status = clearPages(region->start, size);
+			}
+			else
+			{
+				status = eeprom_RegionErase(&eeprom, (method == 1) ? &driftTable : &table, region);
+			}
+			ms[method] = (sim.timeNs - startNs) / 1e6;
+			totals[method] += ms[method];
+			if(status != EepromOk || !erased(mem, region->start, size))
+			{
+				printf("%s not erased (method %u)\n", region->name, method);
+				rc = 1;
+			}
+		}
+		printf("%-12s %8.1f  %9.1f mS  %9.1f mS  %9.1f mS\n", regions[i].name, regions[i].size / 1024.0, ms[0], ms[1], ms[2]);
+	}
+	printf("%-12s %8s  %9.1f mS  %9.1f mS  %9.1f mS\n", "total", "", totals[0], totals[1], totals[2]);
+	return rc;
+}
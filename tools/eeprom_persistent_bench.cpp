@@ -0,0 +1,182 @@
+/*
+ * eeprom_persistent_bench.cpp
+ *
+ * Host tool: compares persistent variables committed in page batches against writing each
+ * setting with eeprom_Write as it is assigned, on the simulated device, and checks the
+ * committed values load back.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -c src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c
+ *   g++ -O2 -std=c++11 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_persistent_bench \
+ *       tools/eeprom_persistent_bench.cpp src/eeprom_persistent.cpp eeprom.o eeprom_seq.o eeprom_sim.o
+ *
+ * Workload: NUM_COMMITS rounds, each assigning CHANGES_PER_COMMIT randomly chosen settings
+ * (a user editing parameters between saves).
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_persistent.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#define NUM_COMMITS			200
+#define CHANGES_PER_COMMIT	8
+
+struct Params
+{
+	uint8_t values[32];
+};
+
+struct Preset
+{
+	char name[16];
+	uint8_t controls[128];
+	float gains[8];
+};
+
+// 32 byte parameters, then four 176 byte presets. The third would cross the end of the
+// first page, so the layout moves it to the start of the next.
+typedef EepromField<Params, EepromLayoutStart<0x10000> > ParamsField;
+typedef EepromField<Preset, ParamsField> Preset0Field;
+typedef EepromField<Preset, Preset0Field> Preset1Field;
+typedef EepromField<Preset, Preset1Field> Preset2Field;
+typedef EepromField<Preset, Preset2Field> Preset3Field;
+typedef EepromField<float, Preset3Field> VolumeField;
+typedef EepromField<uint32_t, VolumeField> BootCountField;
+
+static_assert(Preset2Field::addr % EEPROM_PAGE_SIZE == 0, "Preset 2 starts a page");
+
+static EepromSim sim;
+static Eeprom eeprom;
+
+struct Settings
+{
+	EepromPersistent<ParamsField> params;
+	EepromPersistent<Preset0Field> preset0;
+	EepromPersistent<Preset1Field> preset1;
+	EepromPersistent<Preset2Field> preset2;
+	EepromPersistent<Preset3Field> preset3;
+	EepromPersistent<VolumeField> volume;
+	EepromPersistent<BootCountField> bootCount;
+
+	explicit Settings(EepromStore& store)
+		: params(store), preset0(store), preset1(store), preset2(store), preset3(store), volume(store), bootCount(store) {}
+};
+
+// Applies one change, and with writeThrough also writes the changed bytes at once
+static void change(Settings& settings, uint32_t which, uint32_t value, bool writeThrough)
+{
+	switch(which % 6)
+	{
+		case 0:
+		{
+			uint8_t index = (uint8_t)(value % 32);
+			settings.params.update([&](Params& params) { params.values[index] = (uint8_t)value; });
+			if(writeThrough)
+			{
+				eeprom_Write(&eeprom, (uint8_t*)&settings.params.get().values[index], 1, ParamsField::addr + index);
+			}
+			break;
+		}
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+		{
+			uint8_t control = (uint8_t)(value % 128);
+			uint32_t addr;
+			const Preset* preset;
+			auto edit = [&](Preset& p) { p.controls[control] = (uint8_t)value; };
+			switch(which % 6)
+			{
+				case 1: settings.preset0.update(edit); preset = &settings.preset0.get(); addr = Preset0Field::addr; break;
+				case 2: settings.preset1.update(edit); preset = &settings.preset1.get(); addr = Preset1Field::addr; break;
+				case 3: settings.preset2.update(edit); preset = &settings.preset2.get(); addr = Preset2Field::addr; break;
+				default: settings.preset3.update(edit); preset = &settings.preset3.get(); addr = Preset3Field::addr; break;
+			}
+			if(writeThrough)
+			{
+				eeprom_Write(&eeprom, (uint8_t*)&preset->controls[control], 1, addr + offsetof(Preset, controls) + control);
+			}
+			break;
+		}
+		default:
+			settings.volume = (float)value;
+			if(writeThrough)
+			{
+				float volume = settings.volume;
+				eeprom_Write(&eeprom, (uint8_t*)&volume, sizeof(volume), VolumeField::addr);
+			}
+			break;
+	}
+}
+
+static void run(const char* name, uint8_t* mem, bool writeThrough)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+	EepromStore store(&eeprom);
+	Settings settings(store);
+	store.load();
+
+	srand(1);
+	uint32_t calls = 0;
+	uint64_t startNs = sim.timeNs;
+	uint32_t startCycles = sim.pageWrites;
+	for(uint32_t i=0; i<NUM_COMMITS; i++)
+	{
+		for(uint32_t j=0; j<CHANGES_PER_COMMIT; j++)
+		{
+			uint32_t which = (uint32_t)rand();
+			change(settings, which, (uint32_t)rand(), writeThrough);
+			calls += writeThrough ? 1 : 0;
+		}
+		if(!writeThrough)
+		{
+			store.commit();
+		}
+	}
+	if(!writeThrough)
+	{
+		calls = store.writes;
+	}
+	printf("%-22s %5.2f writes per commit  %5.2f page cycles per commit  %7.2f mS per commit\n", name,
+			(double)calls / NUM_COMMITS, (double)(sim.pageWrites - startCycles) / NUM_COMMITS,
+			(sim.timeNs - startNs) / 1e6 / NUM_COMMITS);
+}
+
+int main(void)
+{
+	uint8_t* mem = (uint8_t*)malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	printf("%u changes per commit, layout 0x%x to 0x%x\n", CHANGES_PER_COMMIT, ParamsField::addr, BootCountField::end);
+	run("eeprom_Write per change", mem, true);
+	run("EepromStore::commit", mem, false);
+
+	// The committed values must load back into a fresh set of variables
+	int rc = 0;
+	{
+		EepromStore store(&eeprom);
+		Settings before(store);
+		store.load();
+		before.bootCount = before.bootCount + 1;
+		before.volume = 0.5f;
+		store.commit();
+		EepromStore reloadStore(&eeprom);
+		Settings after(reloadStore);
+		reloadStore.load();
+		rc = memcmp(&before.preset3.get(), &after.preset3.get(), sizeof(Preset)) != 0
+				|| memcmp(&before.params.get(), &after.params.get(), sizeof(Params)) != 0
+				|| after.volume != 0.5f || after.bootCount != before.bootCount;
+		printf("reload:                %s (%u writes for the last commit)\n", rc ? "MISMATCH" : "match", store.writes);
+	}
+	return rc;
+}
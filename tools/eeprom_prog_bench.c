@@ -0,0 +1,124 @@
+/*
+ * eeprom_prog_bench.c
+ *
+ * Host tool: measures production programming time on the simulated device, loading a
+ * default image (with some all 0xff sectors and pages) over old contents, with an
+ * eeprom_Write and eeprom_Read loop and with eeprom_ProgImage in each verification mode.
+ * Reports the time per MB of image, and checks a corrupted byte is caught by each mode.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_prog_bench tools/eeprom_prog_bench.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_checksum.c src/eeprom_prog.c
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_checksum.h"
+#include "eeprom_prog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_ADDR			0
+#define IMAGE_MAX			(1024 * 1024)
+#define IMAGE_LEN			((EEPROM_DEVICE_SIZE < IMAGE_MAX) ? EEPROM_DEVICE_SIZE - 333 : IMAGE_MAX - 333)
+#define NUM_SECTORS			((IMAGE_LEN + EEPROM_CHECKSUM_SECTOR_SIZE - 1) / EEPROM_CHECKSUM_SECTOR_SIZE)
+#define NAIVE_CHUNK			512
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t image[IMAGE_LEN];
+static uint8_t readBack[NAIVE_CHUNK];
+static uint8_t sectorMap[(NUM_SECTORS + 7) / 8];
+static uint32_t sectorCrc[NUM_SECTORS];
+
+static void setup(uint8_t* mem)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	// Leave old contents on the device, as on a unit being reprogrammed
+	memset(mem, 0x5a, EEPROM_DEVICE_SIZE);
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+}
+
+static void report(const char* name, EepromErrorState status, uint32_t erases)
+{
+	double ms = sim.timeNs / 1e6;
+	printf("  %-30s %9.1f mS  %8.1f mS/MB  %5u page cycles  %4u erases  %s\n", name, ms,
+			ms * (1024.0 * 1024.0) / IMAGE_LEN, sim.pageWrites + sim.pagePrograms, erases,
+			(status == EepromOk) ? "verified" : "FAILED");
+}
+
+// Corrupts one programmed byte and checks verification reports it
+static int checkCorruption(uint8_t* mem, const EepromProgImage* progImage, uint8_t flags)
+{
+	uint32_t addr = IMAGE_LEN / 2 + 17;
+	mem[IMAGE_ADDR + addr] ^= 0x01;
+	EepromProgResult result;
+	EepromErrorState status = eeprom_ProgVerify(&eeprom, progImage, flags, &result);
+	mem[IMAGE_ADDR + addr] ^= 0x01;
+	uint32_t expected = (flags & EEPROM_PROG_VERIFY_CHECKSUM)
+			? IMAGE_ADDR + (addr / EEPROM_CHECKSUM_SECTOR_SIZE) * EEPROM_CHECKSUM_SECTOR_SIZE : IMAGE_ADDR + addr;
+	if(status != EepromDeviceError || result.mismatchAddr != expected)
+	{
+		printf("    corrupted byte at 0x%06x not reported (0x%08x)\n", IMAGE_ADDR + addr, result.mismatchAddr);
+		return 1;
+	}
+	return 0;
+}
+
+static int runProg(uint8_t* mem, const char* name, const EepromProgImage* progImage, uint8_t flags)
+{
+	setup(mem);
+	EepromProgResult result;
+	EepromErrorState status = eeprom_ProgImage(&eeprom, progImage, flags, &result);
+	report(name, status, result.erases);
+	return (status != EepromOk) | checkCorruption(mem, progImage, flags);
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	// Random data, with every fourth sector and every third page of the rest left blank
+	for(uint32_t i=0; i<IMAGE_LEN; i++)
+	{
+		uint32_t sector = i / EEPROM_CHECKSUM_SECTOR_SIZE;
+		uint32_t page = i / EEPROM_PAGE_SIZE;
+		image[i] = ((sector % 4) == 3 || (page % 3) == 2) ? 0xff : (uint8_t)rand();
+	}
+	eeprom_ProgBuildMap(image, IMAGE_LEN, sectorMap, sectorCrc);
+	EepromProgImage progImage = {IMAGE_ADDR, IMAGE_LEN, image, sectorMap, sectorCrc};
+	printf("%u byte image, %u sectors:\n", IMAGE_LEN, NUM_SECTORS);
+
+	// eeprom_Write and eeprom_Read loop
+	setup(mem);
+	EepromErrorState status = EepromOk;
+	for(uint32_t offset=0; offset<IMAGE_LEN && status == EepromOk; offset += NAIVE_CHUNK)
+	{
+		uint32_t len = (IMAGE_LEN - offset < NAIVE_CHUNK) ? IMAGE_LEN - offset : NAIVE_CHUNK;
+		status = eeprom_Write(&eeprom, &image[offset], len, IMAGE_ADDR + offset);
+	}
+	for(uint32_t offset=0; offset<IMAGE_LEN && status == EepromOk; offset += NAIVE_CHUNK)
+	{
+		uint32_t len = (IMAGE_LEN - offset < NAIVE_CHUNK) ? IMAGE_LEN - offset : NAIVE_CHUNK;
+		status = eeprom_Read(&eeprom, readBack, len, IMAGE_ADDR + offset);
+		if(status == EepromOk && memcmp(readBack, &image[offset], len) != 0)
+		{
+			status = EepromDeviceError;
+		}
+	}
+	report("eeprom_Write + eeprom_Read", status, 0);
+	int rc = (status != EepromOk);
+
+	rc |= runProg(mem, "eeprom_ProgImage", &progImage, 0);
+	rc |= runProg(mem, "eeprom_ProgImage, checksums", &progImage, EEPROM_PROG_VERIFY_CHECKSUM);
+#if defined(M95P32)
+	rc |= runProg(mem, "eeprom_ProgImage, chip erase", &progImage, EEPROM_PROG_CHIP_ERASE | EEPROM_PROG_VERIFY_CHECKSUM);
+#endif
+	return rc;
+}
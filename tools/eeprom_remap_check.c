@@ -0,0 +1,228 @@
+/*
+ * eeprom_remap_check.c
+ *
+ * Host tool: exercises page retirement on the simulated device with injected page
+ * failures. The same series of saves, each changing bytes in the failing pages, is timed
+ * with plain eeprom_Write and with eeprom_RemapWrite, on a healthy device and with the
+ * pages failing, so the cost of repeated failures, and of the M95P32 safety register read
+ * (RDCR) eeprom_RemapWrite issues after every page, can be compared. A second run checks
+ * that retirement merges the old page contents into the spare (the first save after the
+ * failures only rewrites part of each failing page), that the data reads back and that
+ * the table restores the mapping.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_remap_check tools/eeprom_remap_check.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_remap.c
+ *
+ * Usage: eeprom_remap_check [-t]
+ *   -t    failing cycles hold WIP past the ready timeout (default: PRF/ERF flags)
+ *
+ * Only the M95P32 reports failed cycles in its safety register. Other devices only detect
+ * timeouts, so the check always runs in -t mode there.
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_remap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_PAGES			64
+#define SPARE_START			NUM_PAGES
+#define NUM_SPARES			8
+#define TABLE_PAGE			(SPARE_START + NUM_SPARES)
+#define SAVE_LEN			(16 * EEPROM_PAGE_SIZE)
+#define NUM_SAVES			5
+#define SAVE_ADDR			(EEPROM_PAGE_SIZE / 2)
+#define SAVE_PAGES			((SAVE_LEN / EEPROM_PAGE_SIZE) + 1)		// The save starts mid page
+#define PATCH_LEN			32
+
+static EepromSim sim;
+static Eeprom eeprom;
+static EepromRemap remap;
+static uint16_t map[NUM_PAGES];
+static uint8_t failPages[EEPROM_SIM_NUM_PAGES / 8];
+static uint8_t initial[SAVE_LEN];
+static uint8_t saveBuf[SAVE_LEN];
+static uint8_t readBuf[SAVE_LEN];
+static uint8_t failMode;
+
+static const uint32_t failing[] = {3, 9};
+#define NUM_FAILING			(sizeof(failing) / sizeof(failing[0]))
+
+// Offset into the save of a byte in a logical page
+static uint32_t pageOffset(uint32_t page, uint32_t byte)
+{
+	return (page * EEPROM_PAGE_SIZE) + byte - SAVE_ADDR;
+}
+
+/**
+  * @brief 	Starts a run from the same initial contents. With fail set, the failing pages
+  * (and the first spare) start failing once the initial contents are written.
+  */
+static int setup(uint8_t* mem, uint8_t fail)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	memset(failPages, 0, sizeof(failPages));
+	sim.failPages = failPages;
+	sim.failMode = failMode;
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	memset(map, 0, sizeof(map));
+	memcpy(saveBuf, initial, SAVE_LEN);
+	if(eeprom_Init(&eeprom) != EepromOk || eeprom_RemapInit(&remap, &eeprom, map, NUM_PAGES, SPARE_START, NUM_SPARES, TABLE_PAGE) != EepromOk
+			|| eeprom_RemapWrite(&remap, saveBuf, SAVE_LEN, SAVE_ADDR) != EepromOk)
+	{
+		fprintf(stderr, "init failed\n");
+		return 1;
+	}
+	if(fail)
+	{
+		for(uint8_t i=0; i<NUM_FAILING; i++)
+		{
+			failPages[failing[i] / 8] |= (uint8_t)(1 << (failing[i] % 8));
+		}
+		failPages[SPARE_START / 8] |= (uint8_t)(1 << (SPARE_START % 8));
+	}
+	return 0;
+}
+
+// Changes PATCH_LEN bytes in each failing page, at a different place for each save
+static void changeFailingPages(uint8_t save)
+{
+	for(uint8_t i=0; i<NUM_FAILING; i++)
+	{
+		uint32_t offset = pageOffset(failing[i], (EEPROM_PAGE_SIZE / 4) + (save * PATCH_LEN));
+		for(uint32_t k=0; k<PATCH_LEN; k++)
+		{
+			saveBuf[offset + k] ^= 0xa5;
+		}
+	}
+}
+
+/**
+  * @brief 	Times NUM_SAVES full saves. Plain saves write page by page and carry on past
+  * failed pages, as an application without remapping would.
+  * @retval	Pages whose contents were lost in the last save
+  */
+static uint32_t timeSaves(uint8_t* mem, const char* name, uint8_t useRemap, uint8_t fail, double* totalMs)
+{
+	if(setup(mem, fail))
+	{
+		exit(1);
+	}
+	printf("%-28s", name);
+	*totalMs = 0;
+	for(uint8_t i=0; i<NUM_SAVES; i++)
+	{
+		changeFailingPages(i);
+		uint64_t startNs = sim.timeNs;
+		if(useRemap)
+		{
+			eeprom_RemapWrite(&remap, saveBuf, SAVE_LEN, SAVE_ADDR);
+		}
+		else
+		{
+			for(uint32_t offset=0; offset<SAVE_LEN;)
+			{
+				uint32_t n = EEPROM_PAGE_SIZE - ((SAVE_ADDR + offset) % EEPROM_PAGE_SIZE);
+				n = (n < SAVE_LEN - offset) ? n : SAVE_LEN - offset;
+				eeprom_Write(&eeprom, &saveBuf[offset], n, SAVE_ADDR + offset);
+				offset += n;
+			}
+		}
+		double ms = (sim.timeNs - startNs) / 1e6;
+		*totalMs += ms;
+		printf(" %7.2f", ms);
+	}
+	uint32_t lost = 0;
+	for(uint32_t page=0; page<SAVE_PAGES; page++)
+	{
+		uint32_t start = (page == 0) ? 0 : pageOffset(page, 0);
+		uint32_t end = (page == SAVE_PAGES - 1) ? SAVE_LEN : pageOffset(page + 1, 0);
+		uint32_t addr = SAVE_ADDR + start;
+		if(useRemap)
+		{
+			eeprom_RemapRead(&remap, readBuf, end - start, addr);
+		}
+		else
+		{
+			eeprom_Read(&eeprom, readBuf, end - start, addr);
+		}
+		lost += (memcmp(readBuf, &saveBuf[start], end - start) != 0);
+	}
+	printf("  %7.2f mS  %u pages lost\n", *totalMs, lost);
+	return lost;
+}
+
+int main(int argc, char** argv)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+#if defined(M95P32)
+	failMode = (argc > 1 && strcmp(argv[1], "-t") == 0) ? EepromSimFailTimeout : EepromSimFailFlag;
+#else
+	(void)argc;
+	(void)argv;
+	printf("no safety register: only timeouts are detected\n");
+	failMode = EepromSimFailTimeout;
+#endif
+	for(uint32_t i=0; i<SAVE_LEN; i++)
+	{
+		initial[i] = (uint8_t)rand();
+	}
+
+	// The same saves with and without remapping, on a healthy device and with failing pages
+	printf("%u saves of %u pages, pages %u and %u failing, mS per save:\n", NUM_SAVES, SAVE_PAGES, failing[0], failing[1]);
+	double plainHealthyMs, plainFailingMs, remapHealthyMs, remapFailingMs;
+	int rc = 0;
+	rc |= (timeSaves(mem, "eeprom_Write, healthy", 0, 0, &plainHealthyMs) != 0);
+	timeSaves(mem, "eeprom_Write, failing", 0, 1, &plainFailingMs);
+	rc |= (timeSaves(mem, "eeprom_RemapWrite, healthy", 1, 0, &remapHealthyMs) != 0);
+	rc |= (timeSaves(mem, "eeprom_RemapWrite, failing", 1, 1, &remapFailingMs) != 0);
+	printf("failures cost %.2f mS without remapping, %.2f mS with it; remap checks cost %.1f uS per page\n",
+			plainFailingMs - plainHealthyMs, remapFailingMs - remapHealthyMs,
+			(remapHealthyMs - plainHealthyMs) * 1e3 / (NUM_SAVES * SAVE_PAGES));
+
+	// Retirement merges the old page contents when only part of a failing page is written
+	if(setup(mem, 1))
+	{
+		return 1;
+	}
+	changeFailingPages(0);
+	EepromErrorState status = EepromOk;
+	for(uint8_t i=0; i<NUM_FAILING && status == EepromOk; i++)
+	{
+		uint32_t offset = pageOffset(failing[i], EEPROM_PAGE_SIZE / 4);
+		status = eeprom_RemapWrite(&remap, &saveBuf[offset], PATCH_LEN, SAVE_ADDR + offset);
+	}
+	changeFailingPages(1);
+	if(status == EepromOk)
+	{
+		status = eeprom_RemapWrite(&remap, saveBuf, SAVE_LEN, SAVE_ADDR);
+	}
+	rc |= (status != EepromOk);
+	eeprom_RemapRead(&remap, readBuf, SAVE_LEN, SAVE_ADDR);
+	int match = (status == EepromOk && memcmp(saveBuf, readBuf, SAVE_LEN) == 0);
+	printf("partial write, read back: %s (%u pages retired, %u spares used)\n", match ? "match" : "MISMATCH",
+			remap.retired, remap.sparesUsed);
+	rc |= !match;
+
+	// The table must restore the same mapping after a restart
+	memset(map, 0, sizeof(map));
+	eeprom_RemapInit(&remap, &eeprom, map, NUM_PAGES, SPARE_START, NUM_SPARES, TABLE_PAGE);
+	eeprom_RemapRead(&remap, readBuf, SAVE_LEN, SAVE_ADDR);
+	match = (memcmp(saveBuf, readBuf, SAVE_LEN) == 0);
+	printf("after reload:             %s (page %u -> %u, page %u -> %u)\n", match ? "match" : "MISMATCH",
+			failing[0], map[failing[0]], failing[1], map[failing[1]]);
+	rc |= !match;
+	for(uint8_t i=0; i<NUM_FAILING; i++)
+	{
+		rc |= (map[failing[i]] < SPARE_START);
+	}
+	return rc;
+}
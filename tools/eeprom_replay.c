@@ -0,0 +1,298 @@
+/*
+ * eeprom_replay.c
+ *
+ * Host tool: replays a captured operation trace (eeprom_TraceExport output) against the
+ * simulated device and reports time, program/erase cycles, write amplification and wear.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_replay tools/eeprom_replay.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_trace.c
+ *
+ * Usage: eeprom_replay [options] trace.bin
+ *   -c <Hz>     SCK rate (default 10 MHz)
+ *   -o <nS>     software overhead per transport call (default 1000)
+ *   -b          use the burst transport (segment lists in one call)
+ *   -r          keep the captured gaps between calls (idle time) instead of back to back
+ *   -w <file>   write per-page wear as CSV (page,address,cycles)
+ *   -t <n>      number of most worn pages to list (default 10)
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_TRACE_OPS		(EepromTraceProgram + 1)
+
+typedef struct
+{
+	uint32_t calls;
+	uint32_t failed;
+	uint64_t bytes;
+	uint64_t timeNs;
+	uint64_t maxNs;
+} OpStats;
+
+static const char* opNames[NUM_TRACE_OPS] = {"read", "write", "erase page", "erase sector", "erase block", "erase chip", "program"};
+
+static uint8_t* loadFile(const char* path, long* size);
+static EepromErrorState replayRecord(Eeprom* eeprom, const EepromTraceRecord* record, uint8_t* buf);
+static int compareWear(const void* a, const void* b);
+
+static uint32_t* wearSorted;
+
+int main(int argc, char** argv)
+{
+	uint32_t clockHz = 0;
+	uint32_t overheadNs = 0;
+	uint8_t burst = 0;
+	uint8_t realtime = 0;
+	const char* wearPath = NULL;
+	uint32_t top = 10;
+	int opt;
+	while((opt = getopt(argc, argv, "c:o:brw:t:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'c': clockHz = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'o': overheadNs = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'b': burst = 1; break;
+			case 'r': realtime = 1; break;
+			case 'w': wearPath = optarg; break;
+			case 't': top = (uint32_t)strtoul(optarg, NULL, 0); break;
+			default:
+				fprintf(stderr, "usage: %s [-c Hz] [-o nS] [-b] [-r] [-w wear.csv] [-t n] trace.bin\n", argv[0]);
+				return 2;
+		}
+	}
+	if(optind >= argc)
+	{
+		fprintf(stderr, "usage: %s [-c Hz] [-o nS] [-b] [-r] [-w wear.csv] [-t n] trace.bin\n", argv[0]);
+		return 2;
+	}
+
+	long size;
+	uint8_t* trace = loadFile(argv[optind], &size);
+	uint32_t numRecords, lost;
+	if(trace == NULL || size < EEPROM_TRACE_HEADER_SIZE || !eeprom_TraceDecodeHeader(trace, &numRecords, &lost))
+	{
+		fprintf(stderr, "%s: not a trace file\n", argv[optind]);
+		return 1;
+	}
+	if((uint64_t)EEPROM_TRACE_HEADER_SIZE + ((uint64_t)numRecords * EEPROM_TRACE_RECORD_SIZE) > (uint64_t)size)
+	{
+		fprintf(stderr, "%s: truncated trace\n", argv[optind]);
+		return 1;
+	}
+
+	static EepromSim sim;
+	static Eeprom eeprom;
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	uint32_t* wear = malloc(EEPROM_SIM_NUM_PAGES * sizeof(uint32_t));
+	uint8_t* buf = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL || wear == NULL || buf == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	eeprom_SimInit(&sim, mem, wear);
+	if(clockHz != 0)
+	{
+		sim.spiClockHz = clockHz;
+	}
+	if(overheadNs != 0)
+	{
+		sim.callOverheadNs = overheadNs;
+	}
+	eeprom.transport = burst ? &eepromTransportSimBurst : &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	if(eeprom_Init(&eeprom) != EepromOk)
+	{
+		fprintf(stderr, "simulator init failed\n");
+		return 1;
+	}
+
+	OpStats stats[NUM_TRACE_OPS];
+	memset(stats, 0, sizeof(stats));
+	uint32_t skipped = 0;
+	uint32_t mismatched = 0;
+	uint64_t startNs = sim.timeNs;
+	uint64_t ioNs = 0;
+	uint32_t firstTimestamp = 0;
+	for(uint32_t i=0; i<numRecords; i++)
+	{
+		EepromTraceRecord record;
+		eeprom_TraceDecodeRecord(&trace[EEPROM_TRACE_HEADER_SIZE + (i * EEPROM_TRACE_RECORD_SIZE)], &record);
+		if(record.op >= NUM_TRACE_OPS || record.len > EEPROM_DEVICE_SIZE)
+		{
+			skipped++;
+			continue;
+		}
+		if(i == 0)
+		{
+			firstTimestamp = record.timestamp;
+		}
+		if(realtime)
+		{
+			// Calls never start before their captured time; late ones start immediately
+			uint64_t due = startNs + ((uint64_t)(record.timestamp - firstTimestamp) * 1000000);
+			if(sim.timeNs < due)
+			{
+				eeprom_SimIdle(&sim, due - sim.timeNs);
+			}
+		}
+		uint64_t callStart = sim.timeNs;
+		EepromErrorState result = replayRecord(&eeprom, &record, buf);
+		uint64_t callNs = sim.timeNs - callStart;
+
+		OpStats* op = &stats[record.op];
+		op->calls++;
+		op->bytes += record.len;
+		op->timeNs += callNs;
+		if(callNs > op->maxNs)
+		{
+			op->maxNs = callNs;
+		}
+		if(result != EepromOk)
+		{
+			op->failed++;
+		}
+		if((uint8_t)result != record.result)
+		{
+			mismatched++;
+		}
+		ioNs += callNs;
+	}
+
+	// Physical array bytes cycled versus bytes the application asked to write
+	uint64_t cycledBytes = ((uint64_t)sim.pageWrites + sim.pagePrograms + sim.pageErases) * EEPROM_PAGE_SIZE;
+#if defined(M95P32)
+	cycledBytes += ((uint64_t)sim.sectorErases * EEPROM_SECTOR_SIZE) + ((uint64_t)sim.blockErases * EEPROM_BLOCK_SIZE)
+			+ ((uint64_t)sim.chipErases * EEPROM_DEVICE_SIZE);
+#endif
+
+	printf("trace            %s: %u records, %u lost before export, %u skipped\n", argv[optind], numRecords, lost, skipped);
+	printf("transport        %s, SCK %u Hz, %u nS per call\n", burst ? "burst" : "per segment", sim.spiClockHz, sim.callOverheadNs);
+	printf("\n%-14s %9s %7s %12s %12s %12s\n", "op", "calls", "failed", "bytes", "mean uS", "max uS");
+	for(uint8_t i=0; i<NUM_TRACE_OPS; i++)
+	{
+		if(stats[i].calls == 0)
+		{
+			continue;
+		}
+		printf("%-14s %9u %7u %12llu %12.1f %12.1f\n", opNames[i], stats[i].calls, stats[i].failed,
+				(unsigned long long)stats[i].bytes, (stats[i].timeNs / 1000.0) / stats[i].calls, stats[i].maxNs / 1000.0);
+	}
+	printf("\nI/O time         %.3f mS\n", ioNs / 1e6);
+	printf("total time       %.3f mS\n", (sim.timeNs - startNs) / 1e6);
+	printf("transport calls  %u\n", sim.calls);
+	printf("bus bytes        %llu\n", (unsigned long long)sim.busBytes);
+	printf("page writes      %u\n", sim.pageWrites);
+	printf("page programs    %u\n", sim.pagePrograms);
+	printf("erases           page %u, sector %u, block %u, chip %u\n", sim.pageErases, sim.sectorErases, sim.blockErases, sim.chipErases);
+	uint64_t writtenBytes = stats[EepromTraceWrite].bytes + stats[EepromTraceProgram].bytes;
+	if(writtenBytes > 0)
+	{
+		printf("write amp        %.2f (array bytes cycled / bytes written)\n", (double)cycledBytes / writtenBytes);
+	}
+	printf("result mismatch  %u (replayed result differs from captured)\n", mismatched);
+
+	// Wear summary
+	uint32_t* order = malloc(EEPROM_SIM_NUM_PAGES * sizeof(uint32_t));
+	uint64_t totalWear = 0;
+	uint32_t wornPages = 0;
+	for(uint32_t i=0; i<EEPROM_SIM_NUM_PAGES; i++)
+	{
+		order[i] = i;
+		totalWear += wear[i];
+		wornPages += (wear[i] != 0);
+	}
+	wearSorted = wear;
+	qsort(order, EEPROM_SIM_NUM_PAGES, sizeof(uint32_t), compareWear);
+	printf("\npages cycled     %u of %u, mean %.2f cycles over cycled pages\n", wornPages, (uint32_t)EEPROM_SIM_NUM_PAGES,
+			wornPages ? (double)totalWear / wornPages : 0.0);
+	for(uint32_t i=0; i<top && i<EEPROM_SIM_NUM_PAGES && wear[order[i]] != 0; i++)
+	{
+		printf("  page %5u  0x%06x  %u cycles\n", order[i], order[i] * EEPROM_PAGE_SIZE, wear[order[i]]);
+	}
+	if(wearPath != NULL)
+	{
+		FILE* f = fopen(wearPath, "w");
+		if(f == NULL)
+		{
+			fprintf(stderr, "%s: cannot write\n", wearPath);
+			return 1;
+		}
+		fprintf(f, "page,address,cycles\n");
+		for(uint32_t i=0; i<EEPROM_SIM_NUM_PAGES; i++)
+		{
+			fprintf(f, "%u,%u,%u\n", i, i * EEPROM_PAGE_SIZE, wear[i]);
+		}
+		fclose(f);
+	}
+	return 0;
+}
+
+static uint8_t* loadFile(const char* path, long* size)
+{
+	FILE* f = fopen(path, "rb");
+	if(f == NULL)
+	{
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t* data = malloc(*size > 0 ? *size : 1);
+	if(data != NULL && fread(data, 1, *size, f) != (size_t)*size)
+	{
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+/**
+  * @brief 	Issues the driver call for one record. Written data is a fill pattern; the
+  * trace does not capture contents.
+  */
+static EepromErrorState replayRecord(Eeprom* eeprom, const EepromTraceRecord* record, uint8_t* buf)
+{
+	switch(record->op)
+	{
+		case EepromTraceRead:
+			return eeprom_Read(eeprom, buf, record->len, record->addr);
+		case EepromTraceWrite:
+			memset(buf, (uint8_t)record->addr, record->len);
+			return eeprom_Write(eeprom, buf, record->len, record->addr);
+		case EepromTraceProgram:
+			memset(buf, (uint8_t)record->addr, record->len);
+			return eeprom_ProgramPage(eeprom, buf, record->len, record->addr);
+	#if defined(M95P32)
+		case EepromTraceErasePage:
+			return eeprom_ErasePage(eeprom, record->addr);
+		case EepromTraceEraseSector:
+			return eeprom_EraseSector(eeprom, record->addr);
+		case EepromTraceEraseBlock:
+			return eeprom_EraseBlock(eeprom, record->addr);
+		case EepromTraceEraseChip:
+			return eeprom_EraseChip(eeprom);
+	#else
+		case EepromTraceEraseChip:
+			return eeprom_EraseAll(eeprom);
+	#endif
+		default:
+			return EepromStorageError;
+	}
+}
+
+static int compareWear(const void* a, const void* b)
+{
+	uint32_t wa = wearSorted[*(const uint32_t*)a];
+	uint32_t wb = wearSorted[*(const uint32_t*)b];
+	return (wa < wb) - (wa > wb);
+}
@@ -0,0 +1,160 @@
+/*
+ * eeprom_sched_bench.c
+ *
+ * Host tool: measures read latency under a mixed workload on the simulated device, with
+ * blocking driver calls and with the I/O scheduler.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_sched_bench tools/eeprom_sched_bench.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c src/eeprom_sched.c
+ *
+ * Workload: a low priority WRITE_LEN byte save and a normal priority ERASE_LEN byte erase
+ * are queued at the start; a high priority READ_LEN byte read with a READ_DEADLINE_MS
+ * deadline arrives every READ_PERIOD_US until the background work is done.
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WRITE_LEN			65536
+#define ERASE_LEN			16384
+#define READ_LEN			256
+#define READ_PERIOD_US		3000
+#define READ_DEADLINE_MS	10
+#define LOOP_US				50			// Application work per main loop iteration
+
+typedef struct
+{
+	uint32_t reads;
+	uint32_t misses;
+	uint64_t maxNs;
+	uint64_t totalNs;
+	uint64_t endNs;
+} Result;
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t writeBuf[WRITE_LEN];
+static uint8_t readBuf[READ_LEN];
+
+static void setup(uint8_t* mem)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+}
+
+static void recordRead(Result* result, uint64_t arrivalNs)
+{
+	uint64_t latency = sim.timeNs - arrivalNs;
+	result->reads++;
+	result->totalNs += latency;
+	if(latency > result->maxNs)
+	{
+		result->maxNs = latency;
+	}
+	if(latency > (uint64_t)READ_DEADLINE_MS * 1000000)
+	{
+		result->misses++;
+	}
+}
+
+/**
+  * @brief 	Blocking driver calls: reads that arrive during the save wait for all of it.
+  */
+static void runBlocking(Result* result)
+{
+	uint64_t nextReadNs = sim.timeNs;
+	eeprom_Write(&eeprom, writeBuf, WRITE_LEN, 0);
+#if defined(M95P32)
+	for(uint32_t addr = WRITE_LEN; addr < WRITE_LEN + ERASE_LEN; addr += EEPROM_SECTOR_SIZE)
+	{
+		eeprom_EraseSector(&eeprom, addr);
+	}
+#else
+	eeprom_Write(&eeprom, writeBuf, ERASE_LEN, WRITE_LEN);
+#endif
+	uint64_t doneNs = sim.timeNs;
+	// Serve the reads that queued up behind the save, in arrival order
+	while(nextReadNs < doneNs)
+	{
+		eeprom_Read(&eeprom, readBuf, READ_LEN, WRITE_LEN * 2);
+		recordRead(result, nextReadNs);
+		nextReadNs += (uint64_t)READ_PERIOD_US * 1000;
+	}
+	result->endNs = sim.timeNs;
+}
+
+/**
+  * @brief 	Scheduler: reads are served between page write and erase units.
+  */
+static void runScheduled(Result* result)
+{
+	EepromScheduler sched;
+	eeprom_SchedInit(&sched, &eeprom);
+	EepromRequest save = {.op = EepromReqWrite, .priority = EepromPriorityLow, .pData = writeBuf, .addr = 0, .len = WRITE_LEN};
+	EepromRequest erase = {.op = EepromReqErase, .priority = EepromPriorityNormal, .addr = WRITE_LEN, .len = ERASE_LEN};
+	EepromRequest read = {.op = EepromReqRead, .priority = EepromPriorityHigh, .pData = readBuf, .addr = WRITE_LEN * 2,
+			.len = READ_LEN, .deadlineMs = READ_DEADLINE_MS};
+	eeprom_SchedSubmit(&sched, &save);
+	eeprom_SchedSubmit(&sched, &erase);
+
+	uint64_t nextReadNs = sim.timeNs;
+	uint64_t arrivalNs = 0;
+	while(save.pending || erase.pending || read.pending)
+	{
+		if(!read.pending && (save.pending || erase.pending) && sim.timeNs >= nextReadNs)
+		{
+			arrivalNs = sim.timeNs;
+			eeprom_SchedSubmit(&sched, &read);
+			nextReadNs += (uint64_t)READ_PERIOD_US * 1000;
+		}
+		uint8_t wasPending = read.pending;
+		eeprom_SchedPoll(&sched);
+		if(wasPending && !read.pending)
+		{
+			recordRead(result, arrivalNs);
+		}
+		eeprom_SimIdle(&sim, LOOP_US * 1000);
+	}
+	result->endNs = sim.timeNs;
+}
+
+static void report(const char* name, const Result* result)
+{
+	printf("%-10s reads %4u  mean %9.1f uS  worst %9.1f uS  deadline misses %4u  background done %8.1f mS\n",
+			name, result->reads, result->reads ? (result->totalNs / 1000.0) / result->reads : 0.0,
+			result->maxNs / 1000.0, result->misses, result->endNs / 1e6);
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	for(uint32_t i=0; i<WRITE_LEN; i++)
+	{
+		writeBuf[i] = (uint8_t)(i * 31);
+	}
+	Result blocking, scheduled;
+	memset(&blocking, 0, sizeof(blocking));
+	memset(&scheduled, 0, sizeof(scheduled));
+
+	setup(mem);
+	runBlocking(&blocking);
+	setup(mem);
+	runScheduled(&scheduled);
+
+	printf("%u byte save + %u byte erase, %u byte read every %u uS (deadline %u mS), SCK %u Hz\n",
+			WRITE_LEN, ERASE_LEN, READ_LEN, READ_PERIOD_US, READ_DEADLINE_MS, sim.spiClockHz);
+	report("blocking", &blocking);
+	report("scheduled", &scheduled);
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * eeprom_seq_bench.c
+ *
+ * Host tool: models page writes on the simulated device with the instruction sequence the
+ * driver used before the sequence engine (separate WREN, WRITE and RDSR transactions,
+ * the payload copied behind the header), with eeprom_SeqRun over a per-segment and a
+ * segment list transport, and with eeprom_SeqStart driven by transfer completions and a
+ * 1 mS tick. Reports, per page write, transport calls, the gaps between transactions
+ * while the device is idle, CPU time and the delay from the end of the write cycle until
+ * it is seen, and checks the data was written.
+ *
+ * CPU time model: blocking calls keep the CPU busy for their call overhead and bus time
+ * (so ready polling costs the whole write cycle), an asynchronous transfer costs one call
+ * overhead to start and one for its completion interrupt, and the old code's copy costs
+ * COPY_NS_PER_BYTE.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -DEEPROM_SEQ_DMA -Iinclude -Isrc -o eeprom_seq_bench \
+ *       tools/eeprom_seq_bench.c src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_seq.h"
+#include "eeprom_m95.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef EEPROM_SEQ_DMA
+#error "eeprom_seq_bench needs EEPROM_SEQ_DMA defined"
+#endif
+
+#define NUM_PAGES			64
+#define WRITE_ADDR			0x10000
+#define COPY_NS_PER_BYTE	2
+#define TICK_NS				1000000
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t data[NUM_PAGES * EEPROM_PAGE_SIZE];
+
+//-------------------- Measuring transport --------------------//
+// Wraps a simulated transport, recording idle gaps and CPU time
+static const EepromTransport* base;
+static uint64_t gapNs;
+static uint64_t cpuNs;
+static uint64_t releaseNs;
+static uint8_t releaseIdle;			// The device was idle when chip select was last released
+
+// Chip select is high from the start of a deselect call to the end of the next select call
+static void model_Asserted(void)
+{
+	if(releaseIdle && sim.busyUntilNs <= sim.timeNs)
+	{
+		gapNs += sim.timeNs - releaseNs;
+	}
+	releaseIdle = FALSE;
+}
+
+static void model_Released(uint64_t ns)
+{
+	releaseNs = ns;
+	releaseIdle = (sim.busyUntilNs <= sim.timeNs);
+}
+
+static void model_Select(Eeprom* eeprom)
+{
+	uint64_t startNs = sim.timeNs;
+	base->select(eeprom);
+	cpuNs += sim.timeNs - startNs;
+	model_Asserted();
+}
+
+static void model_Deselect(Eeprom* eeprom)
+{
+	uint64_t startNs = sim.timeNs;
+	base->deselect(eeprom);
+	cpuNs += sim.timeNs - startNs;
+	model_Released(startNs);
+}
+
+static EepromErrorState model_Transmit(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	uint64_t startNs = sim.timeNs;
+	EepromErrorState status = base->transmit(eeprom, pData, len);
+	cpuNs += sim.timeNs - startNs;
+	return status;
+}
+
+static EepromErrorState model_Receive(Eeprom* eeprom, uint8_t* pData, uint32_t len)
+{
+	uint64_t startNs = sim.timeNs;
+	EepromErrorState status = base->receive(eeprom, pData, len);
+	cpuNs += sim.timeNs - startNs;
+	return status;
+}
+
+static EepromErrorState model_TransmitReceive(Eeprom* eeprom, uint8_t* txData, uint8_t* rxData, uint32_t len)
+{
+	uint64_t startNs = sim.timeNs;
+	EepromErrorState status = base->transmitReceive(eeprom, txData, rxData, len);
+	cpuNs += sim.timeNs - startNs;
+	return status;
+}
+
+static uint32_t model_GetTick(Eeprom* eeprom)
+{
+	return base->getTick(eeprom);
+}
+
+static EepromErrorState model_Transfer(Eeprom* eeprom, const EepromSegment* segments, uint8_t numSegments)
+{
+	// One call: chip select is asserted after the call overhead and released at the end
+	uint64_t startNs = sim.timeNs;
+	sim.timeNs += sim.callOverheadNs;
+	model_Asserted();
+	sim.timeNs = startNs;
+	EepromErrorState status = base->transfer(eeprom, segments, numSegments);
+	cpuNs += sim.timeNs - startNs;
+	model_Released(sim.timeNs);
+	return status;
+}
+
+static EepromErrorState model_StartAsync(Eeprom* eeprom, const EepromSegment* segment)
+{
+	// Start and completion interrupt. The completion may start the next step inline.
+	cpuNs += 2 * sim.callOverheadNs;
+	return base->startAsync(eeprom, segment);
+}
+
+static EepromTransport modelTransport =
+{
+	0,
+	NULL,
+	model_Select,
+	model_Deselect,
+	model_Transmit,
+	model_Receive,
+	model_TransmitReceive,
+	model_GetTick,
+	model_Transfer,
+	model_StartAsync
+};
+
+//-------------------- Page write before the sequence engine --------------------//
+static EepromErrorState old_PollReady(void)
+{
+	const EepromTransport* transport = eeprom.transport;
+	uint8_t txBuf = RDSR_CMD;
+	uint8_t rxBuf = 0xff;
+	transport->select(&eeprom);
+	transport->transmit(&eeprom, &txBuf, 1);
+	uint32_t startMs = transport->getTick(&eeprom);
+	while((transport->getTick(&eeprom) - startMs) < READY_CHECK_TIMEOUT)
+	{
+		transport->receive(&eeprom, &rxBuf, 1);
+		if(!((rxBuf >> WIP_BIT) & 1))
+		{
+			break;
+		}
+	}
+	transport->deselect(&eeprom);
+	return ((rxBuf >> WIP_BIT) & 1) ? EepromBusy : EepromOk;
+}
+
+static EepromErrorState old_PageWrite(uint8_t* pData, uint32_t len, uint32_t dataAddr)
+{
+	const EepromTransport* transport = eeprom.transport;
+	uint8_t wren = WREN_CMD;
+	transport->select(&eeprom);
+	transport->transmit(&eeprom, &wren, 1);
+	transport->deselect(&eeprom);
+
+	uint8_t txPacket[4 + EEPROM_PAGE_SIZE];
+	txPacket[0] = WRITE_CMD;
+	txPacket[1] = (uint8_t)((dataAddr >> 16) & 0xff);
+	txPacket[2] = (uint8_t)((dataAddr >> 8) & 0xff);
+	txPacket[3] = (uint8_t)(dataAddr & 0xff);
+	memcpy(&txPacket[4], pData, len);
+	eeprom_SimIdle(&sim, (uint64_t)len * COPY_NS_PER_BYTE);
+	cpuNs += (uint64_t)len * COPY_NS_PER_BYTE;
+
+	EepromErrorState status = old_PollReady();
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	transport->select(&eeprom);
+	transport->transmit(&eeprom, txPacket, 4 + len);
+	transport->deselect(&eeprom);
+	return old_PollReady();
+}
+
+//-------------------- Benchmark --------------------//
+typedef enum
+{
+	ModeOld,
+	ModeSeqRun,
+	ModeSeqStart
+} Mode;
+
+static int run(uint8_t* mem, const char* name, const EepromTransport* transport, Mode mode)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	base = transport;
+	modelTransport.caps = transport->caps;
+	eeprom.transport = &modelTransport;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+	gapNs = 0;
+	cpuNs = 0;
+	releaseIdle = FALSE;
+	uint32_t startCalls = sim.calls;
+	uint64_t startNs = sim.timeNs;
+	uint64_t detectNs = 0;
+
+	EepromErrorState status = EepromOk;
+	for(uint32_t page=0; page<NUM_PAGES && status == EepromOk; page++)
+	{
+		uint8_t* pData = &data[page * EEPROM_PAGE_SIZE];
+		uint32_t dataAddr = WRITE_ADDR + (page * EEPROM_PAGE_SIZE);
+		EepromSeqPageWrite pageWrite;
+		uint8_t numSteps = eeprom_SeqBuildPageWrite(&pageWrite, pData, EEPROM_PAGE_SIZE, dataAddr, FALSE);
+		if(mode == ModeOld)
+		{
+			status = old_PageWrite(pData, EEPROM_PAGE_SIZE, dataAddr);
+		}
+		else if(mode == ModeSeqRun)
+		{
+			status = eeprom_SeqRun(&eeprom, pageWrite.steps, numSteps);
+		}
+		else
+		{
+			EepromSeq seq = {0};
+			status = eeprom_SeqStart(&seq, &eeprom, pageWrite.steps, numSteps);
+			while(status == EepromOk && seq.running)
+			{
+				// The application runs until the next tick
+				eeprom_SimIdle(&sim, TICK_NS - (sim.timeNs % TICK_NS));
+				eeprom_SeqTick(&seq);
+			}
+			if(status == EepromOk)
+			{
+				status = seq.result;
+			}
+		}
+		// Time from the end of the write cycle until the driver saw it
+		detectNs += sim.timeNs - sim.busyUntilNs;
+	}
+	int ok = (status == EepromOk && memcmp(&mem[WRITE_ADDR], data, sizeof(data)) == 0);
+	printf("%-34s %6.2f calls  %7.2f uS gaps  %8.1f uS CPU  %7.1f uS to detect  %6.2f mS/page  %s\n", name,
+			(double)(sim.calls - startCalls) / NUM_PAGES, gapNs / 1e3 / NUM_PAGES, cpuNs / 1e3 / NUM_PAGES,
+			detectNs / 1e3 / NUM_PAGES, (sim.timeNs - startNs) / 1e6 / NUM_PAGES, ok ? "ok" : "MISMATCH");
+	return !ok;
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	for(uint32_t i=0; i<sizeof(data); i++)
+	{
+		data[i] = (uint8_t)rand();
+	}
+	printf("%u page writes of %u bytes, per page write:\n", NUM_PAGES, EEPROM_PAGE_SIZE);
+	int rc = 0;
+	rc |= run(mem, "old WREN/WRITE/RDSR calls", &eepromTransportSim, ModeOld);
+	rc |= run(mem, "eeprom_SeqRun, per segment", &eepromTransportSim, ModeSeqRun);
+	rc |= run(mem, "eeprom_SeqRun, segment lists", &eepromTransportSimBurst, ModeSeqRun);
+	rc |= run(mem, "eeprom_SeqStart, async + 1 mS tick", &eepromTransportSimBurst, ModeSeqStart);
+	return rc;
+}
@@ -0,0 +1,209 @@
+/*
+ * eeprom_shadow_check.c
+ *
+ * Host tool: compares the register shadowed driver against the instruction sequences the
+ * driver sent before (re-reading the registers on every call, and sending writes and erases
+ * the device then ignores), on the simulated device with block protection set and the ID
+ * pages locked. Reports transport calls, bus time and silently ignored instructions.
+ *
+ * Build from the repository root (M95P32 only, the M95M04 has no configuration register), e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_shadow_check tools/eeprom_shadow_check.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include "eeprom_seq.h"
+#include "eeprom_m95.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(M95P32)
+#error "eeprom_shadow_check needs the M95P32 (block protection and ID page lock)"
+#endif
+
+#define NUM_OPS				100
+#define RECORD_LEN			32
+#define PROTECTED_ADDR		(EEPROM_DEVICE_SIZE - EEPROM_BLOCK_SIZE)	// BP level 1, top 1/64
+#define OPEN_ADDR			0x1000
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t record[RECORD_LEN];
+
+typedef struct
+{
+	uint32_t calls;
+	uint64_t timeNs;
+	uint32_t silent;			// Calls returning EepromOk for instructions the device ignored
+	uint32_t rejected;			// Calls rejected by the driver
+} Result;
+
+//-------------------- Sequences sent before shadowing --------------------//
+static EepromErrorState raw_Write(uint8_t* pData, uint32_t len, uint32_t dataAddr)
+{
+	EepromSeqPageWrite seq;
+	uint8_t numSteps = eeprom_SeqBuildPageWrite(&seq, pData, (uint16_t)len, dataAddr, FALSE);
+	return eeprom_SeqRun(&eeprom, seq.steps, numSteps);
+}
+
+static EepromErrorState raw_EraseSector(uint32_t dataAddr)
+{
+	m95_WriteEnable(&eeprom);
+	uint8_t txPacket[4] = {SCER_CMD, (uint8_t)(dataAddr >> 16), (uint8_t)(dataAddr >> 8), (uint8_t)dataAddr};
+	EepromSegment segment = {txPacket, NULL, 4};
+	EepromErrorState status = m95_Transfer(&eeprom, &segment, 1);
+	return (status != EepromOk) ? status : m95_PollReady(&eeprom, SECTOR_ERASE_TIMEOUT);
+}
+
+static EepromErrorState raw_WriteIdPage(uint8_t* pData, uint32_t len, uint32_t dataAddr)
+{
+	m95_WriteEnable(&eeprom);
+	uint8_t txPacket[4] = {WRID_CMD, (uint8_t)(dataAddr >> 16), (uint8_t)(dataAddr >> 8), (uint8_t)dataAddr};
+	EepromSegment segments[2] = {{txPacket, NULL, 4}, {pData, NULL, len}};
+	EepromErrorState status = m95_Transfer(&eeprom, segments, 2);
+	return (status != EepromOk) ? status : m95_PollReady(&eeprom, READY_CHECK_TIMEOUT);
+}
+
+static EepromErrorState raw_IdPageLocked(uint8_t* locked)
+{
+	uint8_t configReg, safetyReg;
+	EepromErrorState status = eeprom_ReadConfigRegisters(&eeprom, &configReg, &safetyReg);
+	*locked = (configReg >> EEPROM_CONFIG_LID_BIT) & 1;
+	return status;
+}
+
+static EepromErrorState raw_SetBlockProtection(uint8_t bpLevel, uint8_t protectBottom)
+{
+	uint8_t statusReg;
+	EepromErrorState status = m95_ReadStatusRegister(&eeprom, &statusReg);
+	if(status != EepromOk)
+	{
+		return status;
+	}
+	statusReg &= ~((1 << BP2_BIT) | (1 << BP1_BIT) | (1 << BP0_BIT) | (1 << TB_BIT));
+	statusReg |= (uint8_t)((bpLevel << BP0_BIT) | (protectBottom ? (1 << TB_BIT) : 0));
+	return m95p32_WriteStatusConfigRegisters(&eeprom, statusReg, 0, FALSE);
+}
+
+//-------------------- Workloads --------------------//
+typedef enum
+{
+	OpWrite,
+	OpErase,
+	OpWriteIdPage,
+	OpIdPageLocked,
+	OpSetProtection,
+	NUM_WORKLOADS
+} Workload;
+
+static const char* workloadNames[NUM_WORKLOADS] =
+{
+	"protected eeprom_Write",
+	"eeprom_EraseSector (BP set)",
+	"eeprom_WriteIdPage (locked)",
+	"eeprom_IdPageLocked",
+	"eeprom_SetBlockProtection",
+};
+
+static void setup(uint8_t* mem)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	eeprom.transport = &eepromTransportSim;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+	eeprom_LockIdPage(&eeprom);
+	eeprom_SetBlockProtection(&eeprom, 1, 0);
+	eeprom_ClearSafetyFlags(&eeprom);
+}
+
+static Result run(Workload workload, uint8_t shadowed)
+{
+	Result result = {0, 0, 0, 0};
+	uint32_t startCalls = sim.calls;
+	uint64_t startNs = sim.timeNs;
+	for(uint32_t i=0; i<NUM_OPS; i++)
+	{
+		uint32_t rejectedBefore = sim.rejected;
+		uint8_t locked;
+		EepromErrorState status;
+		switch(workload)
+		{
+			case OpWrite:
+				status = shadowed ? eeprom_Write(&eeprom, record, RECORD_LEN, PROTECTED_ADDR + i * RECORD_LEN)
+						: raw_Write(record, RECORD_LEN, PROTECTED_ADDR + i * RECORD_LEN);
+				break;
+			case OpErase:
+				status = shadowed ? eeprom_EraseSector(&eeprom, OPEN_ADDR) : raw_EraseSector(OPEN_ADDR);
+				break;
+			case OpWriteIdPage:
+				status = shadowed ? eeprom_WriteIdPage(&eeprom, record, RECORD_LEN, EEPROM_ID_USER_PAGE_ADDR)
+						: raw_WriteIdPage(record, RECORD_LEN, EEPROM_ID_USER_PAGE_ADDR);
+				break;
+			case OpIdPageLocked:
+				status = shadowed ? eeprom_IdPageLocked(&eeprom, &locked) : raw_IdPageLocked(&locked);
+				break;
+			default:
+				status = shadowed ? eeprom_SetBlockProtection(&eeprom, 1, 0) : raw_SetBlockProtection(1, 0);
+				break;
+		}
+		if(status == EepromOk && sim.rejected != rejectedBefore)
+		{
+			result.silent++;
+		}
+		else if(status == EepromStorageError)
+		{
+			result.rejected++;
+		}
+	}
+	result.calls = sim.calls - startCalls;
+	result.timeNs = sim.timeNs - startNs;
+	return result;
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	for(uint32_t i=0; i<RECORD_LEN; i++)
+	{
+		record[i] = (uint8_t)i;
+	}
+	printf("%u calls each, BP level 1 (0x%x-0x%x protected), ID pages locked\n", NUM_OPS, PROTECTED_ADDR, EEPROM_DEVICE_SIZE - 1);
+	printf("%-28s %22s %22s %14s\n", "", "transport calls", "bus time (mS)", "silent fails");
+	int rc = 0;
+	for(uint8_t w=0; w<NUM_WORKLOADS; w++)
+	{
+		setup(mem);
+		Result before = run((Workload)w, FALSE);
+		setup(mem);
+		Result after = run((Workload)w, TRUE);
+		printf("%-28s %10u -> %8u %12.2f -> %7.2f %6u -> %5u\n", workloadNames[w], before.calls, after.calls,
+				before.timeNs / 1e6, after.timeNs / 1e6, before.silent, after.silent);
+		rc |= (after.silent != 0);
+		// Every write or erase into the protected state must now be rejected up front
+		rc |= (w <= OpWriteIdPage && after.rejected != NUM_OPS);
+	}
+
+	// Writes outside the protected range still go through, and the array is untouched inside it
+	setup(mem);
+	memset(&mem[PROTECTED_ADDR], 0x5a, RECORD_LEN);
+	int ok = eeprom_Write(&eeprom, record, RECORD_LEN, OPEN_ADDR) == EepromOk
+			&& memcmp(&mem[OPEN_ADDR], record, RECORD_LEN) == 0
+			&& eeprom_Write(&eeprom, record, RECORD_LEN, PROTECTED_ADDR - RECORD_LEN / 2) == EepromStorageError
+			&& mem[PROTECTED_ADDR] == 0x5a;
+
+	// After a reset the shadows are reloaded, and lowering the protection opens the range
+	ok &= eeprom_Reset(&eeprom) == EepromOk && eeprom.shadowValid == EEPROM_SHADOW_STATUS;
+	ok &= eeprom_SetBlockProtection(&eeprom, 0, 0) == EepromOk
+			&& eeprom_Write(&eeprom, record, RECORD_LEN, PROTECTED_ADDR) == EepromOk
+			&& memcmp(&mem[PROTECTED_ADDR], record, RECORD_LEN) == 0
+			&& eeprom_EraseSector(&eeprom, OPEN_ADDR) == EepromOk && mem[OPEN_ADDR] == 0xff;
+	printf("unprotected writes, reset: %s\n", ok ? "ok" : "FAILED");
+	rc |= !ok;
+	return rc;
+}
@@ -0,0 +1,106 @@
+/*
+ * eeprom_transport_bench.c
+ *
+ * Host tool: measures the per-call cost of the transport forms on the simulated device.
+ * Runs common operations through a transport that takes one call per segment and chip
+ * select change (a transport without transfer()) and one that takes a whole segment list
+ * per call (EEPROM_TRANSPORT_CAP_SEGMENTS, as the HAL and Arduino backends), at several
+ * software costs per call. Reports transport calls and time per operation, and the share
+ * spent in call overhead rather than on the bus.
+ *
+ * Build from the repository root, defining the same device as the firmware, e.g.
+ *   gcc -O2 -DM95P32 -DEEPROM_SIM -Iinclude -Isrc -o eeprom_transport_bench tools/eeprom_transport_bench.c \
+ *       src/eeprom.c src/eeprom_seq.c src/eeprom_sim.c
+ */
+
+#include "eeprom.h"
+#include "eeprom_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_OPS				100
+#define OP_ADDR				0x2000
+
+static EepromSim sim;
+static Eeprom eeprom;
+static uint8_t buf[4096];
+
+typedef enum
+{
+	OpStatus,
+	OpRead16,
+	OpRead256,
+	OpRead4k,
+	OpWriteStart,
+	NUM_OP_TYPES
+} OpType;
+
+static const char* opNames[NUM_OP_TYPES] = {"status read", "16 B read", "256 B read", "4 KB read", "page write start"};
+
+static EepromErrorState runOp(OpType op)
+{
+	uint8_t busy;
+	switch(op)
+	{
+		case OpStatus: return eeprom_IsBusy(&eeprom, &busy);
+		case OpRead16: return eeprom_Read(&eeprom, buf, 16, OP_ADDR);
+		case OpRead256: return eeprom_Read(&eeprom, buf, 256, OP_ADDR);
+		case OpRead4k: return eeprom_Read(&eeprom, buf, 4096, OP_ADDR);
+		default:
+		{
+			EepromErrorState status = eeprom_WritePageStart(&eeprom, buf, 32, OP_ADDR);
+			// Let the cycle finish outside the measurement
+			sim.busyUntilNs = sim.timeNs;
+			return status;
+		}
+	}
+}
+
+static int run(uint8_t* mem, const char* name, const EepromTransport* transport, uint32_t overheadNs)
+{
+	eeprom_SimInit(&sim, mem, NULL);
+	sim.callOverheadNs = overheadNs;
+	eeprom.transport = transport;
+	eeprom.transportCtx = &sim;
+	eeprom_Init(&eeprom);
+	int rc = 0;
+	printf("%-14s %4.2f uS/call", name, overheadNs / 1e3);
+	for(uint8_t op=0; op<NUM_OP_TYPES; op++)
+	{
+		uint64_t startNs = sim.timeNs;
+		uint32_t startCalls = sim.calls;
+		for(uint32_t i=0; i<NUM_OPS; i++)
+		{
+			rc |= (runOp((OpType)op) != EepromOk);
+		}
+		double calls = (double)(sim.calls - startCalls) / NUM_OPS;
+		double us = (sim.timeNs - startNs) / 1e3 / NUM_OPS;
+		printf("  %4.1f %7.2f uS %3.0f%%", calls, us, 100.0 * calls * overheadNs / 1e3 / us);
+	}
+	printf("\n");
+	return rc;
+}
+
+int main(void)
+{
+	uint8_t* mem = malloc(EEPROM_DEVICE_SIZE);
+	if(mem == NULL)
+	{
+		return 1;
+	}
+	static const uint32_t overheads[] = {250, 1000, 5000};
+	printf("Per operation: transport calls, time, share in call overhead\n");
+	printf("%-27s", "");
+	for(uint8_t op=0; op<NUM_OP_TYPES; op++)
+	{
+		printf("  %-20s", opNames[op]);
+	}
+	printf("\n");
+	int rc = 0;
+	for(uint8_t i=0; i<sizeof(overheads) / sizeof(overheads[0]); i++)
+	{
+		rc |= run(mem, "per segment", &eepromTransportSim, overheads[i]);
+		rc |= run(mem, "segment lists", &eepromTransportSimBurst, overheads[i]);
+	}
+	return rc;
+}